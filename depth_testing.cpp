@@ -16,10 +16,10 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
-void drawScene(Shader normalShader, unsigned int containerTexture, unsigned int floorTexture, unsigned int planeVAO, unsigned int cubeVAO, bool isMirrored);
-void drawTwoCubes(Shader shader, unsigned int cubeVAO, unsigned int cubeTexture, float scale);
-void drawFloor(Shader shader, unsigned int planeVAO, unsigned int floorTexture);
-void drawWindow(Shader shader, unsigned int windowVAO, unsigned int texture);
+void drawScene(Shader &normalShader, unsigned int containerTexture, unsigned int floorTexture, unsigned int planeVAO, unsigned int cubeVAO, bool isMirrored);
+void drawTwoCubes(Shader &shader, unsigned int cubeVAO, unsigned int cubeTexture, float scale);
+void drawFloor(Shader &shader, unsigned int planeVAO, unsigned int floorTexture);
+void drawWindow(Shader &shader, unsigned int windowVAO, unsigned int texture);
 
 // settings
 const unsigned int SCR_WIDTH = 1280;
@@ -296,7 +296,7 @@ int main()
 	return 0;
 }
 
-void drawScene(Shader normalShader, unsigned int containerTexture, unsigned int floorTexture, unsigned int planeVAO, unsigned int cubeVAO, bool isMirrored)
+void drawScene(Shader &normalShader, unsigned int containerTexture, unsigned int floorTexture, unsigned int planeVAO, unsigned int cubeVAO, bool isMirrored)
 {
 	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
@@ -311,8 +311,7 @@ void drawScene(Shader normalShader, unsigned int containerTexture, unsigned int
 
 	glm::mat4 view = camera.GetViewMatrix();
 	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-	normalShader.setMat4("view", view);
-	normalShader.setMat4("projection", projection);
+	FrameUniforms::Get().Update(view, projection, camera.Position, glfwGetTime());
 
 	drawFloor(normalShader, planeVAO, floorTexture);
 	drawTwoCubes(normalShader, cubeVAO, containerTexture, 1.0f);
@@ -324,7 +323,7 @@ void drawScene(Shader normalShader, unsigned int containerTexture, unsigned int
 	// drawWindow(normalShader, quadVAO, windowTexture);
 }
 
-void drawTwoCubes(Shader shader, unsigned int cubeVAO, unsigned int cubeTexture, float scale)
+void drawTwoCubes(Shader &shader, unsigned int cubeVAO, unsigned int cubeTexture, float scale)
 {
 	// cubes
 	glBindVertexArray(cubeVAO);
@@ -342,7 +341,7 @@ void drawTwoCubes(Shader shader, unsigned int cubeVAO, unsigned int cubeTexture,
 	glDrawArrays(GL_TRIANGLES, 0, 36);
 }
 
-void drawFloor(Shader shader, unsigned int planeVAO, unsigned int floorTexture)
+void drawFloor(Shader &shader, unsigned int planeVAO, unsigned int floorTexture)
 {
 	// floor
 	glBindVertexArray(planeVAO);
@@ -352,7 +351,7 @@ void drawFloor(Shader shader, unsigned int planeVAO, unsigned int floorTexture)
 	glBindVertexArray(0);
 }
 
-void drawWindow(Shader shader, unsigned int quadVAO, unsigned int texture)
+void drawWindow(Shader &shader, unsigned int quadVAO, unsigned int texture)
 {
 	// Sorting the windows
 	// -------------------
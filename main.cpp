@@ -7,9 +7,14 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <assimp/Importer.hpp>
+// Counts allocations for the startup report
+#define STARTUP_PROFILER_IMPLEMENTATION
+#include "src/core/startup_profiler.h"
 #include "src/graphics/camera.h"
 #include "src/graphics/shader.h"
+#include "src/graphics/hot_reload.h"
 #include "src/graphics/model.h"
+#include "src/graphics/instance_buffer.h"
 #include "src/graphics/light/direction_light.h"
 #include "src/graphics/light/spot_light.h"
 #include "src/graphics/light/point_light.h"
@@ -18,7 +23,10 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xOffset, double yOffset);
 void processInput(GLFWwindow *window);
-void displayMap(Shader *shader, unsigned int VAO, unsigned int diffuseMap, unsigned int specularMap);
+void submitMap(RenderQueue &queue, Shader *shader, unsigned int tileVAO, unsigned int markerVAO, unsigned int diffuseMap, unsigned int specularMap);
+void updateTileInstances();
+void updateMarkerInstances();
+unsigned int createInstancedCube(unsigned int VBO, InstanceBuffer *instances);
 void getPositionFromTileIndex(unsigned int index, glm::vec3 *positions);
 bool canMoveToPosition(glm::vec3 currentPosition);
 
@@ -27,13 +35,13 @@ glm::vec3 castRay(glm::vec3, glm::vec3, float);
 glm::vec3 handleObjectAtPos(glm::vec3);
 unsigned int getTileAt(unsigned int col, unsigned int row);
 void setTileAt(unsigned int col, unsigned int row, unsigned int value);
-void setupLights(Shader *lampShader, Shader *objectShader, DirectionLight *directionLight, PointLight pointLights[], unsigned int pointLightCount, SpotLight *spotLight, unsigned int VAO);
+void setupLights(RenderQueue &queue, Shader *lampShader, DirectionLight *directionLight, PointLight pointLights[], unsigned int pointLightCount, SpotLight *spotLight, unsigned int VAO);
 unsigned int loadCubemap(vector<std::string> faces);
 
-void displayNanosuit(Model *nanosuit, Shader *shader);
-void displayWindows(Shader *shader, unsigned int quadVAO, unsigned int texture);
-void drawPlanet(Model *planet, Shader *shader, float scale);
-void displayPlanet(Model *planet, Shader *, Shader *);
+void submitNanosuit(RenderQueue &queue, Model *nanosuit, Shader *shader, const glm::mat4 &view, const glm::mat4 &projection);
+void submitWindows(RenderQueue &queue, Shader *shader, unsigned int quadVAO, unsigned int texture);
+void submitPlanet(RenderQueue &queue, Model *planet, Shader *, Shader *);
+void submitSkybox(RenderQueue &queue, Shader *shader, unsigned int skyboxVAO, unsigned int cubemap);
 
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
@@ -58,6 +66,13 @@ unsigned int g_postProcessor = 0;
 
 glm::vec3 g_windowLocations[6];
 
+// Model matrices of the map cubes, rebuilt when setTileAt changes the map or castRay moves
+// the markers
+InstanceBuffer g_tileInstances;
+InstanceBuffer g_markerInstances;
+bool g_isMapDirty = true;
+bool g_areMarkersDirty = true;
+
 unsigned int tileMap[][g_mapRow] = {
  	{ 3, 2, 2, 2, 2, 2, 2, 3 },
 	{ 1, 0, 0, 0, 0, 0, 0, 1 },
@@ -203,6 +218,7 @@ vector<std::string> faces
 
 int main()
 {
+	StartupProfiler::Get().BeginPhase("window");
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -217,11 +233,13 @@ int main()
 	}
 	glfwMakeContextCurrent(window);
 
+	StartupProfiler::Get().BeginPhase("gl init");
 	if ( !gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 	{
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+	ProgramCache::Get().Init((GLADloadproc)glfwGetProcAddress);
 
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
@@ -239,18 +257,28 @@ int main()
 	glEnable(GL_DEPTH_TEST);
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+	// Packed by tools/asset_packer (make pack_assets), loose files are used without it
+	Vfs::Get().Mount("assets.pak");
+
 	// SHADERS
 	// -------
-	Shader lightingShader("shaders/color.vs", "shaders/color.fs");
+	StartupProfiler::Get().BeginPhase("shaders");
+	unsigned int pointLightCount = sizeof(pointLights) / sizeof(pointLights[0]);
+	Shader lightingShader("shaders/color.vs", "shaders/color.fs", ShaderDefines().Set("HAS_SPECULAR", 0));
+	Shader mapShader("shaders/color.vs", "shaders/color.fs", ShaderDefines().Set("HAS_SPECULAR", 0).Set("INSTANCED", 1));
 	Shader nanoShader("shaders/test-nano.vs", "shaders/test-nano.fs");
 	Shader lampShader("shaders/lamp.vs", "shaders/lamp.fs");
 	Shader borderShader("shaders/depth_testing.vs", "shaders/border.fs");
 	Shader simpleShader("shaders/depth_testing.vs", "shaders/depth_testing.fs");
 	Shader skyboxShader("shaders/skybox.vs", "shaders/skybox.fs");
-	Shader frameBufferShader("shaders/framebuffer.vs", "shaders/framebuffer.fs");
+	// One program per post effect, built now so switching effects never compiles mid frame
+	ShaderPermutations frameBufferShaders("shaders/framebuffer.vs", "shaders/framebuffer.fs");
+	for (unsigned int i = 0; i <= 6; i++)
+		frameBufferShaders.Prepare(ShaderDefines().Set("POST_EFFECT", i));
 	
 	// CONFIGURATION
 	// -------------
+	StartupProfiler::Get().BeginPhase("buffers");
 	unsigned int VBO, VAO, EBO;
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
@@ -271,6 +299,10 @@ int main()
 	
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+	// The same cube drawn once per tile and once per marker, see submitMap
+	unsigned int tileVAO = createInstancedCube(VBO, &g_tileInstances);
+	unsigned int markerVAO = createInstancedCube(VBO, &g_markerInstances);
+
 	// Quad vertices
 	unsigned int quadVAO, quadVBO;
 	glGenVertexArrays(1, &quadVAO);
@@ -295,14 +327,18 @@ int main()
 
 	// TEXTURES SETUP
 	// --------------
-	stbi_set_flip_vertically_on_load(true);
-	unsigned int diffuseMap = Shader::LoadTextureFromFile("tile.png", "assets");
-	unsigned int specularMap = Shader::LoadTextureFromFile("container2_specular.png", "assets/textures");
-	unsigned int windowTexture = Shader::LoadTextureFromFile("blending_transparent_window.png", "assets/textures");
+	StartupProfiler::Get().BeginPhase("textures");
+	TextureLoader::SetFlipVertically(true);
+	// Textures give up mip levels beyond this instead of letting the driver page
+	TextureResidency::Get().SetBudget(256 * 1024 * 1024);
+	unsigned int diffuseMap = TextureRegistry::Get().Acquire("assets/tile.png");
+	unsigned int specularMap = TextureRegistry::Get().Acquire("assets/textures/container2_specular.png");
+	unsigned int windowTexture = TextureRegistry::Get().Acquire("assets/textures/blending_transparent_window.png");
 	unsigned int skyboxTexture = loadCubemap(faces);	
 
 	// FRAMEBUFFER SETUP
 	// -----------------
+	StartupProfiler::Get().BeginPhase("framebuffer");
 	unsigned int frameBuffer;
 	glGenFramebuffers(1, &frameBuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
@@ -334,7 +370,7 @@ int main()
 
 	// LIGHTS SETUP
 	// ------------
-	unsigned int pointLightCount = sizeof(pointLights) / sizeof(pointLights[0]);
+	StartupProfiler::Get().BeginPhase("scene setup");
 	DirectionLight directionLight(glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.5f, -1.0f, 0.5f));
 	directionLight.AmbientIntensity = 0.01f;
 	directionLight.DiffuseIntensity = 0.2f;
@@ -344,10 +380,13 @@ int main()
 	// SHADERS SETUP
 	// -------------
 	lightingShader.use();
-	lightingShader.setInt("pointLightCount", pointLightCount);
 	lightingShader.setInt("material.texture_diffuse1", 0);
 	lightingShader.setInt("material.texture_specular1", 1);
 
+	mapShader.use();
+	mapShader.setInt("material.texture_diffuse1", 0);
+	mapShader.setInt("material.texture_specular1", 1);
+
 	nanoShader.use();
 	nanoShader.setInt("material.texture_diffuse1", 0);
 	nanoShader.setInt("material.texture_specular1", 1);
@@ -365,86 +404,60 @@ int main()
 
 	// MODELS SETUP
 	// ------------
-	Model planet("assets/planet/planet.obj");
-	Model nanosuit("assets/nanosuit/nanosuit.obj");
-
+	StartupProfiler::Get().BeginPhase("models");
+	Model planet("assets/planet/planet.obj", MODEL_LOAD_ASYNC);
+	Model nanosuit("assets/nanosuit/nanosuit.obj", MODEL_LOAD_ASYNC, VertexFormat::Packed());
+
+	// Edited shaders and textures are picked up without restarting
+	HotReload::Get().Start();
+	RenderQueue renderQueue;
+	StartupProfiler::Get().BeginPhase("first frame");
 	
 	while(!glfwWindowShouldClose(window))
 	{
+		HotReload::Get().Update();
+		TextureResidency::Get().Update();
 		processInput(window);
 
+		// Models still streaming in get a small slice of the frame each
+		planet.Update();
+		nanosuit.Update();
+
 		// --------------------------------
 		// Drawing
 		// --------------------------------
 		glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);//0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
-		glEnable(GL_DEPTH_TEST);
- 		glStencilMask(0x00);
 
 		glm::mat4 projection = glm::perspective(glm::radians(g_camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 		glm::mat4 view = g_camera.GetViewMatrix();
 
-		// Shaders setup
-		lightingShader.use();
-		lightingShader.setMat4("projection", projection);
-		lightingShader.setMat4("view", view);
-		lightingShader.setVec3("viewPos", g_camera.Position);
-		
-		nanoShader.use();
-		nanoShader.setMat4("projection", projection);
-		nanoShader.setMat4("view", view);
-		nanoShader.setVec3("viewPos", g_camera.Position);
-
-		lampShader.use();
-		lampShader.setMat4("projection", projection);
-		lampShader.setMat4("view", view);
-
-		simpleShader.use();
-		simpleShader.setMat4("projection", projection);
-		simpleShader.setMat4("view", view);
-
-		borderShader.use();
-		borderShader.setMat4("projection", projection);
-		borderShader.setMat4("view", view);
-
-		skyboxShader.use();
-		lightingShader.setMat4("projection", projection);
-		lightingShader.setMat4("view", view);
-
-		setupLights(&lampShader, &lightingShader, &directionLight, pointLights, pointLightCount, &spotLight, VAO);
-
-		displayMap(&lightingShader, VAO, diffuseMap, specularMap);
-		displayNanosuit(&nanosuit, &nanoShader);
-		displayPlanet(&planet, &lightingShader, &borderShader);
-		displayWindows(&simpleShader, quadVAO, windowTexture);
-
-		// Skybox
-		glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-		skyboxShader.use();
-		view = glm::mat4(glm::mat3(g_camera.GetViewMatrix())); // remove translation from the view matrix
-		skyboxShader.setMat4("view", view);
-		skyboxShader.setMat4("projection", projection);
-
-		// skybox cube
-		glBindVertexArray(skyboxVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
-		glDepthFunc(GL_LESS); // set depth function back to default		
+		// Camera data for every shader, in one buffer write
+		FrameUniforms::Get().Update(view, projection, g_camera.Position, glfwGetTime());
+
+		// Everything is queued in any order, the queue sorts it by pass and state
+		renderQueue.Begin(g_camera.Position);
+		setupLights(renderQueue, &lampShader, &directionLight, pointLights, pointLightCount, &spotLight, VAO);
+
+		submitMap(renderQueue, &mapShader, tileVAO, markerVAO, diffuseMap, specularMap);
+		submitNanosuit(renderQueue, &nanosuit, &nanoShader, view, projection);
+		submitPlanet(renderQueue, &planet, &lightingShader, &borderShader);
+		submitWindows(renderQueue, &simpleShader, quadVAO, windowTexture);
+		submitSkybox(renderQueue, &skyboxShader, skyboxVAO, skyboxTexture);
+		renderQueue.Execute();
 
 		// Default buffer
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 		glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 		
+		Shader &frameBufferShader = frameBufferShaders.Get(ShaderDefines().Set("POST_EFFECT", g_postProcessor));
 		frameBufferShader.use();
 		glm::mat4 model = glm::mat4(1.0f);
 		//model = glm::translate(model, glm::vec3(0, 0.5f, 0));
 		model = glm::scale(model, glm::vec3(2.0f));
 		frameBufferShader.setMat4("model", model);
-		frameBufferShader.setInt("postProcessor", g_postProcessor);
 
 		glBindVertexArray(quadVAO);
 		glDisable(GL_DEPTH_TEST);
@@ -453,6 +466,8 @@ int main()
 
  		glfwSwapBuffers(window);
 		glfwPollEvents();
+		// Written once, after the first frame is on screen
+		StartupProfiler::Get().Finish("startup_profile.json");
 
 		float currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
@@ -460,64 +475,61 @@ int main()
 	}
 
 	glDeleteVertexArrays(1, &VAO);
+	glDeleteVertexArrays(1, &tileVAO);
+	glDeleteVertexArrays(1, &markerVAO);
 	glDeleteBuffers(1, &VBO);
+	g_tileInstances.Release();
+	g_markerInstances.Release();
 	// glDeleteBuffers(1, &EBO);
+
+	planet.Unload();
+	nanosuit.Unload();
+	TextureRegistry::Get().Release(diffuseMap);
+	TextureRegistry::Get().Release(specularMap);
+	TextureRegistry::Get().Release(windowTexture);
+	TextureRegistry::Get().Release(skyboxTexture);
 	
 	glfwTerminate();
   return 0;
 }
 
-void displayNanosuit(Model *nanosuit, Shader *shader)
+void submitNanosuit(RenderQueue &queue, Model *nanosuit, Shader *shader, const glm::mat4 &view, const glm::mat4 &projection)
 {
 	glm::mat4 model = glm::mat4(1.0f);
 	model = glm::translate(model, glm::vec3(2.0f, -0.5f, 1.0f));
 	model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
 
-	shader->use();
-	shader->setMat4("model", model);
-		
-	nanosuit->Draw(*shader);
+	nanosuit->SelectLod(model, g_camera.Position, glm::radians(g_camera.Zoom), SCR_HEIGHT);
+	nanosuit->Cull(model, view, projection, g_camera.Position);
+	nanosuit->Submit(queue, RENDER_PASS_OPAQUE, shader, model);
 }
 
-void displayPlanet(Model *planet, Shader *planetShader, Shader *borderShader)
+void submitPlanet(RenderQueue &queue, Model *planet, Shader *planetShader, Shader *borderShader)
 {
 	// TODO: Planet should not have specular. Add ability to turn on and off
-	// We freeze the stencil
-	glStencilFunc(GL_ALWAYS, 1, 0xFF);
-	glStencilMask(0xFF);
-		
-	// Draw the planet
-	drawPlanet(planet, planetShader, 1.0f);
-
-	// We disable the stencil
-	glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-	glStencilMask(0x00);
-	glDisable(GL_DEPTH_TEST);
+	glm::mat4 model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(3.0f, 0.5f, -2.0f));
+	model = glm::scale(model, glm::vec3(0.3f, 0.3f, 0.3f));
+	model = glm::rotate(model, (float)glfwGetTime() / 2, glm::vec3(0.3f, 1.0f, 0.0f));
+	planet->SelectLod(model, g_camera.Position, glm::radians(g_camera.Zoom), SCR_HEIGHT);
 
-	// Draw a bigger planet
-	drawPlanet(planet, borderShader, 1.05f);
-		
-	// Return stencil to normal
-	glStencilMask(0xFF);
-	glStencilFunc(GL_ALWAYS, 1, 0xFF);
-	glEnable(GL_DEPTH_TEST);
+	// The planet marks the stencil, a bigger planet is drawn around it where it is not marked
+	planet->Submit(queue, RENDER_PASS_STENCIL_MARK, planetShader, model);
+	planet->Submit(queue, RENDER_PASS_OUTLINE, borderShader, glm::scale(model, glm::vec3(1.05f)));
 }
 
-void drawPlanet(Model *planet, Shader *shader, float scale)
+void submitSkybox(RenderQueue &queue, Shader *shader, unsigned int skyboxVAO, unsigned int cubemap)
 {
-	shader->use();
-	glm::mat4 model = glm::mat4(1.0f);
-	model = glm::translate(model, glm::vec3(3.0f, 0.5f, -2.0f));
-	model = glm::scale(model, glm::vec3(0.3f, 0.3f, 0.3f) * scale);
-	model = glm::rotate(model, (float)glfwGetTime() / 2, glm::vec3(0.3f, 1.0f, 0.0f));
-	shader->setMat4("model", model);
-	planet->Draw(*shader);
+	RenderItem &item = queue.Submit(RENDER_PASS_SKYBOX, shader, glm::mat4(1.0f), skyboxVAO, GL_TRIANGLES, 0, 36);
+	item.textureTarget = GL_TEXTURE_CUBE_MAP;
+	RenderQueue::AddTexture(item, cubemap);
 }
 
-void setupLights(Shader *lampShader, Shader *objectShader, DirectionLight *directionLight, PointLight pointLights[], unsigned int pointLightCount, SpotLight *spotLight, unsigned int VAO)
+void setupLights(RenderQueue &queue, Shader *lampShader, DirectionLight *directionLight, PointLight pointLights[], unsigned int pointLightCount, SpotLight *spotLight, unsigned int VAO)
 {
-	objectShader->use();
-	directionLight->setup(objectShader, "dirLight");
+	// Every lit shader reads the lights from one buffer, written once below
+	LightUniforms::Get().Begin();
+	directionLight->setup();
 
 	if ( g_isFlashLightOn )
 	{
@@ -525,62 +537,64 @@ void setupLights(Shader *lampShader, Shader *objectShader, DirectionLight *direc
 		spotLight->Direction = g_camera.Front;
 		spotLight->AmbientIntensity = 0.1f;
 		spotLight->DiffuseIntensity = 0.8f;
-		spotLight->setup(objectShader, "spotLight");
-	}
-	else
-	{
-		objectShader->setBool("isSpotLightSetup", false);
+		spotLight->setup();
 	}
 	
 	for ( unsigned int i = 0; i < pointLightCount ; ++i )
 	{
-		pointLights[i].use(objectShader, "pointLights[" + std::to_string(i) + "]");
+		pointLights[i].use();
 		pointLights[i].setup(VAO);
-		pointLights[i].draw(lampShader);
+		pointLights[i].submit(queue, lampShader);
 	}
+	LightUniforms::Get().Upload();
 }
 
-void displayWindows(Shader *shader, unsigned int quadVAO, unsigned int texture)
+void submitWindows(RenderQueue &queue, Shader *shader, unsigned int quadVAO, unsigned int texture)
 {
-	shader->use();
-	
-	// Sorting the windows
-	// -------------------
-	std::map<float, glm::vec3> sorted;
+	// The transparent pass sorts them back to front
 	for (unsigned int i = 0 ; i < 6; i++ )
 	{
-		float distance = glm::length(g_camera.Position - g_windowLocations[i]);
-		sorted[distance] = g_windowLocations[i];
+		glm::mat4 model = glm::mat4(1.0f);
+		model = glm::translate(model, glm::vec3(g_windowLocations[i].x, g_windowLocations[i].y, g_windowLocations[i].z + 0.52f));
+
+		RenderItem &item = queue.Submit(RENDER_PASS_TRANSPARENT, shader, model, quadVAO, GL_TRIANGLES, 0, 6);
+		RenderQueue::AddTexture(item, texture);
 	}
-	
-	glm::mat4 model;
+}
 
-	for ( std::map<float, glm::vec3>::reverse_iterator it = sorted.rbegin(); it != sorted.rend(); ++it)
+void submitMap(RenderQueue &queue, Shader *shader, unsigned int tileVAO, unsigned int markerVAO, unsigned int diffuseMap, unsigned int specularMap)
+{
+	if ( g_isMapDirty )
 	{
-		model= glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(it->second.x, it->second.y, it->second.z + 0.52f));
-	
-		glBindVertexArray(quadVAO);
-		glBindTexture(GL_TEXTURE_2D, texture);
-	
-		shader->setMat4("model", model);
-	
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+		updateTileInstances();
+		g_isMapDirty = false;
+	}
+	if ( g_areMarkersDirty )
+	{
+		updateMarkerInstances();
+		g_areMarkersDirty = false;
+	}
+
+	// Walls, floors and markers share the material, one instanced draw for the tiles and one
+	// for the markers
+	unsigned int vertexArrays[] = { tileVAO, markerVAO };
+	unsigned int instanceCounts[] = { g_tileInstances.Count(), g_markerInstances.Count() };
+	for ( unsigned int i = 0 ; i < 2 ; ++i )
+	{
+		if ( instanceCounts[i] == 0 )
+			continue;
+
+		RenderItem &item = queue.Submit(RENDER_PASS_OPAQUE, shader, glm::mat4(1.0f), vertexArrays[i], GL_TRIANGLES, 0, 36);
+		item.instanceCount = instanceCounts[i];
+		RenderQueue::AddTexture(item, diffuseMap);
+		RenderQueue::AddTexture(item, specularMap);
 	}
-	glBindVertexArray(0);
 }
 
-void displayMap(Shader *shader, unsigned int VAO, unsigned int diffuseMap, unsigned int specularMap)
+void updateTileInstances()
 {
-	shader->use();
-	
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, diffuseMap);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, specularMap);
-
+	vector<glm::mat4> models;
 	unsigned int displayWindowIndex = 0;
-	glm::vec3 position;
 	for(unsigned int row = 0; row < g_mapRow ; row++)
 	{
 		for (unsigned int col = 0; col < g_mapCol ; col++)
@@ -605,28 +619,42 @@ void displayMap(Shader *shader, unsigned int VAO, unsigned int diffuseMap, unsig
 
 			glm::mat4 model = glm::mat4(1.0f);
 			model = glm::translate(model, glm::vec3(col, yPos, row));
-			model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
-			shader->setMat4("model", model);
-
-			glBindVertexArray(VAO);
-			glDrawArrays(GL_TRIANGLES, 0, 36);
-
-			glBindVertexArray(0);
+			models.push_back(model);
 		}
 	}
+	g_tileInstances.Upload(models);
+}
 
-	// Markers
+void updateMarkerInstances()
+{
+	vector<glm::mat4> models;
 	for ( unsigned int index = 0 ; index < maxMarkerCount ; ++index )
 	{
  		glm::mat4 model = glm::mat4(1.0f);
 		model = glm::translate(model, glm::vec3(g_markers[index].x, -0.5f, g_markers[index].z));
 		model = glm::scale(model, glm::vec3(0.04f, 0.1f, 0.04f));
-		int modelLoc = glGetUniformLocation(shader->ID, "model");
-		shader->setVec4("tint", 1.0f, 0.0f, 0.0f, 1.0f);
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		models.push_back(model);
 	}
+	g_markerInstances.Upload(models);
+}
+
+unsigned int createInstancedCube(unsigned int VBO, InstanceBuffer *instances)
+{
+	unsigned int cubeVAO;
+	glGenVertexArrays(1, &cubeVAO);
+	glBindVertexArray(cubeVAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+
+	instances->Attach(cubeVAO);
+	glBindVertexArray(0);
+	return cubeVAO;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -791,12 +819,12 @@ glm::vec3 castRay(glm::vec3 startPosition, glm::vec3 rayDirection, float castDis
 {
 	// This link has helped me a lot in making this:
 	// https://theshoemaker.de/2016/02/ray-casting-in-2d-grids/
-	const float tileSize = 1.0f;
 
 	for ( unsigned int i = 0 ; i < maxMarkerCount ; ++i )
 	{
 		g_markers[i] = g_camera.Position;
 	}
+	g_areMarkersDirty = true;
 	glm::vec3 currentPosition = startPosition;
 	glm::vec3 tileCoordinate = getTileCoords(currentPosition, g_tileCenterOffset);
 
@@ -850,6 +878,7 @@ unsigned int getTileAt(unsigned int col, unsigned int row)
 void setTileAt(unsigned int col, unsigned int row, unsigned int value)
 {
 	tileMap[row][col] = value;
+	g_isMapDirty = true;
 }
 
 glm::vec3 handleObjectAtPos(glm::vec3 raycastPosition)
@@ -895,32 +924,5 @@ void getPositionFromTileIndex(unsigned int index, glm::vec3 *position)
 
 unsigned int loadCubemap(vector<std::string> faces)
 {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++)
-	{
-		unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data)
-		{
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 
-									 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-				);
-			stbi_image_free(data);
-		}
-		else
-		{
-			std::cout << "Cubemap tex failed to load at path: " << faces[i] << std::endl;
-			stbi_image_free(data);
-		}
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	return textureID;
+	return TextureRegistry::Get().AcquireCubemap(faces);
 }
@@ -7,37 +7,13 @@ struct Material {
   float shininess;
 };
 
-struct DirLight {
-  vec3 direction;
+#include "include/lights.glsl"
+#include "include/frame_data.glsl"
 
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-};
-
-struct PointLight {    
-  vec3 position;
-    
-  float constant;
-  float linear;
-  float quadratic;  
-
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-};  
-
-struct SpotLight {
-  vec3 position;
-  vec3 direction;
-
-  float cutOff;
-  float outerCutOff;
-
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-};
+// Compile time switch, see ShaderDefines
+#ifndef HAS_SPECULAR
+#define HAS_SPECULAR 0
+#endif
 
 out vec4 FragColor;
 
@@ -45,13 +21,7 @@ in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoords;
 
-uniform int hasSpecular;
-uniform vec3 viewPos;
-uniform int pointLightCount;
 uniform Material material;
-uniform DirLight dirLight;
-uniform SpotLight spotLight;
-uniform PointLight pointLights[5];
 
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);  
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
@@ -66,7 +36,8 @@ void main()
   for(int i = 0; i < pointLightCount; i++) {
     result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
   }
-  result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
+  if ( spotLightEnabled )
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
     
   FragColor = vec4(result, 1.0);
 }
@@ -82,9 +53,10 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
   // combine results
   vec3 ambient  = light.ambient  * vec3(texture(material.texture_diffuse1, TexCoords));
   vec3 diffuse  = light.diffuse  * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-  vec3 specular;
-	if ( hasSpecular > 0 )
-		specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+  vec3 specular = vec3(0.0);
+#if HAS_SPECULAR
+	specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+#endif
   return (ambient + diffuse + specular);
 }  
 
@@ -103,9 +75,10 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
   // combine results
   vec3 ambient  = light.ambient  * vec3(texture(material.texture_diffuse1, TexCoords));
   vec3 diffuse  = light.diffuse  * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-	vec3 specular;
-	if ( hasSpecular > 0 )
-		specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+	vec3 specular = vec3(0.0);
+#if HAS_SPECULAR
+	specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+#endif
 	
   ambient  *= attenuation;
   diffuse  *= attenuation;
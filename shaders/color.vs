@@ -3,9 +3,21 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
+#include "include/frame_data.glsl"
+
+// Compile time switch, see ShaderDefines. Instanced draws take the model matrix of each
+// instance from attributes 3 to 6 (see InstanceBuffer) instead of the uniform.
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+
+#if INSTANCED
+layout (location = 3) in mat4 instanceModel;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+
+#include "include/vertex_encoding.glsl"
 
 out vec3 FragPos;
 out vec3 Normal;
@@ -13,8 +25,12 @@ out vec2 TexCoords;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+#if INSTANCED
+    mat4 model = instanceModel;
+#endif
+    vec3 position = DecodePosition(aPos);
+    gl_Position = viewProjection * model * vec4(position, 1.0);
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(model))) * DecodeNormal(aNormal);
     TexCoords = aTexCoords;
 } 
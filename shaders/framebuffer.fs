@@ -4,37 +4,42 @@ out vec4 FragColor;
 in vec2 TexCoords;
 
 uniform sampler2D screenTexture;
-uniform int postProcessor = 0;
+
+// Compile time switch, see ShaderDefines: 0 normal, 1 inversion, 2 grayscale, 3 weighted
+// grayscale, 4 sharpen, 5 blur, 6 edge detection
+#ifndef POST_EFFECT
+#define POST_EFFECT 0
+#endif
 
 const float offset = 1.0 / 300.0;
 
 void main()
 {
-	if ( postProcessor == 0 )
+#if POST_EFFECT == 0
 	{
 		// Normal
 		FragColor = texture(screenTexture, TexCoords);
 	}
-	else if ( postProcessor == 1 )
+#elif POST_EFFECT == 1
 	{
 		// Inversion
 		FragColor = vec4(vec3(1.0 - texture(screenTexture, TexCoords)), 1.0);
 	}
-	else if ( postProcessor == 2 )
+#elif POST_EFFECT == 2
 	{
 		// Grayscale
 		FragColor = texture(screenTexture, TexCoords);
 		float average = (FragColor.r + FragColor.g + FragColor.b) / 3.0;
 		FragColor = vec4(average, average, average, 1.0);
 	}
-	else if ( postProcessor == 3 )
+#elif POST_EFFECT == 3
 	{
  		// Grayscale2
 		FragColor = texture(screenTexture, TexCoords);
 		float average = 0.2126 * FragColor.r + 0.7152 * FragColor.g + 0.0722 * FragColor.b;
 		FragColor = vec4(average, average, average, 1.0);
 	}
-	else
+#else
 	{
 		vec2 offsets[9] = vec2[](
 			vec2(-offset,  offset), // top-left
@@ -48,34 +53,28 @@ void main()
 			vec2( offset, -offset)  // bottom-right    
 			);
 
-		float kernel[9];
-		if ( postProcessor == 4 )
-		{
-			// Sharpen
-			kernel = float[](
-				-1, -1, -1,
-				-1,  9, -1,
-				-1, -1, -1
-				);
-		}
-		else if ( postProcessor == 5 )
-		{
-			// Blur
-			kernel = float[](
-				1.0 / 16, 2.0 / 16, 1.0 / 16,
-				2.0 / 16, 4.0 / 16, 2.0 / 16,
-				1.0 / 16, 2.0 / 16, 1.0 / 16
-				);
-		}
-		else if ( postProcessor == 6 )
-		{
-			// Edge detection
-			kernel = float[](
-				1, 1, 1,
-				1,-8, 1,
-				1, 1, 1
+#if POST_EFFECT == 4
+		// Sharpen
+		float kernel[9] = float[](
+			-1, -1, -1,
+			-1,  9, -1,
+			-1, -1, -1
 			);
-		}
+#elif POST_EFFECT == 5
+		// Blur
+		float kernel[9] = float[](
+			1.0 / 16, 2.0 / 16, 1.0 / 16,
+			2.0 / 16, 4.0 / 16, 2.0 / 16,
+			1.0 / 16, 2.0 / 16, 1.0 / 16
+			);
+#else
+		// Edge detection
+		float kernel[9] = float[](
+			1, 1, 1,
+			1,-8, 1,
+			1, 1, 1
+		);
+#endif
     
 		vec3 sampleTex[9];
 		for(int i = 0; i < 9; i++)
@@ -88,4 +87,5 @@ void main()
     
 		FragColor = vec4(col, 1.0);
 	}
+#endif
 }
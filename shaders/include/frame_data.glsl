@@ -0,0 +1,11 @@
+// Camera data shared by every program, written once per frame by FrameUniforms
+// (src/graphics/frame_uniforms.h). The layout must match its FrameData struct.
+
+layout (std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec3 viewPos;
+	float time;
+};
@@ -0,0 +1,45 @@
+// Light structs shared by the lit shaders and the block holding every light of the scene,
+// written once per frame by LightUniforms (src/graphics/light_uniforms.h). The std140
+// layouts must match its structs, a float follows each vec3 to fill its 16 bytes.
+
+#define MAX_POINT_LIGHTS 240
+
+struct DirLight {
+	vec3 direction;
+	
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+
+struct PointLight {
+	vec3 position;
+	float constant;
+	vec3 ambient;
+	float linear;
+	vec3 diffuse;
+	float quadratic;
+	vec3 specular;
+};
+
+struct SpotLight {
+	vec3 position;
+	float cutOff;
+	vec3 direction;
+	float outerCutOff;
+	vec3 ambient;
+	float constant;
+	vec3 diffuse;
+	float linear;
+	vec3 specular;
+	float quadratic;
+};
+
+layout (std140) uniform LightData
+{
+	DirLight dirLight;
+	SpotLight spotLight;
+	int pointLightCount;
+	bool spotLightEnabled;
+	PointLight pointLights[MAX_POINT_LIGHTS];
+};
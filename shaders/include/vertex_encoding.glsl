@@ -0,0 +1,27 @@
+// Decoding of the packed vertex formats, see vertex_format.h. Mesh::DrawGeometry sets the
+// uniforms. Bit 0 of vertexEncoding: positions are normalized int16 relative to the mesh
+// bounds, bit 1: normals are octahedral encoded.
+
+uniform int vertexEncoding;
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+
+vec3 DecodePosition(vec3 position)
+{
+	if ( (vertexEncoding & 1) != 0 )
+		return position * positionScale + positionBias;
+	return position;
+}
+
+vec3 DecodeNormal(vec3 normal)
+{
+	if ( (vertexEncoding & 2) != 0 )
+	{
+		vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+		float t = max(-n.z, 0.0);
+		n.x += n.x >= 0.0 ? -t : t;
+		n.y += n.y >= 0.0 ? -t : t;
+		return normalize(n);
+	}
+	return normal;
+}
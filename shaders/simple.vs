@@ -7,11 +7,11 @@ layout (location = 2) in vec2 aTexCoords;
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "include/frame_data.glsl"
+#include "include/vertex_encoding.glsl"
 
 void main()
 {
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = viewProjection * model * vec4(DecodePosition(aPos), 1.0);
 }
\ No newline at end of file
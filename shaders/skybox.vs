@@ -3,11 +3,11 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "include/frame_data.glsl"
 
 void main()
 {
 	TexCoords = aPos;
-	gl_Position = projection * view * vec4(aPos, 1.0);
+	// Without the translation, the box stays centered on the camera
+	gl_Position = projection * mat4(mat3(view)) * vec4(aPos, 1.0);
 }  
@@ -8,53 +8,14 @@ struct Material {
 	float shininess;
 }; 
 
-struct DirLight {
-	vec3 direction;
-	
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-
-struct PointLight {
-	vec3 position;
-    
-	float constant;
-	float linear;
-	float quadratic;
-	
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-
-struct SpotLight {
-	vec3 position;
-	vec3 direction;
-	float cutOff;
-	float outerCutOff;
-  
-	float constant;
-	float linear;
-	float quadratic;
-  
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;       
-};
-
-#define NR_POINT_LIGHTS 5
+#include "include/lights.glsl"
+#include "include/frame_data.glsl"
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
 uniform Material material;
-uniform bool isSpotLightSetup;
 
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
@@ -76,11 +37,11 @@ void main()
 	// phase 1: directional lighting
 	vec3 result = CalcDirLight(dirLight, norm, viewDir);
 	// phase 2: point lights
-	for(int i = 0; i < NR_POINT_LIGHTS; i++)
+	for(int i = 0; i < pointLightCount; i++)
 		result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
 	// phase 3: spot light
 
-	if ( isSpotLightSetup )
+	if ( spotLightEnabled )
 		result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
     
 	FragColor = vec4(result, 1.0);
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <stdint.h>
+#include "hash.h"
+#include "lz4.h"
+#include "mapped_file.h"
+
+using namespace std;
+
+// Many asset files packed into one, written by tools/asset_packer and read through Vfs.
+//
+//   ArchiveHeader
+//   file data, every entry ARCHIVE_ALIGNMENT aligned so stored entries can be used in place
+//   ArchiveEntry[entryCount], sorted by pathHash
+//   names, not null terminated
+const uint32_t ARCHIVE_MAGIC = 0x4b415046; // "FPAK"
+const uint32_t ARCHIVE_VERSION = 1;
+const uint64_t ARCHIVE_ALIGNMENT = 64;
+
+enum ArchiveCompression
+{
+	ARCHIVE_STORED,
+	ARCHIVE_LZ4
+};
+
+struct ArchiveHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t padding;
+	uint64_t entriesOffset;
+	uint64_t namesOffset;
+};
+
+struct ArchiveEntry
+{
+	uint64_t pathHash;
+	uint64_t offset;
+	// Bytes in the archive, and once decompressed
+	uint64_t storedSize;
+	uint64_t size;
+	// Of the packed file, so staleness checks against it keep working from the archive
+	int64_t mtime;
+	uint32_t compression;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	uint32_t padding;
+};
+
+class Archive
+{
+ public:
+	// Maps the archive and checks its tables, the file data is only checked when read
+	bool Open(const string &path)
+	{
+		if ( !file.Open(path) )
+			return false;
+
+		if ( !isValid() )
+		{
+			cout << "ERROR::ARCHIVE::INVALID::" << path << endl;
+			file.Close();
+			return false;
+		}
+		return true;
+	}
+
+	bool IsOpen() const { return file.IsOpen(); }
+	unsigned int EntryCount() const { return file.IsOpen() ? header()->entryCount : 0; }
+	const ArchiveEntry *Entry(unsigned int i) const { return entries() + i; }
+	string EntryName(const ArchiveEntry *entry) const
+	{
+		return string((const char *)file.Data() + header()->namesOffset + entry->nameOffset, entry->nameLength);
+	}
+
+	// Binary search on the hash of the normalized path, NULL if the archive does not have it
+	const ArchiveEntry *Find(const string &path) const
+	{
+		if ( !file.IsOpen() )
+			return NULL;
+
+		string name = NormalizePath(path);
+		uint64_t hash = HashString(name);
+		const ArchiveEntry *first = entries(), *last = entries() + header()->entryCount;
+		const ArchiveEntry *found = lower_bound(first, last, hash, lessHash);
+		for ( ; found != last && found->pathHash == hash; ++found)
+		{
+			if ( found->nameLength == name.size() && memcmp(file.Data() + header()->namesOffset + found->nameOffset, name.data(), name.size()) == 0 )
+				return found;
+		}
+		return NULL;
+	}
+
+	// The mapped bytes of a stored entry, NULL if it is compressed
+	const unsigned char *Data(const ArchiveEntry *entry) const
+	{
+		return entry->compression == ARCHIVE_STORED ? file.Data() + entry->offset : NULL;
+	}
+
+	bool Read(const ArchiveEntry *entry, vector<unsigned char> &data) const
+	{
+		const unsigned char *stored = file.Data() + entry->offset;
+		data.resize(entry->size);
+		if ( entry->compression == ARCHIVE_STORED )
+		{
+			if ( entry->size > 0 )
+				memcpy(data.data(), stored, entry->size);
+			return true;
+		}
+		if ( !Lz4::Decompress(stored, entry->storedSize, data.data(), data.size()) )
+		{
+			cout << "ERROR::ARCHIVE::CORRUPT_ENTRY::" << EntryName(entry) << endl;
+			data.clear();
+			return false;
+		}
+		return true;
+	}
+
+	// The path as stored: forward slashes, no "." components, ".." resolved where possible
+	static string NormalizePath(const string &path)
+	{
+		vector<string> parts;
+		size_t start = 0;
+		while ( start <= path.size() )
+		{
+			size_t end = path.find_first_of("/\\", start);
+			if ( end == string::npos )
+				end = path.size();
+			string part = path.substr(start, end - start);
+			if ( part == ".." && !parts.empty() && parts.back() != ".." )
+				parts.pop_back();
+			else if ( !part.empty() && part != "." )
+				parts.push_back(part);
+			start = end + 1;
+		}
+
+		string result = !path.empty() && path[0] == '/' ? "/" : "";
+		for (unsigned int i = 0; i < parts.size(); i++)
+			result += (i > 0 ? "/" : "") + parts[i];
+		return result;
+	}
+
+ private:
+	MappedFile file;
+
+	const ArchiveHeader *header() const { return (const ArchiveHeader *)file.Data(); }
+	const ArchiveEntry *entries() const { return (const ArchiveEntry *)(file.Data() + header()->entriesOffset); }
+
+	static bool lessHash(const ArchiveEntry &entry, uint64_t hash)
+	{
+		return entry.pathHash < hash;
+	}
+
+	bool isValid() const
+	{
+		if ( file.Size() < sizeof(ArchiveHeader) )
+			return false;
+		const ArchiveHeader *archive = header();
+		if ( archive->magic != ARCHIVE_MAGIC || archive->version != ARCHIVE_VERSION || archive->entriesOffset % 8 != 0 )
+			return false;
+		if ( archive->entriesOffset + (uint64_t)archive->entryCount * sizeof(ArchiveEntry) > file.Size() || archive->namesOffset > file.Size() )
+			return false;
+
+		for (unsigned int i = 0; i < archive->entryCount; i++)
+		{
+			const ArchiveEntry *entry = Entry(i);
+			if ( entry->offset + entry->storedSize > file.Size() || archive->namesOffset + entry->nameOffset + entry->nameLength > file.Size() )
+				return false;
+			if ( entry->compression > ARCHIVE_LZ4 || (entry->compression == ARCHIVE_STORED && entry->storedSize != entry->size) )
+				return false;
+			if ( i > 0 && Entry(i - 1)->pathHash > entry->pathHash )
+				return false;
+		}
+		return true;
+	}
+};
+
+// Collects files in memory and writes them as an Archive
+class ArchiveWriter
+{
+ public:
+	// Compressed with LZ4 unless that saves less than an eighth, or compress is false
+	void Add(const string &path, const vector<unsigned char> &data, int64_t mtime, bool compress)
+	{
+		Pending pending;
+		pending.name = Archive::NormalizePath(path);
+		pending.entry = ArchiveEntry();
+		pending.entry.pathHash = HashString(pending.name);
+		pending.entry.size = data.size();
+		pending.entry.mtime = mtime;
+		pending.entry.compression = ARCHIVE_STORED;
+		pending.data = data;
+
+		if ( compress && !data.empty() )
+		{
+			vector<unsigned char> compressed(Lz4::Bound(data.size()));
+			compressed.resize(Lz4::Compress(data.data(), data.size(), compressed.data()));
+			if ( compressed.size() < data.size() - data.size() / 8 )
+			{
+				pending.entry.compression = ARCHIVE_LZ4;
+				pending.data.swap(compressed);
+			}
+		}
+		pending.entry.storedSize = pending.data.size();
+		files.push_back(pending);
+	}
+
+	unsigned int FileCount() const { return files.size(); }
+
+	// Through a temporary file so a failed write never replaces a good archive
+	bool Write(const string &path, uint64_t *archiveBytes)
+	{
+		sort(files.begin(), files.end(), lessPending);
+
+		string names;
+		uint64_t offset = align(sizeof(ArchiveHeader));
+		for (unsigned int i = 0; i < files.size(); i++)
+		{
+			ArchiveEntry &entry = files[i].entry;
+			entry.offset = offset;
+			entry.nameOffset = names.size();
+			entry.nameLength = files[i].name.size();
+			names += files[i].name;
+			offset = align(offset + entry.storedSize);
+		}
+
+		ArchiveHeader header = ArchiveHeader();
+		header.magic = ARCHIVE_MAGIC;
+		header.version = ARCHIVE_VERSION;
+		header.entryCount = files.size();
+		header.entriesOffset = offset;
+		header.namesOffset = offset + files.size() * sizeof(ArchiveEntry);
+
+		string tempPath = path + ".tmp";
+		FILE *out = fopen(tempPath.c_str(), "wb");
+		if ( !out )
+		{
+			cout << "ERROR::ARCHIVE::CANNOT_WRITE::" << tempPath << endl;
+			return false;
+		}
+
+		bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+		for (unsigned int i = 0; ok && i < files.size(); i++)
+		{
+			ok = fseek(out, files[i].entry.offset, SEEK_SET) == 0;
+			ok = ok && (files[i].data.empty() || fwrite(files[i].data.data(), files[i].data.size(), 1, out) == 1);
+		}
+		ok = ok && fseek(out, header.entriesOffset, SEEK_SET) == 0;
+		for (unsigned int i = 0; ok && i < files.size(); i++)
+			ok = fwrite(&files[i].entry, sizeof(ArchiveEntry), 1, out) == 1;
+		ok = ok && (names.empty() || fwrite(names.data(), names.size(), 1, out) == 1);
+		ok = (fclose(out) == 0) && ok;
+
+		if ( !ok || rename(tempPath.c_str(), path.c_str()) != 0 )
+		{
+			cout << "ERROR::ARCHIVE::CANNOT_WRITE::" << path << endl;
+			remove(tempPath.c_str());
+			return false;
+		}
+
+		*archiveBytes = header.namesOffset + names.size();
+		return true;
+	}
+
+ private:
+	struct Pending
+	{
+		string name;
+		ArchiveEntry entry;
+		vector<unsigned char> data;
+	};
+
+	vector<Pending> files;
+
+	static bool lessPending(const Pending &a, const Pending &b)
+	{
+		return a.entry.pathHash < b.entry.pathHash;
+	}
+
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + ARCHIVE_ALIGNMENT - 1) & ~(ARCHIVE_ALIGNMENT - 1);
+	}
+};
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdint.h>
+#include "hash.h"
+#include "mapped_file.h"
+
+using namespace std;
+
+// What the asset cooker built last time, so a run only redoes the jobs whose inputs changed.
+// A job (e.g. "texture:assets/tile.png") is recorded with the version of its tool and the
+// content hash of every file it read, discovered while it ran (a model's .mtl, a shader's
+// includes). It is up to date while all of those files still hash the same. File hashes are
+// kept too, with the mtime and size they were taken at, so unchanged files are not re-read.
+//
+// Text, one record per line, fields separated by tabs:
+//   asset_manifest <ASSET_MANIFEST_VERSION>
+//   file <path> <mtime> <size> <hash>
+//   job <key> <version> <dependency count> (<path> <hash>)...
+const uint32_t ASSET_MANIFEST_VERSION = 1;
+
+class AssetManifest
+{
+ public:
+	AssetManifest() {}
+
+	// A missing or outdated manifest loads as empty, everything is rebuilt then
+	bool Load(const string &path)
+	{
+		files.clear();
+		jobs.clear();
+		ifstream in(path.c_str());
+		string line;
+		if ( !in || !getline(in, line) || line != "asset_manifest\t" + to_string(ASSET_MANIFEST_VERSION) )
+			return false;
+
+		while ( getline(in, line) )
+		{
+			vector<string> fields = split(line);
+			if ( fields.size() == 5 && fields[0] == "file" )
+			{
+				FileState &state = files[fields[1]];
+				state.mtime = strtoll(fields[2].c_str(), NULL, 10);
+				state.size = strtoull(fields[3].c_str(), NULL, 10);
+				state.hash = strtoull(fields[4].c_str(), NULL, 16);
+			}
+			else if ( fields.size() >= 4 && fields[0] == "job" )
+			{
+				unsigned int count = strtoul(fields[3].c_str(), NULL, 10);
+				if ( fields.size() != 4 + 2 * count )
+					continue;
+
+				Job &job = jobs[fields[1]];
+				job.version = strtoul(fields[2].c_str(), NULL, 10);
+				job.dependencies.resize(count);
+				for (unsigned int i = 0; i < count; i++)
+				{
+					job.dependencies[i].path = fields[4 + 2 * i];
+					job.dependencies[i].hash = strtoull(fields[5 + 2 * i].c_str(), NULL, 16);
+				}
+			}
+		}
+		return true;
+	}
+
+	// Keeps only the jobs recorded or confirmed up to date since Load, and the files they use
+	bool Save(const string &path)
+	{
+		lock_guard<mutex> lock(stateMutex);
+		string tempPath = path + ".tmp";
+		FILE *out = fopen(tempPath.c_str(), "w");
+		if ( !out )
+		{
+			cout << "ERROR::ASSET_MANIFEST::CANNOT_WRITE::" << tempPath << endl;
+			return false;
+		}
+
+		map<string, bool> used;
+		fprintf(out, "asset_manifest\t%u\n", ASSET_MANIFEST_VERSION);
+		for (map<string, Job>::const_iterator it = jobs.begin(); it != jobs.end(); ++it)
+		{
+			if ( !it->second.current )
+				continue;
+			fprintf(out, "job\t%s\t%u\t%u", it->first.c_str(), it->second.version, (unsigned int)it->second.dependencies.size());
+			for (unsigned int i = 0; i < it->second.dependencies.size(); i++)
+			{
+				const Dependency &dependency = it->second.dependencies[i];
+				fprintf(out, "\t%s\t%016llx", dependency.path.c_str(), (unsigned long long)dependency.hash);
+				used[dependency.path] = true;
+			}
+			fprintf(out, "\n");
+		}
+		for (map<string, FileState>::const_iterator it = files.begin(); it != files.end(); ++it)
+		{
+			if ( used.count(it->first) )
+				fprintf(out, "file\t%s\t%lld\t%llu\t%016llx\n", it->first.c_str(), (long long)it->second.mtime,
+								(unsigned long long)it->second.size, (unsigned long long)it->second.hash);
+		}
+
+		if ( fclose(out) != 0 || rename(tempPath.c_str(), path.c_str()) != 0 )
+		{
+			cout << "ERROR::ASSET_MANIFEST::CANNOT_WRITE::" << path << endl;
+			remove(tempPath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// Content hash of a file, re-read only when its mtime or size changed. Thread safe.
+	bool HashFile(const string &path, uint64_t *hash)
+	{
+		int64_t mtime;
+		uint64_t size;
+		if ( !MappedFile::Stat(path, &mtime, &size) )
+			return false;
+
+		{
+			lock_guard<mutex> lock(stateMutex);
+			map<string, FileState>::const_iterator found = files.find(path);
+			if ( found != files.end() && found->second.mtime == mtime && found->second.size == size )
+			{
+				*hash = found->second.hash;
+				return true;
+			}
+		}
+
+		// MappedFile refuses empty files
+		MappedFile file;
+		if ( size > 0 && !file.Open(path) )
+			return false;
+		*hash = HashBytes(file.Data(), file.Size());
+
+		lock_guard<mutex> lock(stateMutex);
+		FileState &state = files[path];
+		state.mtime = mtime;
+		state.size = size;
+		state.hash = *hash;
+		return true;
+	}
+
+	// True if key was built by the same tool version from files that all still hash the same.
+	// Also keeps the job in the manifest on the next Save. Thread safe.
+	bool IsUpToDate(const string &key, uint32_t version)
+	{
+		vector<Dependency> dependencies;
+		{
+			lock_guard<mutex> lock(stateMutex);
+			map<string, Job>::const_iterator found = jobs.find(key);
+			if ( found == jobs.end() || found->second.version != version || found->second.dependencies.empty() )
+				return false;
+			dependencies = found->second.dependencies;
+		}
+
+		for (unsigned int i = 0; i < dependencies.size(); i++)
+		{
+			uint64_t hash;
+			if ( !HashFile(dependencies[i].path, &hash) || hash != dependencies[i].hash )
+				return false;
+		}
+
+		lock_guard<mutex> lock(stateMutex);
+		jobs[key].current = true;
+		return true;
+	}
+
+	// Records a successful build of key from dependencies, hashed now. Thread safe.
+	bool Record(const string &key, uint32_t version, const vector<string> &dependencies)
+	{
+		Job job;
+		job.version = version;
+		job.current = true;
+		job.dependencies.resize(dependencies.size());
+		for (unsigned int i = 0; i < dependencies.size(); i++)
+		{
+			job.dependencies[i].path = dependencies[i];
+			if ( !HashFile(dependencies[i], &job.dependencies[i].hash) )
+				return false;
+		}
+
+		lock_guard<mutex> lock(stateMutex);
+		jobs[key] = job;
+		return true;
+	}
+
+	// Drops key, e.g. after its build failed, so the next run retries it. Thread safe.
+	void Forget(const string &key)
+	{
+		lock_guard<mutex> lock(stateMutex);
+		jobs.erase(key);
+	}
+
+ private:
+	struct FileState
+	{
+		int64_t mtime;
+		uint64_t size;
+		uint64_t hash;
+	};
+
+	struct Dependency
+	{
+		string path;
+		uint64_t hash;
+	};
+
+	struct Job
+	{
+		uint32_t version;
+		vector<Dependency> dependencies;
+		// Recorded or confirmed during this run
+		bool current;
+
+		Job() : version(0), current(false) {}
+	};
+
+	map<string, FileState> files;
+	map<string, Job> jobs;
+	mutex stateMutex;
+
+	AssetManifest(const AssetManifest &);
+	AssetManifest &operator=(const AssetManifest &);
+
+	static vector<string> split(const string &line)
+	{
+		vector<string> fields;
+		istringstream in(line);
+		string field;
+		while ( getline(in, field, '\t') )
+			fields.push_back(field);
+		return fields;
+	}
+};
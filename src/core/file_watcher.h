@@ -0,0 +1,84 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+// Reports files written in a set of directories, through inotify. Directories are watched
+// rather than files because editors and the cookers save by renaming a temporary file over
+// the old one, which would end a watch on the file itself.
+class FileWatcher
+{
+ public:
+	FileWatcher() : fd(-1)
+	{
+	}
+
+	~FileWatcher()
+	{
+		if ( fd >= 0 )
+			close(fd);
+	}
+
+	bool Open()
+	{
+		if ( fd < 0 )
+			fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		return fd >= 0;
+	}
+
+	bool IsWatching(const std::string &directory) const
+	{
+		return watched.count(directory) != 0;
+	}
+
+	bool WatchDirectory(const std::string &directory)
+	{
+		if ( fd < 0 )
+			return false;
+		if ( IsWatching(directory) )
+			return true;
+
+		int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if ( wd < 0 )
+			return false;
+		directories[wd] = directory;
+		watched.insert(directory);
+		return true;
+	}
+
+	// Files finished writing since the last call, as directory + "/" + name, each listed once.
+	// Never blocks.
+	std::vector<std::string> Poll()
+	{
+		std::set<std::string> changed;
+		alignas(struct inotify_event) char buffer[4096];
+		for (;;)
+		{
+			ssize_t length = fd >= 0 ? read(fd, buffer, sizeof(buffer)) : -1;
+			if ( length <= 0 )
+				break;
+
+			for (ssize_t offset = 0; offset < length; )
+			{
+				const struct inotify_event *event = (const struct inotify_event *)(buffer + offset);
+				std::map<int, std::string>::iterator directory = directories.find(event->wd);
+				if ( event->len > 0 && directory != directories.end() )
+					changed.insert(directory->second + "/" + event->name);
+				offset += sizeof(struct inotify_event) + event->len;
+			}
+		}
+		return std::vector<std::string>(changed.begin(), changed.end());
+	}
+
+ private:
+	int fd;
+	std::map<int, std::string> directories;
+	std::set<std::string> watched;
+
+	FileWatcher(const FileWatcher &);
+	FileWatcher &operator=(const FileWatcher &);
+};
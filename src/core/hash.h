@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// 64 bit FNV-1a. Not cryptographic, only used to detect changed content.
+const uint64_t HASH_SEED = 14695981039346656037ULL;
+
+inline uint64_t HashBytes(const void *data, size_t size, uint64_t hash = HASH_SEED)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+inline uint64_t HashString(const std::string &value, uint64_t hash = HASH_SEED)
+{
+	return HashBytes(value.data(), value.size(), hash);
+}
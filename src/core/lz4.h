@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ4 block format (no frame), compatible with the reference implementation's
+// LZ4_compress_default / LZ4_decompress_safe. Greedy matching with a single hash table
+// slot per position, fast to decode which is all the asset archive needs.
+class Lz4
+{
+ public:
+	// Largest output Compress can produce for size input bytes
+	static size_t Bound(size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	// dst must hold Bound(size) bytes, returns the compressed size
+	static size_t Compress(const unsigned char *src, size_t size, unsigned char *dst)
+	{
+		std::vector<uint32_t> table(1 << HASH_BITS, 0);
+		unsigned char *out = dst;
+		size_t anchor = 0, i = 0;
+
+		// The last match has to start MATCH_LIMIT bytes before the end and leave
+		// LAST_LITERALS bytes after it
+		while ( i + MATCH_LIMIT <= size )
+		{
+			uint32_t sequence = read32(src + i);
+			uint32_t &slot = table[hash(sequence)];
+			size_t candidate = slot;
+			// Positions are stored plus one, 0 is an empty slot
+			slot = i + 1;
+			if ( candidate == 0 || i + 1 - candidate > MAX_OFFSET || read32(src + candidate - 1) != sequence )
+			{
+				i++;
+				continue;
+			}
+
+			size_t match = candidate - 1;
+			size_t length = MIN_MATCH;
+			while ( i + length < size - LAST_LITERALS && src[match + length] == src[i + length] )
+				length++;
+
+			out = writeSequence(out, src + anchor, i - anchor, i - match, length);
+			i += length;
+			anchor = i;
+		}
+
+		// Trailing literals with no match
+		size_t literals = size - anchor;
+		*out++ = (literals < 15 ? literals : 15) << 4;
+		out = writeLength(out, literals);
+		memcpy(out, src + anchor, literals);
+		return out + literals - dst;
+	}
+
+	// Fails on malformed input or if it does not decode to exactly dstSize bytes
+	static bool Decompress(const unsigned char *src, size_t srcSize, unsigned char *dst, size_t dstSize)
+	{
+		const unsigned char *in = src, *end = src + srcSize;
+		size_t out = 0;
+		while ( in < end )
+		{
+			unsigned int token = *in++;
+			size_t literals = token >> 4;
+			if ( literals == 15 && !readLength(&in, end, &literals) )
+				return false;
+			if ( literals > (size_t)(end - in) || literals > dstSize - out )
+				return false;
+			memcpy(dst + out, in, literals);
+			in += literals;
+			out += literals;
+
+			// The last sequence has literals only
+			if ( in == end )
+				break;
+
+			if ( end - in < 2 )
+				return false;
+			size_t offset = in[0] | (in[1] << 8);
+			in += 2;
+			size_t length = token & 15;
+			if ( length == 15 && !readLength(&in, end, &length) )
+				return false;
+			length += MIN_MATCH;
+			if ( offset == 0 || offset > out || length > dstSize - out )
+				return false;
+
+			// Matches may overlap their own output, byte by byte is only needed then
+			if ( offset >= length )
+				memcpy(dst + out, dst + out - offset, length);
+			else
+			{
+				for (size_t k = 0; k < length; k++)
+					dst[out + k] = dst[out + k - offset];
+			}
+			out += length;
+		}
+		return out == dstSize;
+	}
+
+ private:
+	static const unsigned int HASH_BITS = 16;
+	static const size_t MIN_MATCH = 4;
+	static const size_t LAST_LITERALS = 5;
+	static const size_t MATCH_LIMIT = 12;
+	static const size_t MAX_OFFSET = 65535;
+
+	static uint32_t read32(const unsigned char *p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	static uint32_t hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	// The 255, 255, ..., rest continuation of a length whose 4 bit token field is 15
+	static unsigned char *writeLength(unsigned char *out, size_t length)
+	{
+		if ( length < 15 )
+			return out;
+		for (length -= 15; length >= 255; length -= 255)
+			*out++ = 255;
+		*out++ = length;
+		return out;
+	}
+
+	static bool readLength(const unsigned char **in, const unsigned char *end, size_t *length)
+	{
+		unsigned int byte;
+		do
+		{
+			if ( *in == end )
+				return false;
+			byte = *(*in)++;
+			*length += byte;
+		} while ( byte == 255 );
+		return true;
+	}
+
+	static unsigned char *writeSequence(unsigned char *out, const unsigned char *literals, size_t literalCount, size_t offset, size_t matchLength)
+	{
+		size_t matchCode = matchLength - MIN_MATCH;
+		*out++ = (literalCount < 15 ? literalCount : 15) << 4 | (matchCode < 15 ? matchCode : 15);
+		out = writeLength(out, literalCount);
+		memcpy(out, literals, literalCount);
+		out += literalCount;
+		*out++ = offset & 0xff;
+		*out++ = offset >> 8;
+		return writeLength(out, matchCode);
+	}
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Read only memory mapping of a whole file. The mapping lives as long as the object.
+class MappedFile
+{
+ public:
+	MappedFile() : data(NULL), size(0)
+	{
+	}
+
+	~MappedFile()
+	{
+		Close();
+	}
+
+	bool Open(const std::string &path)
+	{
+		Close();
+
+		int fd = open(path.c_str(), O_RDONLY);
+		if ( fd < 0 )
+			return false;
+
+		struct stat info;
+		if ( fstat(fd, &info) != 0 || info.st_size == 0 )
+		{
+			close(fd);
+			return false;
+		}
+
+		void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if ( mapping == MAP_FAILED )
+			return false;
+
+		data = (const unsigned char *)mapping;
+		size = info.st_size;
+		return true;
+	}
+
+	void Close()
+	{
+		if ( data )
+			munmap((void *)data, size);
+		data = NULL;
+		size = 0;
+	}
+
+	bool IsOpen() const { return data != NULL; }
+	const unsigned char *Data() const { return data; }
+	size_t Size() const { return size; }
+
+	// Modification time in nanoseconds and size of a file on disk, false if it does not exist.
+	static bool Stat(const std::string &path, int64_t *mtime, uint64_t *fileSize)
+	{
+		struct stat info;
+		if ( stat(path.c_str(), &info) != 0 )
+			return false;
+
+		*mtime = (int64_t)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+		*fileSize = info.st_size;
+		return true;
+	}
+
+ private:
+	const unsigned char *data;
+	size_t size;
+
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+};
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <iostream>
+#include <stdint.h>
+
+using namespace std;
+
+// Wall time, bytes read and operator new calls of one startup phase or asset load
+struct ProfileRecord
+{
+	string name;
+	// Phase the record started in, empty for phases themselves
+	string phase;
+	double milliseconds;
+	uint64_t bytesRead;
+	uint64_t allocations;
+	uint64_t allocatedBytes;
+};
+
+// Where main() spends its time before the first frame. main marks its phases with
+// BeginPhase, loaders wrap each asset in a ProfileScope, and Finish prints the report and
+// writes it as JSON for comparing runs. Nothing is recorded after Finish.
+//
+// The counters are process wide: a record also counts what other threads read or allocated
+// meanwhile, e.g. a model importing in the background. Bytes read are counted by Vfs and
+// ProgramCache, allocations by the operator new defined with STARTUP_PROFILER_IMPLEMENTATION
+// (malloc calls from C code such as stb_image are not seen).
+class StartupProfiler
+{
+ public:
+	static StartupProfiler &Get()
+	{
+		static StartupProfiler profiler;
+		return profiler;
+	}
+
+	static void AddBytesRead(uint64_t bytes)
+	{
+		if ( counters().finished.load(memory_order_relaxed) )
+			return;
+		counters().bytesRead.fetch_add(bytes, memory_order_relaxed);
+	}
+
+	// After Finish this is a single load, operator new calls it for the whole run
+	static void CountAllocation(size_t bytes)
+	{
+		if ( counters().finished.load(memory_order_relaxed) )
+			return;
+		counters().allocations.fetch_add(1, memory_order_relaxed);
+		counters().allocatedBytes.fetch_add(bytes, memory_order_relaxed);
+	}
+
+	bool IsActive() const
+	{
+		return active;
+	}
+
+	// Ends the current phase, if any, and starts the next one
+	void BeginPhase(const string &name)
+	{
+		if ( !active )
+			return;
+		EndPhase();
+		lock_guard<mutex> lock(recordsMutex);
+		phaseName = name;
+		phaseStart = Snapshot::Take();
+	}
+
+	void EndPhase()
+	{
+		if ( !active )
+			return;
+		lock_guard<mutex> lock(recordsMutex);
+		if ( phaseName.empty() )
+			return;
+		phases.push_back(phaseStart.RecordTo(Snapshot::Take(), phaseName, ""));
+		phaseName.clear();
+	}
+
+	// Name of the phase running now, for asset records
+	string CurrentPhase()
+	{
+		lock_guard<mutex> lock(recordsMutex);
+		return phaseName;
+	}
+
+	void AddAsset(const ProfileRecord &record)
+	{
+		lock_guard<mutex> lock(recordsMutex);
+		if ( active )
+			assets.push_back(record);
+	}
+
+	// Prints the phases in order and the assets slowest first, then writes both to jsonPath.
+	// Only the first call does anything, so it can sit in the frame loop.
+	void Finish(const string &jsonPath)
+	{
+		if ( !active )
+			return;
+		EndPhase();
+		ProfileRecord total = startup.RecordTo(Snapshot::Take(), "total", "");
+		active = false;
+		counters().finished.store(true, memory_order_relaxed);
+
+		lock_guard<mutex> lock(recordsMutex);
+		sort(assets.begin(), assets.end(), slower);
+
+		cout << "STARTUP::PROFILE::" << formatRecord(total) << endl;
+		for (unsigned int i = 0; i < phases.size(); i++)
+			cout << "STARTUP::PHASE::" << formatRecord(phases[i]) << endl;
+		for (unsigned int i = 0; i < assets.size(); i++)
+			cout << "STARTUP::ASSET::" << formatRecord(assets[i]) << " [" << assets[i].phase << "]" << endl;
+
+		writeJson(jsonPath, total);
+	}
+
+ private:
+	struct Counters
+	{
+		atomic<uint64_t> bytesRead;
+		atomic<uint64_t> allocations;
+		atomic<uint64_t> allocatedBytes;
+		// Set by Finish, nothing is counted after it
+		atomic<bool> finished;
+	};
+
+	// Zero initialized before any constructor runs, operator new may be called that early
+	static Counters &counters()
+	{
+		static Counters values;
+		return values;
+	}
+
+	struct Snapshot
+	{
+		chrono::steady_clock::time_point time;
+		uint64_t bytesRead;
+		uint64_t allocations;
+		uint64_t allocatedBytes;
+
+		static Snapshot Take()
+		{
+			Snapshot snapshot;
+			snapshot.time = chrono::steady_clock::now();
+			snapshot.bytesRead = counters().bytesRead.load(memory_order_relaxed);
+			snapshot.allocations = counters().allocations.load(memory_order_relaxed);
+			snapshot.allocatedBytes = counters().allocatedBytes.load(memory_order_relaxed);
+			return snapshot;
+		}
+
+		ProfileRecord RecordTo(const Snapshot &end, const string &name, const string &phase) const
+		{
+			ProfileRecord record;
+			record.name = name;
+			record.phase = phase;
+			record.milliseconds = chrono::duration<double, milli>(end.time - time).count();
+			record.bytesRead = end.bytesRead - bytesRead;
+			record.allocations = end.allocations - allocations;
+			record.allocatedBytes = end.allocatedBytes - allocatedBytes;
+			return record;
+		}
+	};
+
+	friend class ProfileScope;
+
+	atomic<bool> active;
+	Snapshot startup;
+	mutex recordsMutex;
+	string phaseName;
+	Snapshot phaseStart;
+	vector<ProfileRecord> phases;
+	vector<ProfileRecord> assets;
+
+	StartupProfiler() : active(true), startup(Snapshot::Take()) {}
+	StartupProfiler(const StartupProfiler &);
+	StartupProfiler &operator=(const StartupProfiler &);
+
+	static bool slower(const ProfileRecord &a, const ProfileRecord &b)
+	{
+		return a.milliseconds > b.milliseconds;
+	}
+
+	static string formatRecord(const ProfileRecord &record)
+	{
+		char line[512];
+		snprintf(line, sizeof(line), "%-48s %9.2f ms %9.1f KB read %8llu allocations %9.1f KB", record.name.c_str(), record.milliseconds,
+						 record.bytesRead / 1024.0, (unsigned long long)record.allocations, record.allocatedBytes / 1024.0);
+		return line;
+	}
+
+	static string jsonString(const string &value)
+	{
+		string escaped = "\"";
+		for (unsigned int i = 0; i < value.size(); i++)
+		{
+			if ( value[i] == '"' || value[i] == '\\' )
+				escaped += '\\';
+			if ( (unsigned char)value[i] >= 0x20 )
+				escaped += value[i];
+		}
+		return escaped + "\"";
+	}
+
+	static void writeJsonRecord(FILE *out, const ProfileRecord &record)
+	{
+		fprintf(out, "{\"name\": %s, ", jsonString(record.name).c_str());
+		if ( !record.phase.empty() )
+			fprintf(out, "\"phase\": %s, ", jsonString(record.phase).c_str());
+		fprintf(out, "\"ms\": %.3f, \"bytes_read\": %llu, \"allocations\": %llu, \"allocated_bytes\": %llu}", record.milliseconds,
+						(unsigned long long)record.bytesRead, (unsigned long long)record.allocations, (unsigned long long)record.allocatedBytes);
+	}
+
+	// Through a temporary file like the caches, a crash never leaves half a report
+	void writeJson(const string &path, const ProfileRecord &total)
+	{
+		string tempPath = path + ".tmp";
+		FILE *out = fopen(tempPath.c_str(), "w");
+		if ( !out )
+		{
+			cout << "ERROR::STARTUP_PROFILER::CANNOT_WRITE::" << tempPath << endl;
+			return;
+		}
+
+		fprintf(out, "{\n  \"total\": ");
+		writeJsonRecord(out, total);
+		fprintf(out, ",\n  \"phases\": [");
+		for (unsigned int i = 0; i < phases.size(); i++)
+		{
+			fprintf(out, "%s\n    ", i > 0 ? "," : "");
+			writeJsonRecord(out, phases[i]);
+		}
+		fprintf(out, "\n  ],\n  \"assets\": [");
+		for (unsigned int i = 0; i < assets.size(); i++)
+		{
+			fprintf(out, "%s\n    ", i > 0 ? "," : "");
+			writeJsonRecord(out, assets[i]);
+		}
+		fprintf(out, "\n  ]\n}\n");
+
+		if ( fclose(out) != 0 || rename(tempPath.c_str(), path.c_str()) != 0 )
+		{
+			cout << "ERROR::STARTUP_PROFILER::CANNOT_WRITE::" << path << endl;
+			remove(tempPath.c_str());
+		}
+	}
+};
+
+// Records the load of one asset from construction to destruction, e.g.
+//   ProfileScope profile("texture " + filename);
+class ProfileScope
+{
+ public:
+	ProfileScope(const string &name) : active(StartupProfiler::Get().IsActive())
+	{
+		if ( !active )
+			return;
+		this->name = name;
+		phase = StartupProfiler::Get().CurrentPhase();
+		start = StartupProfiler::Snapshot::Take();
+	}
+
+	~ProfileScope()
+	{
+		if ( active )
+			StartupProfiler::Get().AddAsset(start.RecordTo(StartupProfiler::Snapshot::Take(), name, phase));
+	}
+
+ private:
+	bool active;
+	string name;
+	string phase;
+	StartupProfiler::Snapshot start;
+
+	ProfileScope(const ProfileScope &);
+	ProfileScope &operator=(const ProfileScope &);
+};
+
+// Define in exactly one translation unit before including this file to count allocations
+#ifdef STARTUP_PROFILER_IMPLEMENTATION
+void *operator new(size_t size)
+{
+	StartupProfiler::CountAllocation(size);
+	void *memory = malloc(size > 0 ? size : 1);
+	if ( !memory )
+		throw bad_alloc();
+	return memory;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+	free(memory);
+}
+#endif
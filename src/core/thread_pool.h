@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads pulling jobs from a shared queue. Jobs must not touch GL,
+// the context is only current on the main thread.
+class ThreadPool
+{
+ public:
+	ThreadPool(unsigned int threadCount = 0) : stopping(false)
+	{
+		if ( threadCount == 0 )
+			threadCount = std::thread::hardware_concurrency();
+		if ( threadCount == 0 )
+			threadCount = 4;
+
+		for (unsigned int i = 0; i < threadCount; ++i)
+			workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (unsigned int i = 0; i < workers.size(); ++i)
+			workers[i].join();
+	}
+
+	// Pool shared by all loaders, started on first use
+	static ThreadPool &Shared()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	unsigned int ThreadCount() const { return workers.size(); }
+
+	void Enqueue(const std::function<void()> &job)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobs.push_back(job);
+		}
+		wake.notify_one();
+	}
+
+	// Runs job(0) .. job(count - 1) on the pool and blocks until all of them are done.
+	// The calling thread helps so this is safe to call from inside a job.
+	void ParallelFor(unsigned int count, const std::function<void(unsigned int)> &job)
+	{
+		std::mutex doneMutex;
+		std::condition_variable doneSignal;
+		unsigned int remaining = count;
+
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			Enqueue([&, i]() {
+				job(i);
+				std::unique_lock<std::mutex> lock(doneMutex);
+				if ( --remaining == 0 )
+					doneSignal.notify_all();
+			});
+		}
+
+		while ( runOne() )
+		{
+			std::unique_lock<std::mutex> lock(doneMutex);
+			if ( remaining == 0 )
+				break;
+		}
+
+		std::unique_lock<std::mutex> lock(doneMutex);
+		while ( remaining > 0 )
+			doneSignal.wait(lock);
+	}
+
+ private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	bool runOne()
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if ( jobs.empty() )
+				return false;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		job();
+		return true;
+	}
+
+	void workerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while ( !stopping && jobs.empty() )
+					wake.wait(lock);
+				if ( stopping && jobs.empty() )
+					return;
+				job = jobs.front();
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator=(const ThreadPool &);
+};
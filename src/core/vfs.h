@@ -0,0 +1,191 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+#include "archive.h"
+#include "mapped_file.h"
+#include "startup_profiler.h"
+
+using namespace std;
+
+// Read only contents of one file, from a mounted archive or from disk. Stored archive
+// entries and loose files are mapped, compressed entries are decompressed into the file.
+class VfsFile
+{
+ public:
+	VfsFile() : data(NULL), size(0), opened(false)
+	{
+	}
+
+	bool IsOpen() const { return opened; }
+	const unsigned char *Data() const { return data; }
+	size_t Size() const { return size; }
+
+	void Close()
+	{
+		mapped.Close();
+		vector<unsigned char>().swap(buffer);
+		data = NULL;
+		size = 0;
+		opened = false;
+	}
+
+ private:
+	friend class Vfs;
+
+	const unsigned char *data;
+	size_t size;
+	bool opened;
+	vector<unsigned char> buffer;
+	MappedFile mapped;
+};
+
+// Every asset read goes through here. Mounted archives are searched newest first and loose
+// files under the working directory are the fallback, so a tree without archives behaves
+// like plain file access. Mount before any loading starts, lookups are not locked.
+class Vfs
+{
+ public:
+	static Vfs &Get()
+	{
+		static Vfs vfs;
+		return vfs;
+	}
+
+	~Vfs()
+	{
+		for (unsigned int i = 0; i < archives.size(); i++)
+			delete archives[i];
+	}
+
+	// False if the archive is missing or invalid, which leaves the loose files in use
+	bool Mount(const string &archivePath)
+	{
+		Archive *archive = new Archive();
+		if ( !archive->Open(archivePath) )
+		{
+			delete archive;
+			return false;
+		}
+		archives.insert(archives.begin(), archive);
+		return true;
+	}
+
+	unsigned int MountedCount() const { return archives.size(); }
+
+	bool Open(const string &path, VfsFile &file)
+	{
+		file.Close();
+
+		const Archive *archive;
+		const ArchiveEntry *entry = find(path, &archive);
+		if ( entry )
+		{
+			file.data = archive->Data(entry);
+			if ( !file.data )
+			{
+				if ( !archive->Read(entry, file.buffer) )
+					return false;
+				file.data = file.buffer.data();
+			}
+			file.size = entry->size;
+			file.opened = true;
+			StartupProfiler::AddBytesRead(file.size);
+			return true;
+		}
+
+		// MappedFile refuses empty files, those open with no data
+		int64_t mtime;
+		uint64_t size;
+		if ( !MappedFile::Stat(path, &mtime, &size) )
+			return false;
+		if ( size > 0 && !file.mapped.Open(path) )
+			return false;
+		file.data = file.mapped.Data();
+		file.size = file.mapped.Size();
+		file.opened = true;
+		StartupProfiler::AddBytesRead(file.size);
+		return true;
+	}
+
+	bool Read(const string &path, vector<unsigned char> &data)
+	{
+		const Archive *archive;
+		const ArchiveEntry *entry = find(path, &archive);
+		if ( entry )
+		{
+			bool read = archive->Read(entry, data);
+			StartupProfiler::AddBytesRead(read ? data.size() : 0);
+			return read;
+		}
+
+		ifstream file(path.c_str(), ios::binary | ios::ate);
+		if ( !file )
+			return false;
+
+		data.resize(file.tellg());
+		file.seekg(0);
+		file.read((char *)data.data(), data.size());
+		StartupProfiler::AddBytesRead(data.size());
+		return true;
+	}
+
+	bool ReadText(const string &path, string &text)
+	{
+		vector<unsigned char> data;
+		if ( !Read(path, data) )
+			return false;
+		text.assign(data.begin(), data.end());
+		return true;
+	}
+
+	// Like MappedFile::Stat, archive entries report the mtime the packed file had
+	bool Stat(const string &path, int64_t *mtime, uint64_t *size)
+	{
+		const Archive *archive;
+		const ArchiveEntry *entry = find(path, &archive);
+		if ( !entry )
+			return MappedFile::Stat(path, mtime, size);
+
+		*mtime = entry->mtime;
+		*size = entry->size;
+		return true;
+	}
+
+	bool Exists(const string &path)
+	{
+		int64_t mtime;
+		uint64_t size;
+		return Stat(path, &mtime, &size);
+	}
+
+	// True if path is read from a mounted archive rather than from disk
+	bool InArchive(const string &path) const
+	{
+		const Archive *archive;
+		return find(path, &archive) != NULL;
+	}
+
+ private:
+	vector<Archive *> archives;
+
+	Vfs() {}
+	Vfs(const Vfs &);
+	Vfs &operator=(const Vfs &);
+
+	const ArchiveEntry *find(const string &path, const Archive **archive) const
+	{
+		for (unsigned int i = 0; i < archives.size(); i++)
+		{
+			const ArchiveEntry *entry = archives[i]->Find(path);
+			if ( entry )
+			{
+				*archive = archives[i];
+				return entry;
+			}
+		}
+		return NULL;
+	}
+};
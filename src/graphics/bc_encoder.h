@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstring>
+#include <stdint.h>
+
+// Block compression of 4x4 pixel blocks for the texture cooker. Endpoints come from the
+// inset bounding box of the block (van Waveren, "Real-Time DXT Compression"), which is
+// fast and good enough for offline cooking of diffuse and specular maps.
+class BcEncoder
+{
+ public:
+	// rgba: 16 pixels, 4 bytes each, row by row. Writes 8 bytes, alpha is ignored.
+	static void EncodeBC1(const unsigned char *rgba, unsigned char *out)
+	{
+		unsigned char minColor[3], maxColor[3];
+		colorEndpoints(rgba, minColor, maxColor);
+
+		uint16_t color0 = to565(maxColor);
+		uint16_t color1 = to565(minColor);
+		if ( color0 < color1 )
+		{
+			uint16_t swap = color0;
+			color0 = color1;
+			color1 = swap;
+		}
+
+		uint32_t indices = 0;
+		if ( color0 != color1 )
+		{
+			// color0 > color1 selects the four color mode
+			int palette[4][3];
+			from565(color0, palette[0]);
+			from565(color1, palette[1]);
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+
+			for (unsigned int i = 0; i < 16; i++)
+			{
+				const unsigned char *pixel = rgba + i * 4;
+				unsigned int best = 0;
+				int bestDistance = 0x7fffffff;
+				for (unsigned int p = 0; p < 4; p++)
+				{
+					int dr = pixel[0] - palette[p][0], dg = pixel[1] - palette[p][1], db = pixel[2] - palette[p][2];
+					int distance = dr * dr + dg * dg + db * db;
+					if ( distance < bestDistance )
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= best << (i * 2);
+			}
+		}
+
+		writeLittleEndian(out, color0, 2);
+		writeLittleEndian(out + 2, color1, 2);
+		writeLittleEndian(out + 4, indices, 4);
+	}
+
+	// Writes 16 bytes: the alpha block followed by the BC1 color block
+	static void EncodeBC3(const unsigned char *rgba, unsigned char *out)
+	{
+		EncodeChannel(rgba + 3, 4, out);
+		EncodeBC1(rgba, out + 8);
+	}
+
+	// Writes 16 bytes: red block then green block
+	static void EncodeBC5(const unsigned char *rgba, unsigned char *out)
+	{
+		EncodeChannel(rgba, 4, out);
+		EncodeChannel(rgba + 1, 4, out + 8);
+	}
+
+	// One channel block (BC4, the alpha block of BC3) from 16 values stride bytes apart.
+	// Writes 8 bytes.
+	static void EncodeChannel(const unsigned char *values, unsigned int stride, unsigned char *out)
+	{
+		int minValue = 255, maxValue = 0;
+		for (unsigned int i = 0; i < 16; i++)
+		{
+			int value = values[i * stride];
+			minValue = value < minValue ? value : minValue;
+			maxValue = value > maxValue ? value : maxValue;
+		}
+
+		out[0] = maxValue;
+		out[1] = minValue;
+		uint64_t indices = 0;
+		if ( maxValue != minValue )
+		{
+			// max > min selects the eight value mode
+			int palette[8];
+			palette[0] = maxValue;
+			palette[1] = minValue;
+			for (unsigned int p = 1; p < 7; p++)
+				palette[p + 1] = ((7 - p) * maxValue + p * minValue) / 7;
+
+			for (unsigned int i = 0; i < 16; i++)
+			{
+				int value = values[i * stride];
+				unsigned int best = 0;
+				int bestDistance = 256;
+				for (unsigned int p = 0; p < 8; p++)
+				{
+					int distance = value > palette[p] ? value - palette[p] : palette[p] - value;
+					if ( distance < bestDistance )
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= (uint64_t)best << (i * 3);
+			}
+		}
+		writeLittleEndian(out + 2, indices, 6);
+	}
+
+ private:
+	static void colorEndpoints(const unsigned char *rgba, unsigned char *minColor, unsigned char *maxColor)
+	{
+		int low[3] = { 255, 255, 255 }, high[3] = { 0, 0, 0 };
+		for (unsigned int i = 0; i < 16; i++)
+		{
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				int value = rgba[i * 4 + c];
+				low[c] = value < low[c] ? value : low[c];
+				high[c] = value > high[c] ? value : high[c];
+			}
+		}
+
+		// Pull the endpoints in by 1/16 of the range, the extremes are rarely hit exactly
+		for (unsigned int c = 0; c < 3; c++)
+		{
+			int inset = (high[c] - low[c]) >> 4;
+			low[c] += inset;
+			high[c] -= inset;
+		}
+
+		// The box diagonal follows the main trend of green and blue against red
+		int center[3] = { (low[0] + high[0]) / 2, (low[1] + high[1]) / 2, (low[2] + high[2]) / 2 };
+		int covarianceGreen = 0, covarianceBlue = 0;
+		for (unsigned int i = 0; i < 16; i++)
+		{
+			int red = rgba[i * 4] - center[0];
+			covarianceGreen += red * (rgba[i * 4 + 1] - center[1]);
+			covarianceBlue += red * (rgba[i * 4 + 2] - center[2]);
+		}
+		if ( covarianceGreen < 0 )
+		{
+			int swap = low[1];
+			low[1] = high[1];
+			high[1] = swap;
+		}
+		if ( covarianceBlue < 0 )
+		{
+			int swap = low[2];
+			low[2] = high[2];
+			high[2] = swap;
+		}
+
+		for (unsigned int c = 0; c < 3; c++)
+		{
+			minColor[c] = low[c];
+			maxColor[c] = high[c];
+		}
+	}
+
+	static uint16_t to565(const unsigned char *color)
+	{
+		return ((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255);
+	}
+
+	static void from565(uint16_t color, int *rgb)
+	{
+		int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	static void writeLittleEndian(unsigned char *out, uint64_t value, unsigned int bytes)
+	{
+		for (unsigned int i = 0; i < bytes; i++)
+			out[i] = (value >> (i * 8)) & 0xff;
+	}
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Matches the std140 layout of the FrameData block in shaders/include/frame_data.glsl:
+// three mat4 then viewPos, with time packed into its fourth component
+struct FrameData
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	glm::vec3 viewPos;
+	float time;
+};
+
+static_assert(sizeof(FrameData) == 208, "FrameData must match the std140 block");
+
+// Camera data every program reads from one uniform buffer instead of its own uniforms.
+// Shader binds the FrameData block of each program it builds to BINDING, Update writes the
+// buffer once per frame (again if the camera changes mid frame, e.g. for a mirror pass).
+class FrameUniforms
+{
+ public:
+	static const unsigned int BINDING = 0;
+
+	static FrameUniforms &Get()
+	{
+		static FrameUniforms uniforms;
+		return uniforms;
+	}
+
+	// Must run on the GL thread, the buffer is created on the first call
+	void Update(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos, float time)
+	{
+		if ( buffer == 0 )
+		{
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+			glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+			glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer);
+		}
+
+		data.view = view;
+		data.projection = projection;
+		data.viewProjection = projection * view;
+		data.viewPos = viewPos;
+		data.time = time;
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+	}
+
+	// Values of the last Update
+	const FrameData &Data() const { return data; }
+
+ private:
+	unsigned int buffer;
+	FrameData data;
+
+	FrameUniforms() : buffer(0), data() {}
+	FrameUniforms(const FrameUniforms &);
+	FrameUniforms &operator=(const FrameUniforms &);
+};
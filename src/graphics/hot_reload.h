@@ -0,0 +1,129 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "../core/file_watcher.h"
+#include "../core/vfs.h"
+#include "shader.h"
+#include "texture_registry.h"
+
+using namespace std;
+
+// Picks up edits to shader sources and textures while the game runs. Only what changed is
+// rebuilt: the programs that read a saved file, the textures made from it. Both keep their
+// GL ids, so nothing holding them needs to know. A shader that no longer compiles prints its
+// errors and the old program stays in use.
+class HotReload
+{
+ public:
+	static HotReload &Get()
+	{
+		static HotReload hotReload;
+		return hotReload;
+	}
+
+	// Files served from an archive are not the ones being edited, so mounting one turns this off
+	bool Start()
+	{
+		if ( Vfs::Get().MountedCount() > 0 )
+		{
+			cout << "HOT_RELOAD::DISABLED::ARCHIVE_MOUNTED" << endl;
+			return false;
+		}
+		if ( !watcher.Open() )
+		{
+			cout << "ERROR::HOT_RELOAD::CANNOT_WATCH_FILES" << endl;
+			return false;
+		}
+		started = true;
+		watchLoadedFiles();
+		return true;
+	}
+
+	// Once per frame, on the GL thread
+	void Update()
+	{
+		if ( !started )
+			return;
+
+		watchLoadedFiles();
+		vector<string> changed = watcher.Poll();
+		for (unsigned int i = 0; i < changed.size(); i++)
+		{
+			string path = TextureRegistry::CanonicalPath(changed[i]);
+			// A cooked texture stands in for its source
+			if ( path.size() > 5 && path.compare(path.size() - 5, 5, ".ctex") == 0 )
+				path.erase(path.size() - 5);
+
+			reloadShaders(path);
+			if ( TextureRegistry::Get().Reload(path) > 0 )
+				cout << "HOT_RELOAD::TEXTURE::" << path << endl;
+		}
+	}
+
+ private:
+	FileWatcher watcher;
+	bool started;
+	// Generations of the shader sources and texture paths last watched
+	unsigned int watchedShaders;
+	unsigned int watchedTextures;
+
+	HotReload() : started(false), watchedShaders(0), watchedTextures(0) {}
+	HotReload(const HotReload &);
+	HotReload &operator=(const HotReload &);
+
+	// Shaders and textures keep being created after Start, models stream theirs in, and a
+	// reloaded shader may include new files. Every change bumps a generation, counts could
+	// stay the same.
+	void watchLoadedFiles()
+	{
+		if ( Shader::SourcesGeneration() != watchedShaders )
+		{
+			map<unsigned int, ShaderSource> &sources = Shader::Sources();
+			for (map<unsigned int, ShaderSource>::iterator it = sources.begin(); it != sources.end(); ++it)
+				for (unsigned int i = 0; i < it->second.files.size(); i++)
+					watch(it->second.files[i]);
+			watchedShaders = Shader::SourcesGeneration();
+		}
+
+		if ( TextureRegistry::Get().PathsGeneration() != watchedTextures )
+		{
+			vector<string> paths = TextureRegistry::Get().Paths();
+			for (unsigned int i = 0; i < paths.size(); i++)
+				watch(paths[i]);
+			watchedTextures = TextureRegistry::Get().PathsGeneration();
+		}
+	}
+
+	void watch(const string &file)
+	{
+		size_t slash = file.find_last_of('/');
+		string directory = slash == string::npos ? "." : file.substr(0, slash);
+		if ( !watcher.IsWatching(directory) && !watcher.WatchDirectory(directory) )
+			cout << "ERROR::HOT_RELOAD::CANNOT_WATCH::" << directory << endl;
+	}
+
+	void reloadShaders(const string &path)
+	{
+		// Collected first, Reload updates the sources it walks
+		vector<unsigned int> programs;
+		map<unsigned int, ShaderSource> &sources = Shader::Sources();
+		for (map<unsigned int, ShaderSource>::iterator it = sources.begin(); it != sources.end(); ++it)
+		{
+			bool uses = false;
+			for (unsigned int i = 0; i < it->second.files.size() && !uses; i++)
+				uses = TextureRegistry::CanonicalPath(it->second.files[i]) == path;
+			if ( uses )
+				programs.push_back(it->first);
+		}
+
+		for (unsigned int i = 0; i < programs.size(); i++)
+		{
+			bool reloaded = Shader::Reload(programs[i]);
+			const ShaderSource &source = sources[programs[i]];
+			cout << "HOT_RELOAD::SHADER::" << source.vertexPath << "::" << source.fragmentPath << (reloaded ? "" : "::FAILED") << endl;
+		}
+	}
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+using namespace std;
+
+// Model matrices of the instances of one glDrawArraysInstanced call. Shaders built with
+// INSTANCED (see shaders/color.vs) read them from attributes LOCATION to LOCATION + 3 instead
+// of the model uniform. Upload only when the instances change, the buffer keeps them.
+class InstanceBuffer
+{
+ public:
+	static const unsigned int LOCATION = 3;
+
+	InstanceBuffer() : VBO(0), capacity(0), count(0) {}
+
+	// Points the matrix attributes of vertexArray at this buffer, one matrix per instance.
+	// Leaves vertexArray bound.
+	void Attach(unsigned int vertexArray)
+	{
+		if ( VBO == 0 )
+			glGenBuffers(1, &VBO);
+
+		glBindVertexArray(vertexArray);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		// A mat4 attribute takes four locations, one per column
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			glEnableVertexAttribArray(LOCATION + i);
+			glVertexAttribPointer(LOCATION + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+			glVertexAttribDivisor(LOCATION + i, 1);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Replaces the instances, the buffer only grows
+	void Upload(const vector<glm::mat4> &models)
+	{
+		if ( VBO == 0 )
+			glGenBuffers(1, &VBO);
+
+		count = models.size();
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		if ( count > capacity )
+		{
+			capacity = count;
+			glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), models.data(), GL_DYNAMIC_DRAW);
+		}
+		else if ( count > 0 )
+		{
+			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), models.data());
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	unsigned int Count() const { return count; }
+
+	void Release()
+	{
+		if ( VBO == 0 )
+			return;
+
+		glDeleteBuffers(1, &VBO);
+		VBO = 0;
+		capacity = count = 0;
+	}
+
+ private:
+	unsigned int VBO;
+	unsigned int capacity;
+	unsigned int count;
+
+	InstanceBuffer(const InstanceBuffer &);
+	InstanceBuffer &operator=(const InstanceBuffer &);
+};
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <glm/glm.hpp>
-#include "../shader.h"
+#include "../light_uniforms.h"
 
 class DirectionLight
 {
@@ -19,11 +19,14 @@ class DirectionLight
 		Color = color;
 	}
 
-	void setup(Shader *shader, const std::string &uniformName)
+	// Into the light buffer, see LightUniforms
+	void setup()
 	{
-		shader->setVec3(uniformName + ".direction", Direction);
-		shader->setVec3(uniformName + ".ambient", Color * AmbientIntensity);
-		shader->setVec3(uniformName + ".diffuse", Color * DiffuseIntensity);
-		shader->setVec3(uniformName + ".specular", Color * SpecularIntensity);
+		DirLightData light = DirLightData();
+		light.direction = Direction;
+		light.ambient = Color * AmbientIntensity;
+		light.diffuse = Color * DiffuseIntensity;
+		light.specular = Color * SpecularIntensity;
+		LightUniforms::Get().SetDirectionLight(light);
 	}
 };
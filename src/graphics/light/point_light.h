@@ -2,6 +2,8 @@
 
 #include <glm/glm.hpp>
 #include "../shader.h"
+#include "../light_uniforms.h"
+#include "../render_queue.h"
 
 class PointLight
 {
@@ -23,16 +25,18 @@ class PointLight
 		Color = color;
   }
 
-	void use(Shader *objectShader, const std::string &uniformName)
+	// Adds the light to the light buffer for this frame, see LightUniforms
+	void use()
 	{
-		objectShader->use();
-    objectShader->setVec3(uniformName + ".position", Position);
-    objectShader->setVec3(uniformName + ".ambient", Color * AmbientIntensity);
-    objectShader->setVec3(uniformName + ".diffuse", Color * DiffuseIntensity);
-    objectShader->setVec3(uniformName + ".specular", Color * SpecularIntensity);
-    objectShader->setFloat(uniformName + ".constant", Constant);
-    objectShader->setFloat(uniformName + ".linear", Linear);
-    objectShader->setFloat(uniformName + ".quadratic", Quadratic);
+		PointLightData light = PointLightData();
+		light.position = Position;
+		light.ambient = Color * AmbientIntensity;
+		light.diffuse = Color * DiffuseIntensity;
+		light.specular = Color * SpecularIntensity;
+		light.constant = Constant;
+		light.linear = Linear;
+		light.quadratic = Quadratic;
+		LightUniforms::Get().AddPointLight(light);
 	}
 
 	void setup(unsigned int vao)
@@ -40,19 +44,16 @@ class PointLight
 		this->VAO = vao;
 	}
 
-	void draw(Shader *lampShader)
+	// Queues the lamp cube, drawn in the color of the light
+	void submit(RenderQueue &queue, Shader *lampShader)
 	{
-		lampShader->use();
-		
 		glm::mat4 model = glm::mat4(1.0f);
 		model = glm::translate(model, Position);
 		model = glm::scale(model, glm::vec3(0.2f));
-		
-		lampShader->setMat4("model", model);
-		lampShader->setVec3("lightColor", Color);
 
-		glBindVertexArray(VAO);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		RenderItem &item = queue.Submit(RENDER_PASS_OPAQUE, lampShader, model, VAO, GL_TRIANGLES, 0, 36);
+		item.colorUniform = lampShader->GetUniform<glm::vec3>("lightColor");
+		item.color = Color;
 	}
 
  private:
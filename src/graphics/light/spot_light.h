@@ -1,7 +1,7 @@
 #pragma once
 
 #include <glm/glm.hpp>
-#include "../shader.h"
+#include "../light_uniforms.h"
 
 class SpotLight
 {
@@ -28,18 +28,21 @@ class SpotLight
 		OuterCutOff = outerCutOff;
   }
 
-	void setup(Shader* shader, const std::string &uniformName)
+	// Into the light buffer for this frame, see LightUniforms. Without it the frame has no
+	// spot light.
+	void setup()
 	{
-		shader->setVec3(uniformName + ".position", Position);
-		shader->setVec3(uniformName + ".direction", Direction);
-		shader->setFloat(uniformName + ".cutOff", glm::cos(glm::radians(CutOff)));
-		shader->setFloat(uniformName + ".outerCutOff", glm::cos(glm::radians(OuterCutOff)));
-		shader->setVec3(uniformName + ".ambient", Color * AmbientIntensity);
-		shader->setVec3(uniformName + ".diffuse", Color * DiffuseIntensity);
-		shader->setVec3(uniformName + ".specular", Color * SpecularIntensity);
-		shader->setFloat(uniformName + ".constant", Constant);
-    shader->setFloat(uniformName + ".linear", Linear);
-    shader->setFloat(uniformName + ".quadratic", Quadratic);
-		shader->setBool("isSpotLightSetup", true);
+		SpotLightData light = SpotLightData();
+		light.position = Position;
+		light.direction = Direction;
+		light.cutOff = glm::cos(glm::radians(CutOff));
+		light.outerCutOff = glm::cos(glm::radians(OuterCutOff));
+		light.ambient = Color * AmbientIntensity;
+		light.diffuse = Color * DiffuseIntensity;
+		light.specular = Color * SpecularIntensity;
+		light.constant = Constant;
+		light.linear = Linear;
+		light.quadratic = Quadratic;
+		LightUniforms::Get().SetSpotLight(light);
 	}
 };
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// Room for this many point lights in the block, it has to fit the 16 KB every GL 3.3 driver
+// allows for a uniform block. Must match MAX_POINT_LIGHTS in shaders/include/lights.glsl.
+const unsigned int MAX_POINT_LIGHTS = 240;
+
+// std140 layouts of the structs in shaders/include/lights.glsl, every vec3 is followed by a
+// float (or padding) to fill its 16 bytes
+struct DirLightData
+{
+	glm::vec3 direction;
+	float padding0;
+	glm::vec3 ambient;
+	float padding1;
+	glm::vec3 diffuse;
+	float padding2;
+	glm::vec3 specular;
+	float padding3;
+};
+
+struct PointLightData
+{
+	glm::vec3 position;
+	float constant;
+	glm::vec3 ambient;
+	float linear;
+	glm::vec3 diffuse;
+	float quadratic;
+	glm::vec3 specular;
+	float padding;
+};
+
+struct SpotLightData
+{
+	glm::vec3 position;
+	// Cosines of the angles
+	float cutOff;
+	glm::vec3 direction;
+	float outerCutOff;
+	glm::vec3 ambient;
+	float constant;
+	glm::vec3 diffuse;
+	float linear;
+	glm::vec3 specular;
+	float quadratic;
+};
+
+// The LightData block, only the first pointLightCount lights are used
+struct LightData
+{
+	DirLightData dirLight;
+	SpotLightData spotLight;
+	int pointLightCount;
+	// A GLSL bool, 4 bytes in std140
+	int spotLightEnabled;
+	int padding[2];
+	PointLightData pointLights[MAX_POINT_LIGHTS];
+};
+
+static_assert(sizeof(DirLightData) == 64 && sizeof(PointLightData) == 64 && sizeof(SpotLightData) == 80, "light structs must match std140");
+static_assert(offsetof(LightData, pointLights) == 160 && sizeof(LightData) <= 16384, "LightData must match the std140 block");
+
+// Every light of the scene in one uniform buffer shared by all lit programs, so adding a
+// light or a lit shader costs no uniform calls. Shader binds the LightData block of each
+// program to BINDING. Each frame: Begin, let the lights fill it (see src/graphics/light),
+// then Upload writes the used part of the buffer at once.
+class LightUniforms
+{
+ public:
+	static const unsigned int BINDING = 1;
+
+	static LightUniforms &Get()
+	{
+		static LightUniforms uniforms;
+		return uniforms;
+	}
+
+	// Starts a frame without point lights and with the spot light off, the direction
+	// light is kept
+	void Begin()
+	{
+		data.pointLightCount = 0;
+		data.spotLightEnabled = 0;
+	}
+
+	void SetDirectionLight(const DirLightData &light)
+	{
+		data.dirLight = light;
+	}
+
+	void SetSpotLight(const SpotLightData &light)
+	{
+		data.spotLight = light;
+		data.spotLightEnabled = 1;
+	}
+
+	// False once MAX_POINT_LIGHTS are in, the light is left out then
+	bool AddPointLight(const PointLightData &light)
+	{
+		if ( data.pointLightCount >= (int)MAX_POINT_LIGHTS )
+			return false;
+		data.pointLights[data.pointLightCount++] = light;
+		return true;
+	}
+
+	unsigned int PointLightCount() const { return data.pointLightCount; }
+
+	// Must run on the GL thread, the buffer is created on the first call
+	void Upload()
+	{
+		if ( buffer == 0 )
+		{
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+			glBufferData(GL_UNIFORM_BUFFER, sizeof(LightData), NULL, GL_DYNAMIC_DRAW);
+			glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer);
+		}
+
+		size_t used = offsetof(LightData, pointLights) + data.pointLightCount * sizeof(PointLightData);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, used, &data);
+	}
+
+ private:
+	unsigned int buffer;
+	LightData data;
+
+	LightUniforms() : buffer(0), data() {}
+	LightUniforms(const LightUniforms &);
+	LightUniforms &operator=(const LightUniforms &);
+};
@@ -1,14 +1,37 @@
 #pragma once
 
 #include <iostream>
+#include <utility>
 #include <glm/glm.hpp>
+#include "vertex_format.h"
+#include "mesh_arena.h"
+#include "mesh_simplifier.h"
+#include "meshlet.h"
+#include "texture_residency.h"
 
 using namespace std;
 
-struct Vertex {
-  glm::vec3 Position;
-  glm::vec3 Normal;
-  glm::vec2 TexCoords;
+// GPU buffer sizes of a mesh, indexBytes32 is what the indices would take as unsigned int
+struct MeshMemoryStats
+{
+	size_t vertexBytes;
+	size_t indexBytes;
+	size_t indexBytes32;
+};
+
+// Handles of the uniforms that decode packed vertices (see VertexFormat::ShaderFlags) in one
+// program, resolved once and passed to every Mesh::DrawGeometry with that program
+struct VertexEncodingUniforms
+{
+	Uniform<int> encoding;
+	Uniform<glm::vec3> positionScale;
+	Uniform<glm::vec3> positionBias;
+
+	VertexEncodingUniforms() {}
+	explicit VertexEncodingUniforms(Shader &shader)
+		: encoding(shader.GetUniform<int>("vertexEncoding")), positionScale(shader.GetUniform<glm::vec3>("positionScale")), positionBias(shader.GetUniform<glm::vec3>("positionBias"))
+	{
+	}
 };
 
 struct Texture {
@@ -23,48 +46,299 @@ class Mesh {
   vector<Vertex> vertices;
   vector<unsigned int> indices;
   vector<Texture> textures;
+  // Coarser levels of indices, see MeshSimplifier. Uploaded together with indices.
+  vector<MeshLod> lods;
+  // Partition of indices used by CullMeshlets, see MeshletBuilder
+  vector<Meshlet> meshlets;
 
   // Functions
-  Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+  // The vectors are taken over, pass them with std::move to avoid copying the data.
+  // Pass upload = false to build the mesh off the GL thread, Upload() must then be called on
+  // the GL thread before the first Draw
+  Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload = true)
+		: vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), vertexCount(0), indexType(GL_UNSIGNED_INT), arena(NULL), baseVertex(0), lod(0), culled(false), VAO(0), VBO(0), EBO(0)
+	{
+		indexCount = this->indices.size();
+		if ( upload )
+			setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data());
+	}
+	// GPU only mesh, no copy of the data is kept in vertices/indices. With NULL data the
+	// buffers are only allocated and can be filled through MapVertices/MapIndices, such
+	// meshes always use 32 bit indices.
+	Mesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, unsigned int indexCount, vector<Texture> textures)
+		: textures(std::move(textures)), vertexCount(vertexCount), indexCount(indexCount), indexType(GL_UNSIGNED_INT), arena(NULL), baseVertex(0), lod(0), culled(false), VAO(0), VBO(0), EBO(0)
+	{
+		setupMesh(vertexData, vertexCount, indexData);
+	}
+	void Upload()
+	{
+		if ( !IsUploaded() )
+			setupMesh(vertices.data(), vertices.size(), indices.data());
+	}
+	// Suballocates the mesh from arena instead of creating its own buffers, the vertex format
+	// of the arena replaces the one set with SetVertexFormat
+	void Upload(MeshArena &arena)
+	{
+		if ( IsUploaded() )
+			return;
+
+		format = arena.Format();
+		vertexCount = vertices.size();
+		MeshArenaRange range = arena.Add(vertices.data(), vertices.size(), indices.data(), indexCount, &positionScale, &positionBias);
+		this->arena = &arena;
+		baseVertex = range.baseVertex;
+		indexType = range.indexType;
+
+		lodRanges.clear();
+		lodRanges.push_back(LodRange(range.indexOffset, indexCount, 0.0f));
+		for (unsigned int i = 0; i < lods.size(); i++)
+		{
+			size_t offset = arena.AddIndices(lods[i].indices.data(), lods[i].indices.size(), indexType);
+			lodRanges.push_back(LodRange(offset, lods[i].indices.size(), lods[i].error));
+		}
+	}
+	// Encoding used by the next Upload, meshes built with the pointer constructor always
+	// stay float32
+	void SetVertexFormat(const VertexFormat &format)
+	{
+		this->format = format;
+	}
+	// Write only views of the GPU buffers, every mapped buffer must be unmapped before drawing.
+	// NULL for an empty buffer, there is nothing to map.
+	Vertex *MapVertices()
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		if ( vertexCount == 0 )
+			return NULL;
 
-		setupMesh();
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		GLint size;
+		glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+		return (Vertex *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
 	}
-  void Draw(Shader shader)
+	unsigned int *MapIndices()
 	{
-		unsigned int diffuseNr = 1;
-		unsigned int specularNr = 1;
-		for (unsigned int i = 0; i < textures.size(); i++)
+		if ( indexCount == 0 )
+			return NULL;
+
+		glBindVertexArray(VAO);
+		return (unsigned int *)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indexCount * sizeof(unsigned int), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	}
+	void Unmap()
+	{
+		if ( vertexCount > 0 )
 		{
-			glActiveTexture(GL_TEXTURE0 + i);
+			glBindBuffer(GL_ARRAY_BUFFER, VBO);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		if ( indexCount > 0 )
+		{
+			glBindVertexArray(VAO);
+			glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+			glBindVertexArray(0);
+		}
+	}
+	// Deletes the buffers the mesh created itself, an arena frees its own. There is no
+	// destructor as meshes are copied around in vectors.
+	void Release()
+	{
+		if ( VAO == 0 )
+			return;
 
-			string number;
-			string name = textures[i].type;
-			if(name == "texture_diffuse")
-				number = to_string(diffuseNr++);
-			else if (name == "texture_specular")
-				number = to_string(specularNr++);
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
+	}
+	bool IsUploaded() const
+	{
+		return VAO != 0 || arena != NULL;
+	}
+	// GL_UNSIGNED_SHORT when every index fits in 16 bits, GL_UNSIGNED_INT otherwise
+	GLenum IndexType() const
+	{
+		return indexType;
+	}
+	MeshMemoryStats MemoryStats() const
+	{
+		size_t totalIndices = 0;
+		for (unsigned int i = 0; i < lodRanges.size(); i++)
+			totalIndices += lodRanges[i].indexCount;
 
-			shader.setFloat(("materal." + name + number).c_str(), i);
+		MeshMemoryStats stats;
+		stats.vertexBytes = (size_t)vertexCount * format.Stride();
+		stats.indexBytes = totalIndices * IndexSize(indexType);
+		stats.indexBytes32 = totalIndices * sizeof(unsigned int);
+		return stats;
+	}
+	// Picks the coarsest level whose error stays below maxPixelError once projected.
+	// pixelsPerUnit is the screen size of one object space unit at the mesh's distance.
+	void SelectLod(float pixelsPerUnit, float maxPixelError)
+	{
+		lod = 0;
+		for (unsigned int i = 1; i < lodRanges.size(); i++)
+		{
+			if ( lodRanges[i].error * pixelsPerUnit <= maxPixelError )
+				lod = i;
+		}
+	}
+	unsigned int LodCount() const
+	{
+		return lodRanges.size();
+	}
+	unsigned int CurrentLod() const
+	{
+		return lod;
+	}
+	// Keeps only the meshlets that can be visible for the next Draws: inside the frustum and
+	// not entirely back facing. Both in object space. Applies to the full detail level only,
+	// coarser levels are always drawn whole.
+	void CullMeshlets(const Frustum &frustum, const glm::vec3 &cameraPosition)
+	{
+		if ( meshlets.empty() || !IsUploaded() )
+			return;
+
+		culled = true;
+		drawCounts.clear();
+		drawOffsets.clear();
+		unsigned int indexSize = IndexSize(indexType);
+		for (unsigned int i = 0; i < meshlets.size(); i++)
+		{
+			if ( MeshletBuilder::IsCulled(meshlets[i], frustum, cameraPosition) )
+				continue;
+
+			// Neighbouring visible meshlets become one draw
+			size_t offset = lodRanges[0].indexOffset + (size_t)meshlets[i].firstIndex * indexSize;
+			if ( !drawCounts.empty() && (size_t)drawOffsets.back() + drawCounts.back() * indexSize == offset )
+				drawCounts.back() += meshlets[i].indexCount;
+			else
+			{
+				drawCounts.push_back(meshlets[i].indexCount);
+				drawOffsets.push_back((const void *)offset);
+			}
+		}
+		drawBaseVertices.assign(drawCounts.size(), baseVertex);
+	}
+	// Draws every meshlet again
+	void ResetCulling()
+	{
+		culled = false;
+	}
+	unsigned int VisibleTriangleCount() const
+	{
+		if ( !culled || lod != 0 )
+			return lodRanges.empty() ? 0 : lodRanges[lod].indexCount / 3;
+
+		unsigned int count = 0;
+		for (unsigned int i = 0; i < drawCounts.size(); i++)
+			count += drawCounts[i] / 3;
+		return count;
+	}
+	// The VAO DrawGeometry expects to be bound, the arena's for a mesh in an arena
+	unsigned int VertexArray() const
+	{
+		return arena ? arena->VertexArray() : VAO;
+	}
+	// Pass bindVertexArray = false when the caller already bound the arena of this mesh, e.g.
+	// to draw all meshes of a model with a single VAO bind
+  void Draw(Shader &shader, bool bindVertexArray = true)
+	{
+		// Plain float vertices need no lookup
+		Draw(format.ShaderFlags() != 0 ? VertexEncodingUniforms(shader) : VertexEncodingUniforms(), bindVertexArray);
+	}
+	void Draw(const VertexEncodingUniforms &uniforms, bool bindVertexArray = true)
+	{
+		if ( !IsUploaded() )
+			return;
+
+		// Texture i goes to unit i, the samplers are pointed at their units once at startup
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
 			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			TextureResidency::Get().Touch(textures[i].id);
 		}
 
 		glActiveTexture(GL_TEXTURE0);
 
+		if ( !arena || bindVertexArray )
+			glBindVertexArray(VertexArray());
+		DrawGeometry(uniforms);
+		if ( bindVertexArray )
+			glBindVertexArray(0);
+	}
+	// Only the draw call and its vertex encoding uniforms, for callers that already bound the
+	// textures and VertexArray() (see RenderQueue). uniforms must belong to the program in use.
+	void DrawGeometry(const VertexEncodingUniforms &uniforms)
+	{
+		if ( !IsUploaded() )
+			return;
+
+		int encoding = format.ShaderFlags();
+		if ( encoding != 0 )
+		{
+			uniforms.encoding.Set(encoding);
+			uniforms.positionScale.Set(positionScale);
+			uniforms.positionBias.Set(positionBias);
+		}
+
 		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		const LodRange &range = lodRanges[lod];
+		bool drawMeshlets = culled && lod == 0;
+		if ( arena )
+		{
+			if ( drawMeshlets )
+				glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(), drawCounts.size(), drawBaseVertices.data());
+			else
+				glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, indexType, (void*)range.indexOffset, baseVertex);
+		}
+		else
+		{
+			if ( drawMeshlets )
+				glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(), drawCounts.size());
+			else
+				glDrawElements(GL_TRIANGLES, range.indexCount, indexType, (void*)range.indexOffset);
+		}
+
+		// Other geometry drawn with this program is plain floats
+		if ( encoding != 0 )
+			uniforms.encoding.Set(0);
 	}
  private:
   // Render data
+  VertexFormat format;
+  glm::vec3 positionScale;
+  glm::vec3 positionBias;
+  unsigned int vertexCount;
+  unsigned int indexCount;
+  GLenum indexType;
+  // Set when the buffers live in a shared arena, VAO/VBO/EBO stay 0 then
+  MeshArena *arena;
+  GLint baseVertex;
+  // Index buffer location of every level, 0 is the full mesh
+  struct LodRange
+  {
+		size_t indexOffset;
+		unsigned int indexCount;
+		float error;
+
+		LodRange(size_t indexOffset, unsigned int indexCount, float error)
+			: indexOffset(indexOffset), indexCount(indexCount), error(error)
+		{
+		}
+  };
+  vector<LodRange> lodRanges;
+  unsigned int lod;
+  // Result of the last CullMeshlets, one entry per run of visible meshlets
+  bool culled;
+  vector<GLsizei> drawCounts;
+  vector<const void *> drawOffsets;
+  vector<GLint> drawBaseVertices;
   unsigned int VAO, VBO, EBO;
   // Functions
-  void setupMesh()
+  void setupMesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData)
 	{
+		this->vertexCount = vertexCount;
+
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
@@ -72,22 +346,42 @@ class Mesh {
 		glBindVertexArray(VAO);
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		if ( format.IsFloat() || !vertexData )
+		{
+			format = VertexFormat();
+			glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
+		}
+		else
+		{
+			vector<unsigned char> packed = VertexPacker::Pack(format, vertexData, vertexCount, &positionScale, &positionBias);
+			glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+		}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		// Mapped index buffers are written as unsigned int by the caller
+		indexType = indexData ? IndexTypeFor(vertexCount) : GL_UNSIGNED_INT;
+		unsigned int indexSize = IndexSize(indexType);
 
-		// vertex positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		// All levels back to back in one buffer
+		lodRanges.clear();
+		lodRanges.push_back(LodRange(0, indexCount, 0.0f));
+		size_t indexBytes = (size_t)indexCount * indexSize;
+		for (unsigned int i = 0; indexData && i < lods.size(); i++)
+		{
+			lodRanges.push_back(LodRange(indexBytes, lods[i].indices.size(), lods[i].error));
+			indexBytes += lods[i].indices.size() * indexSize;
+		}
 
-		// vertex normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+		if ( indexData )
+		{
+			BufferIndices(GL_ELEMENT_ARRAY_BUFFER, 0, indexData, indexCount, indexType);
+			for (unsigned int i = 1; i < lodRanges.size(); i++)
+				BufferIndices(GL_ELEMENT_ARRAY_BUFFER, lodRanges[i].indexOffset, lods[i - 1].indices.data(), lodRanges[i].indexCount, indexType);
+		}
 
-		// vertex texture coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+		// vertex positions, normals and texture coords
+		format.SetupAttributes();
 
 		glBindVertexArray(0);
 	}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+#include "vertex_format.h"
+
+using namespace std;
+
+// uint16 indices whenever every vertex of the mesh can be addressed with them
+inline GLenum IndexTypeFor(unsigned int vertexCount)
+{
+	return vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+inline unsigned int IndexSize(GLenum indexType)
+{
+	return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+}
+
+// Writes indices into the buffer bound to target, narrowing them to uint16 if asked
+inline void BufferIndices(GLenum target, size_t offset, const unsigned int *indices, unsigned int count, GLenum indexType)
+{
+	if ( indexType == GL_UNSIGNED_SHORT )
+	{
+		vector<uint16_t> shortIndices(indices, indices + count);
+		glBufferSubData(target, offset, count * sizeof(uint16_t), shortIndices.data());
+	}
+	else
+		glBufferSubData(target, offset, count * sizeof(unsigned int), indices);
+}
+
+// Where a mesh ended up inside an arena
+struct MeshArenaRange
+{
+	GLint baseVertex;
+	// Byte offset into the index buffer
+	size_t indexOffset;
+	GLenum indexType;
+};
+
+// One vertex buffer and one index buffer behind a single VAO, shared by many meshes of the
+// same VertexFormat. Meshes are drawn with glDrawElementsBaseVertex so their indices stay
+// relative to their own first vertex, which keeps 16 bit indices usable per mesh.
+// Buffers grow (and are copied on the GPU) when a mesh does not fit. GL thread only, call
+// Release while the context is still alive.
+class MeshArena
+{
+ public:
+	MeshArena(VertexFormat format = VertexFormat())
+		: format(format), VAO(0), VBO(0), EBO(0), vertexUsed(0), vertexCapacity(0), indexUsed(0), indexCapacity(0)
+	{
+	}
+
+	const VertexFormat &Format() const
+	{
+		return format;
+	}
+
+	// Grows the buffers ahead of a batch of Add calls so they are allocated only once.
+	// Indices are counted as 32 bit.
+	void Reserve(unsigned int vertexCount, unsigned int indexCount)
+	{
+		create();
+		grow(VBO, vertexUsed, vertexCapacity, vertexUsed + (size_t)vertexCount * format.Stride(), false);
+		grow(EBO, indexUsed, indexCapacity, indexUsed + (size_t)indexCount * sizeof(unsigned int), true);
+	}
+
+	// Copies a mesh into the arena, encoding the vertices in the arena's format. Fills
+	// positionScale/positionBias for POSITION_SNORM16.
+	MeshArenaRange Add(const Vertex *vertices, unsigned int vertexCount, const unsigned int *indices, unsigned int indexCount, glm::vec3 *positionScale, glm::vec3 *positionBias)
+	{
+		create();
+
+		MeshArenaRange range;
+		unsigned int stride = format.Stride();
+		range.baseVertex = vertexUsed / stride;
+
+		size_t vertexBytes = (size_t)vertexCount * stride;
+		grow(VBO, vertexUsed, vertexCapacity, vertexUsed + vertexBytes, false);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+		if ( format.IsFloat() )
+			glBufferSubData(GL_COPY_WRITE_BUFFER, vertexUsed, vertexBytes, vertices);
+		else
+		{
+			vector<unsigned char> packed = VertexPacker::Pack(format, vertices, vertexCount, positionScale, positionBias);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, vertexUsed, vertexBytes, packed.data());
+		}
+		vertexUsed += vertexBytes;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		range.indexType = IndexTypeFor(vertexCount);
+		range.indexOffset = AddIndices(indices, indexCount, range.indexType);
+		return range;
+	}
+
+	// Appends another index list, e.g. a LOD of a mesh added before. Returns its byte offset.
+	size_t AddIndices(const unsigned int *indices, unsigned int indexCount, GLenum indexType)
+	{
+		create();
+
+		// Keep every range 4 byte aligned so 32 bit ranges can follow 16 bit ones
+		size_t offset = (indexUsed + 3) & ~(size_t)3;
+		size_t indexBytes = (size_t)indexCount * IndexSize(indexType);
+		grow(EBO, indexUsed, indexCapacity, offset + indexBytes, true);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+		BufferIndices(GL_COPY_WRITE_BUFFER, offset, indices, indexCount, indexType);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		indexUsed = offset + indexBytes;
+		return offset;
+	}
+
+	void Bind() const
+	{
+		glBindVertexArray(VAO);
+	}
+
+	unsigned int VertexArray() const { return VAO; }
+
+	size_t VertexBytes() const { return vertexUsed; }
+	size_t IndexBytes() const { return indexUsed; }
+	size_t CapacityBytes() const { return vertexCapacity + indexCapacity; }
+
+	void Release()
+	{
+		if ( VAO == 0 )
+			return;
+
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
+		vertexUsed = vertexCapacity = indexUsed = indexCapacity = 0;
+	}
+
+ private:
+	VertexFormat format;
+	unsigned int VAO, VBO, EBO;
+	size_t vertexUsed, vertexCapacity;
+	size_t indexUsed, indexCapacity;
+
+	MeshArena(const MeshArena &);
+	MeshArena &operator=(const MeshArena &);
+
+	void create()
+	{
+		if ( VAO != 0 )
+			return;
+
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+	}
+
+	// Reallocates buffer with room for at least needed bytes, keeping the used part
+	void grow(unsigned int &buffer, size_t used, size_t &capacity, size_t needed, bool isIndexBuffer)
+	{
+		if ( needed <= capacity )
+			return;
+
+		size_t newCapacity = capacity * 2 > needed ? capacity * 2 : needed;
+		unsigned int newBuffer;
+		glGenBuffers(1, &newBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, NULL, GL_STATIC_DRAW);
+		if ( used > 0 )
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+		buffer = newBuffer;
+		capacity = newCapacity;
+
+		// Point the VAO at the new buffer
+		glBindVertexArray(VAO);
+		if ( isIndexBuffer )
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		else
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, VBO);
+			format.SetupAttributes();
+		}
+		glBindVertexArray(0);
+	}
+};
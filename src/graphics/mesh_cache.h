@@ -0,0 +1,506 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <iostream>
+#include <stdint.h>
+#include "../core/hash.h"
+#include "../core/vfs.h"
+#include "mesh.h"
+#include "obj_loader.h"
+
+using namespace std;
+
+// Binary copy of an imported model, written next to the source file (nanosuit.obj ->
+// nanosuit.obj.meshcache) so warm starts skip Assimp. Layout, every section 8 byte aligned:
+//
+//   MeshCacheHeader
+//   MeshCacheEntry[meshCount]
+//   MeshCacheTextureRef[textureCount]
+//   MeshCacheLod[lodCount]
+//   Meshlet[meshletCount]
+//   MeshCacheLibrary[libraryCount]
+//   string data (texture types and paths, library paths)
+//   per mesh: Vertex[vertexCount], unsigned int[indexCount], then the indices of every LOD
+//
+// The cache is stale when the source, one of its material libraries or the importer asked for
+// changes. The importer that produced the meshes is kept too, it differs from the one asked
+// for when ObjLoader could not read a file and Assimp was used instead.
+// Bump MESH_CACHE_VERSION whenever the import processing or the Vertex layout changes.
+const uint32_t MESH_CACHE_MAGIC = 0x4853454d; // "MESH"
+const uint32_t MESH_CACHE_VERSION = 9;
+
+enum MeshCacheImporter
+{
+	MESH_CACHE_IMPORTER_NATIVE,
+	MESH_CACHE_IMPORTER_ASSIMP
+};
+
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexSize;
+	uint32_t meshCount;
+	uint32_t textureCount;
+	uint32_t lodCount;
+	uint32_t meshletCount;
+	uint32_t libraryCount;
+	// Asked for by the loader and the one that produced the meshes
+	uint32_t requestedImporter;
+	uint32_t importer;
+	int64_t sourceMtime;
+	uint64_t sourceSize;
+	uint64_t sourceHash;
+	uint64_t stringsOffset;
+	// Of every vertex, readable before the meshes are loaded (see Model::Update)
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+struct MeshCacheEntry
+{
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t firstTexture;
+	uint32_t textureCount;
+	uint32_t firstLod;
+	uint32_t lodCount;
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
+struct MeshCacheTextureRef
+{
+	uint32_t typeOffset;
+	uint32_t typeLength;
+	uint32_t pathOffset;
+	uint32_t pathLength;
+};
+
+struct MeshCacheLod
+{
+	uint32_t indexCount;
+	float error;
+};
+
+// A material library (mtllib) of an .obj source, hash is 0 if the file did not exist
+struct MeshCacheLibrary
+{
+	int64_t mtime;
+	uint64_t size;
+	uint64_t hash;
+	uint32_t pathOffset;
+	uint32_t pathLength;
+};
+
+class MeshCache
+{
+ public:
+	static string CachePath(const string &sourcePath)
+	{
+		return sourcePath + ".meshcache";
+	}
+
+	MeshCache() : refresh(false) {}
+
+	~MeshCache()
+	{
+		Close();
+	}
+
+	// Maps the cache of sourcePath written for the same requested importer. Fails if there is
+	// none or if it is stale.
+	bool Open(const string &sourcePath, MeshCacheImporter requestedImporter)
+	{
+		Close();
+		string cachePath = CachePath(sourcePath);
+		if ( !Vfs::Get().Open(cachePath, file) )
+			return false;
+
+		if ( file.Size() < sizeof(MeshCacheHeader) || !isValid(sourcePath, requestedImporter) )
+		{
+			file.Close();
+			refresh = false;
+			return false;
+		}
+		// Loose files only, an archive entry cannot be updated in place
+		if ( refresh && Vfs::Get().InArchive(cachePath) )
+			refresh = false;
+		if ( refresh )
+			refreshPath = cachePath;
+		return true;
+	}
+
+	// Unmaps the cache, then remembers the new mtimes of sources that were touched without
+	// changing so the next start does not hash them again
+	void Close()
+	{
+		file.Close();
+		if ( !refresh )
+			return;
+		refresh = false;
+
+		FILE *out = fopen(refreshPath.c_str(), "r+b");
+		if ( !out )
+			return;
+		fseek(out, offsetof(MeshCacheHeader, sourceMtime), SEEK_SET);
+		fwrite(&refreshedMtime, sizeof(refreshedMtime), 1, out);
+		for (unsigned int i = 0; i < refreshedLibraries.size(); i++)
+		{
+			fseek(out, refreshedLibraries[i].first, SEEK_SET);
+			fwrite(&refreshedLibraries[i].second, sizeof(int64_t), 1, out);
+		}
+		fclose(out);
+	}
+
+	unsigned int MeshCount() const { return header()->meshCount; }
+	glm::vec3 BoundsMin() const { return glm::vec3(header()->boundsMin[0], header()->boundsMin[1], header()->boundsMin[2]); }
+	glm::vec3 BoundsMax() const { return glm::vec3(header()->boundsMax[0], header()->boundsMax[1], header()->boundsMax[2]); }
+
+	// The importer that produced the cached meshes
+	MeshCacheImporter Importer() const { return (MeshCacheImporter)header()->importer; }
+
+	unsigned int VertexCount(unsigned int mesh) const { return entry(mesh)->vertexCount; }
+	const Vertex *Vertices(unsigned int mesh) const
+	{
+		return (const Vertex *)(file.Data() + entry(mesh)->vertexOffset);
+	}
+
+	unsigned int IndexCount(unsigned int mesh) const { return entry(mesh)->indexCount; }
+	const unsigned int *Indices(unsigned int mesh) const
+	{
+		return (const unsigned int *)(file.Data() + entry(mesh)->indexOffset);
+	}
+
+	// Coarser levels of a mesh, their indices follow the full index list
+	unsigned int LodCount(unsigned int mesh) const { return entry(mesh)->lodCount; }
+	unsigned int LodIndexCount(unsigned int mesh, unsigned int lod) const { return lodEntry(mesh, lod)->indexCount; }
+	float LodError(unsigned int mesh, unsigned int lod) const { return lodEntry(mesh, lod)->error; }
+	const unsigned int *LodIndices(unsigned int mesh, unsigned int lod) const
+	{
+		const unsigned int *indices = Indices(mesh) + IndexCount(mesh);
+		for (unsigned int i = 0; i < lod; i++)
+			indices += LodIndexCount(mesh, i);
+		return indices;
+	}
+
+	unsigned int MeshletCount(unsigned int mesh) const { return entry(mesh)->meshletCount; }
+	const Meshlet *Meshlets(unsigned int mesh) const
+	{
+		return (const Meshlet *)(lodTable() + header()->lodCount) + entry(mesh)->firstMeshlet;
+	}
+
+	unsigned int TextureCount(unsigned int mesh) const { return entry(mesh)->textureCount; }
+	string TextureType(unsigned int mesh, unsigned int i) const
+	{
+		const MeshCacheTextureRef *ref = textureRef(mesh, i);
+		return string(strings() + ref->typeOffset, ref->typeLength);
+	}
+	string TexturePath(unsigned int mesh, unsigned int i) const
+	{
+		const MeshCacheTextureRef *ref = textureRef(mesh, i);
+		return string(strings() + ref->pathOffset, ref->pathLength);
+	}
+
+	// importer is the one that produced meshes, requestedImporter the one Open is called with
+	static bool Write(const string &sourcePath, const vector<Mesh> &meshes, MeshCacheImporter requestedImporter, MeshCacheImporter importer)
+	{
+		MeshCacheHeader header = MeshCacheHeader();
+		header.magic = MESH_CACHE_MAGIC;
+		header.version = MESH_CACHE_VERSION;
+		header.vertexSize = sizeof(Vertex);
+		header.meshCount = meshes.size();
+		header.requestedImporter = requestedImporter;
+		header.importer = importer;
+		if ( !Vfs::Get().Stat(sourcePath, &header.sourceMtime, &header.sourceSize) || !hashFile(sourcePath, &header.sourceHash) )
+			return false;
+
+		vector<MeshCacheEntry> entries(meshes.size());
+		vector<MeshCacheTextureRef> refs;
+		vector<MeshCacheLod> lods;
+		vector<Meshlet> meshlets;
+		vector<MeshCacheLibrary> libraries;
+		string strings;
+
+		vector<string> libraryPaths = materialLibraries(sourcePath);
+		for (unsigned int i = 0; i < libraryPaths.size(); i++)
+		{
+			MeshCacheLibrary library = MeshCacheLibrary();
+			if ( Vfs::Get().Stat(libraryPaths[i], &library.mtime, &library.size) && !hashFile(libraryPaths[i], &library.hash) )
+				return false;
+			library.pathOffset = strings.size();
+			library.pathLength = libraryPaths[i].size();
+			strings += libraryPaths[i];
+			libraries.push_back(library);
+		}
+		glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+		bool hasBounds = false;
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			for (unsigned int j = 0; j < meshes[i].vertices.size(); j++)
+			{
+				const glm::vec3 &position = meshes[i].vertices[j].Position;
+				boundsMin = hasBounds ? glm::min(boundsMin, position) : position;
+				boundsMax = hasBounds ? glm::max(boundsMax, position) : position;
+				hasBounds = true;
+			}
+
+			entries[i].firstMeshlet = meshlets.size();
+			entries[i].meshletCount = meshes[i].meshlets.size();
+			meshlets.insert(meshlets.end(), meshes[i].meshlets.begin(), meshes[i].meshlets.end());
+
+			entries[i].firstLod = lods.size();
+			entries[i].lodCount = meshes[i].lods.size();
+			for (unsigned int j = 0; j < meshes[i].lods.size(); j++)
+			{
+				MeshCacheLod lod;
+				lod.indexCount = meshes[i].lods[j].indices.size();
+				lod.error = meshes[i].lods[j].error;
+				lods.push_back(lod);
+			}
+
+			entries[i].firstTexture = refs.size();
+			entries[i].textureCount = meshes[i].textures.size();
+			for (unsigned int j = 0; j < meshes[i].textures.size(); j++)
+			{
+				const Texture &texture = meshes[i].textures[j];
+				MeshCacheTextureRef ref;
+				ref.typeOffset = strings.size();
+				ref.typeLength = texture.type.size();
+				strings += texture.type;
+				ref.pathOffset = strings.size();
+				ref.pathLength = texture.path.size();
+				strings += texture.path;
+				refs.push_back(ref);
+			}
+		}
+		header.textureCount = refs.size();
+		header.lodCount = lods.size();
+		header.meshletCount = meshlets.size();
+		header.libraryCount = libraries.size();
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			header.boundsMin[i] = boundsMin[i];
+			header.boundsMax[i] = boundsMax[i];
+		}
+
+		uint64_t offset = sizeof(MeshCacheHeader) + entries.size() * sizeof(MeshCacheEntry) + refs.size() * sizeof(MeshCacheTextureRef) + lods.size() * sizeof(MeshCacheLod)
+			+ meshlets.size() * sizeof(Meshlet) + libraries.size() * sizeof(MeshCacheLibrary);
+		header.stringsOffset = offset;
+		offset = align(offset + strings.size());
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			entries[i].vertexCount = meshes[i].vertices.size();
+			entries[i].indexCount = meshes[i].indices.size();
+			entries[i].vertexOffset = offset;
+			offset = align(offset + meshes[i].vertices.size() * sizeof(Vertex));
+			entries[i].indexOffset = offset;
+			offset = align(offset + totalIndexCount(meshes[i]) * sizeof(unsigned int));
+		}
+
+		// Written to a temporary file first so a crash never leaves a truncated cache behind
+		string cachePath = CachePath(sourcePath);
+		string tempPath = cachePath + ".tmp";
+		FILE *out = fopen(tempPath.c_str(), "wb");
+		if ( !out )
+		{
+			cout << "ERROR::MESH_CACHE::CANNOT_WRITE::" << tempPath << endl;
+			return false;
+		}
+
+		bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+		ok = ok && writeArray(out, entries.data(), entries.size() * sizeof(MeshCacheEntry));
+		ok = ok && writeArray(out, refs.data(), refs.size() * sizeof(MeshCacheTextureRef));
+		ok = ok && writeArray(out, lods.data(), lods.size() * sizeof(MeshCacheLod));
+		ok = ok && writeArray(out, meshlets.data(), meshlets.size() * sizeof(Meshlet));
+		ok = ok && writeArray(out, libraries.data(), libraries.size() * sizeof(MeshCacheLibrary));
+		ok = ok && writeArray(out, strings.data(), strings.size());
+		ok = ok && pad(out);
+		for (unsigned int i = 0; ok && i < meshes.size(); i++)
+		{
+			ok = writeArray(out, meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(Vertex)) && pad(out);
+			ok = ok && writeArray(out, meshes[i].indices.data(), meshes[i].indices.size() * sizeof(unsigned int));
+			for (unsigned int j = 0; ok && j < meshes[i].lods.size(); j++)
+				ok = writeArray(out, meshes[i].lods[j].indices.data(), meshes[i].lods[j].indices.size() * sizeof(unsigned int));
+			ok = ok && pad(out);
+		}
+		ok = (fclose(out) == 0) && ok;
+
+		if ( !ok || rename(tempPath.c_str(), cachePath.c_str()) != 0 )
+		{
+			cout << "ERROR::MESH_CACHE::CANNOT_WRITE::" << cachePath << endl;
+			remove(tempPath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+ private:
+	VfsFile file;
+	// Set by isValid when a source was touched without changing, see Close
+	bool refresh;
+	string refreshPath;
+	int64_t refreshedMtime;
+	// File offset of the mtime of a library and its new value
+	vector<pair<uint64_t, int64_t> > refreshedLibraries;
+
+	const MeshCacheHeader *header() const
+	{
+		return (const MeshCacheHeader *)file.Data();
+	}
+	const MeshCacheEntry *entry(unsigned int mesh) const
+	{
+		return (const MeshCacheEntry *)(file.Data() + sizeof(MeshCacheHeader)) + mesh;
+	}
+	const MeshCacheTextureRef *textureRef(unsigned int mesh, unsigned int i) const
+	{
+		const MeshCacheTextureRef *refs = (const MeshCacheTextureRef *)(entry(header()->meshCount));
+		return refs + entry(mesh)->firstTexture + i;
+	}
+	const MeshCacheLod *lodTable() const
+	{
+		return (const MeshCacheLod *)((const MeshCacheTextureRef *)entry(header()->meshCount) + header()->textureCount);
+	}
+	const MeshCacheLod *lodEntry(unsigned int mesh, unsigned int lod) const
+	{
+		return lodTable() + entry(mesh)->firstLod + lod;
+	}
+	const MeshCacheLibrary *libraryTable() const
+	{
+		return (const MeshCacheLibrary *)((const Meshlet *)(lodTable() + header()->lodCount) + header()->meshletCount);
+	}
+	const char *strings() const
+	{
+		return (const char *)file.Data() + header()->stringsOffset;
+	}
+
+	bool isValid(const string &sourcePath, MeshCacheImporter requestedImporter)
+	{
+		const MeshCacheHeader *cached = header();
+		if ( cached->magic != MESH_CACHE_MAGIC || cached->version != MESH_CACHE_VERSION || cached->vertexSize != sizeof(Vertex) || cached->requestedImporter != (uint32_t)requestedImporter )
+			return false;
+
+		uint64_t tablesEnd = sizeof(MeshCacheHeader) + (uint64_t)cached->meshCount * sizeof(MeshCacheEntry) + (uint64_t)cached->textureCount * sizeof(MeshCacheTextureRef)
+			+ (uint64_t)cached->lodCount * sizeof(MeshCacheLod) + (uint64_t)cached->meshletCount * sizeof(Meshlet) + (uint64_t)cached->libraryCount * sizeof(MeshCacheLibrary);
+		if ( tablesEnd > file.Size() || cached->stringsOffset > file.Size() )
+			return false;
+		for (unsigned int i = 0; i < cached->meshCount; i++)
+		{
+			const MeshCacheEntry *mesh = entry(i);
+			if ( mesh->firstTexture + mesh->textureCount > cached->textureCount || mesh->firstLod + mesh->lodCount > cached->lodCount
+					 || mesh->firstMeshlet + mesh->meshletCount > cached->meshletCount )
+				return false;
+
+			uint64_t indexCount = mesh->indexCount;
+			for (unsigned int j = 0; j < mesh->lodCount; j++)
+				indexCount += LodIndexCount(i, j);
+			if ( mesh->vertexOffset + (uint64_t)mesh->vertexCount * sizeof(Vertex) > file.Size()
+					 || mesh->indexOffset + indexCount * sizeof(unsigned int) > file.Size() )
+				return false;
+			for (unsigned int j = 0; j < mesh->meshletCount; j++)
+			{
+				const Meshlet &meshlet = Meshlets(i)[j];
+				if ( (uint64_t)meshlet.firstIndex + meshlet.indexCount > mesh->indexCount )
+					return false;
+			}
+		}
+		for (unsigned int i = 0; i < cached->textureCount; i++)
+		{
+			const MeshCacheTextureRef *ref = (const MeshCacheTextureRef *)entry(cached->meshCount) + i;
+			if ( cached->stringsOffset + ref->typeOffset + ref->typeLength > file.Size()
+					 || cached->stringsOffset + ref->pathOffset + ref->pathLength > file.Size() )
+				return false;
+		}
+
+		for (unsigned int i = 0; i < cached->libraryCount; i++)
+		{
+			if ( cached->stringsOffset + libraryTable()[i].pathOffset + libraryTable()[i].pathLength > file.Size() )
+				return false;
+		}
+
+		int64_t mtime;
+		if ( !isUnchanged(sourcePath, cached->sourceMtime, cached->sourceSize, cached->sourceHash, &mtime) )
+			return false;
+		refreshedMtime = mtime;
+		refresh = mtime != cached->sourceMtime;
+
+		refreshedLibraries.clear();
+		for (unsigned int i = 0; i < cached->libraryCount; i++)
+		{
+			const MeshCacheLibrary &library = libraryTable()[i];
+			string path(strings() + library.pathOffset, library.pathLength);
+			if ( !isUnchanged(path, library.mtime, library.size, library.hash, &mtime) )
+				return false;
+			if ( mtime != library.mtime )
+			{
+				uint64_t offset = (const unsigned char *)&library - file.Data() + offsetof(MeshCacheLibrary, mtime);
+				refreshedLibraries.push_back(make_pair(offset, mtime));
+				refresh = true;
+			}
+		}
+		return true;
+	}
+
+	// Whether path still has the content it had when cached, a hash of 0 meaning it did not
+	// exist. A file that was only touched is hashed, mtime gets its current time.
+	static bool isUnchanged(const string &path, int64_t cachedMtime, uint64_t cachedSize, uint64_t cachedHash, int64_t *mtime)
+	{
+		uint64_t size;
+		*mtime = cachedMtime;
+		if ( !Vfs::Get().Stat(path, mtime, &size) )
+			return cachedHash == 0;
+		if ( size != cachedSize )
+			return false;
+		if ( *mtime == cachedMtime )
+			return true;
+
+		uint64_t hash;
+		return hashFile(path, &hash) && hash == cachedHash;
+	}
+
+	// The mtllib files of an .obj, other formats keep their materials inside
+	static vector<string> materialLibraries(const string &sourcePath)
+	{
+		bool isObj = sourcePath.size() > 4 && sourcePath.compare(sourcePath.size() - 4, 4, ".obj") == 0;
+		return isObj ? ObjLoader::MaterialLibraries(sourcePath) : vector<string>();
+	}
+
+	static bool hashFile(const string &path, uint64_t *hash)
+	{
+		VfsFile source;
+		if ( !Vfs::Get().Open(path, source) )
+			return false;
+		*hash = HashBytes(source.Data(), source.Size());
+		return true;
+	}
+
+	static uint64_t totalIndexCount(const Mesh &mesh)
+	{
+		uint64_t count = mesh.indices.size();
+		for (unsigned int i = 0; i < mesh.lods.size(); i++)
+			count += mesh.lods[i].indices.size();
+		return count;
+	}
+
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + 7) & ~(uint64_t)7;
+	}
+
+	static bool writeArray(FILE *out, const void *data, size_t size)
+	{
+		return size == 0 || fwrite(data, size, 1, out) == 1;
+	}
+
+	static bool pad(FILE *out)
+	{
+		static const char zeros[8] = { 0 };
+		long position = ftell(out);
+		return position >= 0 && writeArray(out, zeros, align(position) - position);
+	}
+};
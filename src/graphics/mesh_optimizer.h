@@ -0,0 +1,410 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "../core/hash.h"
+#include "meshlet.h"
+#include "vertex_format.h"
+
+using namespace std;
+
+struct VertexCacheStats
+{
+	// Average cache miss ratio, vertex shader invocations per triangle (0.5 is ideal)
+	float acmr;
+	// Average transform to vertex ratio, invocations per unique vertex (1.0 is ideal)
+	float atvr;
+};
+
+// Import time reordering of triangle lists so the GPU transforms every vertex as few times
+// as possible. All functions expect triangle lists (3 indices per triangle).
+class MeshOptimizer
+{
+ public:
+	// Vertex count the statistics assume for the post transform cache (FIFO)
+	static const unsigned int STATS_CACHE_SIZE = 16;
+
+	// Runs every stage in order and returns the statistics before and after, of the order
+	// that is uploaded. With meshlets the mesh is also split into meshlets (see
+	// MeshletBuilder), which decides the triangle order: the cache and overdraw passes then
+	// work within and between meshlets.
+	static void Optimize(vector<Vertex> &vertices, vector<unsigned int> &indices, vector<Meshlet> *meshlets, VertexCacheStats *before, VertexCacheStats *after)
+	{
+		*before = AnalyzeVertexCache(indices, vertices.size());
+		if ( indices.size() % 3 != 0 || indices.empty() )
+		{
+			*after = *before;
+			return;
+		}
+
+		WeldVertices(vertices, indices);
+		OptimizeVertexCache(indices, vertices.size());
+		if ( meshlets )
+		{
+			*meshlets = MeshletBuilder::Build(vertices, indices);
+			OptimizeMeshlets(indices, *meshlets, vertices, 1.05f);
+		}
+		else
+		{
+			OptimizeOverdraw(indices, vertices, 1.05f);
+		}
+		OptimizeVertexFetch(vertices, indices);
+		*after = AnalyzeVertexCache(indices, vertices.size());
+	}
+
+	// Merges vertices whose attributes are bit identical
+	static void WeldVertices(vector<Vertex> &vertices, vector<unsigned int> &indices)
+	{
+		vector<unsigned int> remap(vertices.size());
+		unordered_map<uint64_t, vector<unsigned int> > buckets;
+		buckets.reserve(vertices.size());
+
+		vector<Vertex> welded;
+		welded.reserve(vertices.size());
+		for (unsigned int i = 0; i < vertices.size(); ++i)
+		{
+			vector<unsigned int> &bucket = buckets[HashBytes(&vertices[i], sizeof(Vertex))];
+			unsigned int found = welded.size();
+			for (unsigned int j = 0; j < bucket.size(); ++j)
+			{
+				if ( memcmp(&welded[bucket[j]], &vertices[i], sizeof(Vertex)) == 0 )
+				{
+					found = bucket[j];
+					break;
+				}
+			}
+			if ( found == welded.size() )
+			{
+				bucket.push_back(found);
+				welded.push_back(vertices[i]);
+			}
+			remap[i] = found;
+		}
+
+		for (unsigned int i = 0; i < indices.size(); ++i)
+			indices[i] = remap[indices[i]];
+		vertices.swap(welded);
+	}
+
+	// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": greedily emits the triangle
+	// whose vertices score best, favouring recently used vertices and vertices with few
+	// remaining triangles so no stragglers are left behind.
+	static void OptimizeVertexCache(vector<unsigned int> &indices, unsigned int vertexCount)
+	{
+		unsigned int triangleCount = indices.size() / 3;
+
+		// Triangles around every vertex, compressed
+		vector<unsigned int> offsets(vertexCount + 1, 0);
+		for (unsigned int i = 0; i < indices.size(); ++i)
+			offsets[indices[i] + 1]++;
+		for (unsigned int i = 0; i < vertexCount; ++i)
+			offsets[i + 1] += offsets[i];
+		vector<unsigned int> adjacency(indices.size());
+		vector<unsigned int> valence(vertexCount, 0);
+		for (unsigned int i = 0; i < indices.size(); ++i)
+		{
+			unsigned int vertex = indices[i];
+			adjacency[offsets[vertex] + valence[vertex]++] = i / 3;
+		}
+
+		vector<int> cachePosition(vertexCount, -1);
+		vector<float> vertexScore(vertexCount);
+		for (unsigned int i = 0; i < vertexCount; ++i)
+			vertexScore[i] = forsythScore(-1, valence[i]);
+
+		vector<float> triangleScore(triangleCount);
+		vector<bool> emitted(triangleCount, false);
+		for (unsigned int i = 0; i < triangleCount; ++i)
+			triangleScore[i] = vertexScore[indices[i * 3]] + vertexScore[indices[i * 3 + 1]] + vertexScore[indices[i * 3 + 2]];
+
+		vector<unsigned int> result;
+		result.reserve(indices.size());
+		vector<unsigned int> cache, nextCache;
+		unsigned int cursor = 0;
+		int best = -1;
+
+		while ( result.size() < indices.size() )
+		{
+			// Dead end, continue with the next triangle in input order
+			if ( best < 0 )
+			{
+				while ( emitted[cursor] )
+					cursor++;
+				best = cursor;
+			}
+
+			unsigned int triangle = best;
+			emitted[triangle] = true;
+			nextCache.clear();
+			for (unsigned int k = 0; k < 3; ++k)
+			{
+				unsigned int vertex = indices[triangle * 3 + k];
+				result.push_back(vertex);
+				nextCache.push_back(vertex);
+
+				// Remove the triangle from the vertex adjacency
+				unsigned int *begin = &adjacency[offsets[vertex]];
+				unsigned int *end = begin + valence[vertex];
+				*std::find(begin, end, triangle) = *(end - 1);
+				valence[vertex]--;
+			}
+			for (unsigned int k = 0; k < cache.size(); ++k)
+			{
+				if ( std::find(nextCache.begin(), nextCache.end(), cache[k]) == nextCache.end() )
+					nextCache.push_back(cache[k]);
+			}
+
+			// Rescore everything that was or is in the cache, then pick the best triangle touching it
+			for (unsigned int k = 0; k < nextCache.size(); ++k)
+			{
+				unsigned int vertex = nextCache[k];
+				cachePosition[vertex] = k < CACHE_SIZE ? (int)k : -1;
+			}
+			best = -1;
+			float bestScore = -1.0f;
+			for (unsigned int k = 0; k < nextCache.size(); ++k)
+			{
+				unsigned int vertex = nextCache[k];
+				float score = forsythScore(cachePosition[vertex], valence[vertex]);
+				float delta = score - vertexScore[vertex];
+				vertexScore[vertex] = score;
+
+				for (unsigned int t = 0; t < valence[vertex]; ++t)
+				{
+					unsigned int adjacent = adjacency[offsets[vertex] + t];
+					triangleScore[adjacent] += delta;
+					if ( triangleScore[adjacent] > bestScore )
+					{
+						bestScore = triangleScore[adjacent];
+						best = adjacent;
+					}
+				}
+			}
+
+			if ( nextCache.size() > CACHE_SIZE )
+				nextCache.resize(CACHE_SIZE);
+			cache.swap(nextCache);
+		}
+
+		indices.swap(result);
+	}
+
+	// Tipsify style overdraw pass: cuts the cache optimized order into clusters wherever the
+	// cache ran cold, then draws clusters facing away from the mesh center first so they
+	// occlude the inner ones. Kept only if the ACMR grows by less than threshold.
+	static void OptimizeOverdraw(vector<unsigned int> &indices, const vector<Vertex> &vertices, float threshold)
+	{
+		unsigned int triangleCount = indices.size() / 3;
+		if ( triangleCount < 2 )
+			return;
+
+		vector<unsigned int> clusterStart;
+		FifoCache cache(vertices.size());
+		for (unsigned int i = 0; i < triangleCount; ++i)
+		{
+			unsigned int misses = cache.Access(indices[i * 3]) + cache.Access(indices[i * 3 + 1]) + cache.Access(indices[i * 3 + 2]);
+			if ( misses == 3 )
+				clusterStart.push_back(i);
+		}
+		if ( clusterStart.size() < 2 )
+			return;
+
+		vector<unsigned int> order = overdrawOrder(indices, vertices, clusterStart);
+		vector<unsigned int> result;
+		result.reserve(indices.size());
+		for (unsigned int k = 0; k < order.size(); ++k)
+		{
+			unsigned int c = order[k];
+			unsigned int end = c + 1 < clusterStart.size() ? clusterStart[c + 1] : triangleCount;
+			result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + end * 3);
+		}
+
+		if ( AnalyzeVertexCache(result, vertices.size()).acmr <= AnalyzeVertexCache(indices, vertices.size()).acmr * threshold )
+			indices.swap(result);
+	}
+
+	// The same two passes for a mesh split into meshlets, which must stay contiguous: the
+	// triangles of every meshlet are cache optimized on their own, then the meshlets are the
+	// clusters of the overdraw order. The meshlet ranges are updated to match.
+	static void OptimizeMeshlets(vector<unsigned int> &indices, vector<Meshlet> &meshlets, const vector<Vertex> &vertices, float threshold)
+	{
+		// Meshlets have few vertices, numbered locally the cache pass needs little memory
+		const unsigned int unused = ~0u;
+		vector<unsigned int> local(vertices.size(), unused);
+		vector<unsigned int> global, triangles;
+		for (unsigned int m = 0; m < meshlets.size(); ++m)
+		{
+			unsigned int first = meshlets[m].firstIndex, count = meshlets[m].indexCount;
+			triangles.resize(count);
+			global.clear();
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				unsigned int &vertex = local[indices[first + i]];
+				if ( vertex == unused )
+				{
+					vertex = global.size();
+					global.push_back(indices[first + i]);
+				}
+				triangles[i] = vertex;
+			}
+
+			OptimizeVertexCache(triangles, global.size());
+			for (unsigned int i = 0; i < count; ++i)
+				indices[first + i] = global[triangles[i]];
+			for (unsigned int i = 0; i < global.size(); ++i)
+				local[global[i]] = unused;
+		}
+
+		if ( meshlets.size() < 2 )
+			return;
+
+		vector<unsigned int> clusterStart(meshlets.size());
+		for (unsigned int m = 0; m < meshlets.size(); ++m)
+			clusterStart[m] = meshlets[m].firstIndex / 3;
+
+		vector<unsigned int> order = overdrawOrder(indices, vertices, clusterStart);
+		vector<unsigned int> result;
+		result.reserve(indices.size());
+		vector<Meshlet> ordered(meshlets.size());
+		for (unsigned int k = 0; k < order.size(); ++k)
+		{
+			const Meshlet &meshlet = meshlets[order[k]];
+			ordered[k] = meshlet;
+			ordered[k].firstIndex = result.size();
+			result.insert(result.end(), indices.begin() + meshlet.firstIndex, indices.begin() + meshlet.firstIndex + meshlet.indexCount);
+		}
+
+		if ( AnalyzeVertexCache(result, vertices.size()).acmr <= AnalyzeVertexCache(indices, vertices.size()).acmr * threshold )
+		{
+			indices.swap(result);
+			meshlets.swap(ordered);
+		}
+	}
+
+	// Stores vertices in the order the index buffer first references them, unused ones are dropped
+	static void OptimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+	{
+		const unsigned int unused = ~0u;
+		vector<unsigned int> remap(vertices.size(), unused);
+		vector<Vertex> ordered;
+		ordered.reserve(vertices.size());
+		for (unsigned int i = 0; i < indices.size(); ++i)
+		{
+			unsigned int &target = remap[indices[i]];
+			if ( target == unused )
+			{
+				target = ordered.size();
+				ordered.push_back(vertices[indices[i]]);
+			}
+			indices[i] = target;
+		}
+		vertices.swap(ordered);
+	}
+
+	static VertexCacheStats AnalyzeVertexCache(const vector<unsigned int> &indices, unsigned int vertexCount)
+	{
+		VertexCacheStats stats;
+		FifoCache cache(vertexCount);
+		unsigned int misses = 0;
+		for (unsigned int i = 0; i < indices.size(); ++i)
+			misses += cache.Access(indices[i]);
+
+		stats.acmr = indices.size() < 3 ? 0.0f : (float)misses / (indices.size() / 3);
+		stats.atvr = vertexCount == 0 ? 0.0f : (float)misses / vertexCount;
+		return stats;
+	}
+
+ private:
+	// Cache size the Forsyth scoring optimizes for
+	static const unsigned int CACHE_SIZE = 32;
+
+	// Clusters given by their first triangle, drawn facing away from the mesh center first.
+	// Returns the cluster indices in drawing order.
+	static vector<unsigned int> overdrawOrder(const vector<unsigned int> &indices, const vector<Vertex> &vertices, const vector<unsigned int> &clusterStart)
+	{
+		unsigned int triangleCount = indices.size() / 3;
+		glm::vec3 meshCenter(0.0f);
+		float meshArea = 0.0f;
+		vector<glm::vec3> clusterCenter(clusterStart.size());
+		vector<glm::vec3> clusterNormal(clusterStart.size());
+		for (unsigned int c = 0; c < clusterStart.size(); ++c)
+		{
+			unsigned int end = c + 1 < clusterStart.size() ? clusterStart[c + 1] : triangleCount;
+			glm::vec3 center(0.0f), normal(0.0f);
+			float area = 0.0f;
+			for (unsigned int i = clusterStart[c]; i < end; ++i)
+			{
+				glm::vec3 a = vertices[indices[i * 3]].Position;
+				glm::vec3 b = vertices[indices[i * 3 + 1]].Position;
+				glm::vec3 d = vertices[indices[i * 3 + 2]].Position;
+				glm::vec3 n = glm::cross(b - a, d - a);
+				float triangleArea = glm::length(n);
+				center += (a + b + d) * (triangleArea / 3.0f);
+				normal += n;
+				area += triangleArea;
+			}
+			meshCenter += center;
+			meshArea += area;
+			clusterCenter[c] = area > 0.0f ? center / area : vertices[indices[clusterStart[c] * 3]].Position;
+			clusterNormal[c] = normal;
+		}
+		if ( meshArea > 0.0f )
+			meshCenter /= meshArea;
+
+		vector<float> sortKey(clusterStart.size());
+		vector<unsigned int> order(clusterStart.size());
+		for (unsigned int c = 0; c < clusterStart.size(); ++c)
+		{
+			float length = glm::length(clusterNormal[c]);
+			sortKey[c] = length > 0.0f ? glm::dot(clusterCenter[c] - meshCenter, clusterNormal[c] / length) : 0.0f;
+			order[c] = c;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+		return order;
+	}
+
+	static float forsythScore(int cachePosition, unsigned int remainingValence)
+	{
+		if ( remainingValence == 0 )
+			return -1.0f;
+
+		float score = 0.0f;
+		if ( cachePosition >= 0 )
+		{
+			// The last triangle's vertices get a fixed score so its neighbours are not favoured
+			// over each other
+			if ( cachePosition < 3 )
+				score = 0.75f;
+			else
+				score = powf(1.0f - (float)(cachePosition - 3) / (CACHE_SIZE - 3), 1.5f);
+		}
+		return score + 2.0f / sqrtf((float)remainingValence);
+	}
+
+	// Post transform cache as found on most GPUs: first in, first out with STATS_CACHE_SIZE entries
+	class FifoCache
+	{
+	 public:
+		FifoCache(unsigned int vertexCount) : timestamps(vertexCount, 0), time(STATS_CACHE_SIZE + 1)
+		{
+		}
+		// 1 on a miss
+		unsigned int Access(unsigned int vertex)
+		{
+			if ( time - timestamps[vertex] > STATS_CACHE_SIZE )
+			{
+				timestamps[vertex] = time++;
+				return 1;
+			}
+			return 0;
+		}
+	 private:
+		vector<unsigned int> timestamps;
+		unsigned int time;
+	};
+};
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "vertex_format.h"
+#include "mesh_optimizer.h"
+
+using namespace std;
+
+// A coarser index list over the same vertices as the full mesh
+struct MeshLod
+{
+	vector<unsigned int> indices;
+	// Object space distance the level may deviate from the full mesh
+	float error;
+};
+
+// Quadric error metric simplification (Garland & Heckbert) by edge collapse. Vertices are
+// only ever collapsed onto one of their neighbours, so every level is just another index
+// list over the original vertex buffer. Vertices on open borders and on attribute seams
+// (same position, different normal or uv) never move, which keeps textures and silhouettes
+// from tearing.
+class MeshSimplifier
+{
+ public:
+	// Levels halving the triangle count each time, stopping at MIN_TRIANGLES, at maxError
+	// (relative to the mesh radius) or when a level cannot remove a fifth of the triangles
+	static vector<MeshLod> BuildLodChain(const vector<Vertex> &vertices, const vector<unsigned int> &indices, unsigned int maxLevels = 4, float maxError = 0.1f)
+	{
+		vector<MeshLod> lods;
+		if ( indices.size() % 3 != 0 || indices.size() / 3 < MIN_TRIANGLES * 2 )
+			return lods;
+
+		float radius = meshRadius(vertices);
+		const vector<unsigned int> *source = &indices;
+		float error = 0.0f;
+		for (unsigned int level = 0; level < maxLevels; level++)
+		{
+			unsigned int target = source->size() / 2;
+			if ( target / 3 < MIN_TRIANGLES )
+				break;
+
+			float levelError;
+			MeshLod lod;
+			lod.indices = Simplify(vertices, *source, target - target % 3, maxError * radius, &levelError);
+			if ( lod.indices.size() > source->size() * 4 / 5 )
+				break;
+
+			// Each level is simplified from the previous one, errors add up
+			error += levelError;
+			lod.error = error;
+			MeshOptimizer::OptimizeVertexCache(lod.indices, vertices.size());
+			lods.push_back(lod);
+			source = &lods.back().indices;
+		}
+		return lods;
+	}
+
+	// Collapses edges, cheapest first, until the index count is at most targetIndexCount or
+	// the next collapse would move the surface by more than targetError
+	static vector<unsigned int> Simplify(const vector<Vertex> &vertices, const vector<unsigned int> &indices, unsigned int targetIndexCount, float targetError, float *resultError)
+	{
+		unsigned int vertexCount = vertices.size();
+		vector<unsigned int> result = indices;
+		*resultError = 0.0f;
+
+		vector<bool> locked = findLockedVertices(vertices, indices);
+		vector<Quadric> quadrics(vertexCount);
+		for (unsigned int i = 0; i + 2 < indices.size(); i += 3)
+		{
+			Quadric plane = Quadric::FromTriangle(vertices[indices[i]].Position, vertices[indices[i + 1]].Position, vertices[indices[i + 2]].Position);
+			for (unsigned int k = 0; k < 3; k++)
+				quadrics[indices[i + k]].Add(plane);
+		}
+
+		double maxCost = (double)targetError * targetError;
+		vector<unsigned int> remap(vertexCount);
+		vector<bool> touched(vertexCount);
+
+		// Every pass collapses a set of independent edges, then compacts the index list
+		while ( result.size() > targetIndexCount )
+		{
+			vector<unsigned int> offsets, adjacency;
+			buildAdjacency(result, vertexCount, offsets, adjacency);
+
+			vector<Collapse> collapses;
+			for (unsigned int i = 0; i < result.size(); i += 3)
+			{
+				for (unsigned int k = 0; k < 3; k++)
+				{
+					unsigned int a = result[i + k];
+					unsigned int b = result[i + (k + 1) % 3];
+					// Interior edges are seen from both triangles, only keep one. Border edges
+					// have both ends locked and never collapse anyway.
+					if ( a > b )
+						continue;
+					addCollapse(collapses, vertices, quadrics, locked, a, b);
+				}
+			}
+			if ( collapses.empty() )
+				break;
+			std::sort(collapses.begin(), collapses.end());
+
+			for (unsigned int i = 0; i < vertexCount; i++)
+				remap[i] = i;
+			std::fill(touched.begin(), touched.end(), false);
+
+			unsigned int removeGoal = (result.size() - targetIndexCount) / 3;
+			unsigned int removed = 0;
+			unsigned int collapsed = 0;
+			for (unsigned int i = 0; i < collapses.size() && removed < removeGoal; i++)
+			{
+				const Collapse &collapse = collapses[i];
+				if ( collapse.cost > maxCost )
+					break;
+				if ( touched[collapse.from] || touched[collapse.to] )
+					continue;
+				if ( flipsTriangle(vertices, result, offsets, adjacency, collapse.from, collapse.to) )
+					continue;
+
+				// Neighbours of the removed vertex change shape, leave them to the next pass
+				for (unsigned int t = offsets[collapse.from]; t < offsets[collapse.from + 1]; t++)
+				{
+					unsigned int triangle = adjacency[t];
+					for (unsigned int k = 0; k < 3; k++)
+					{
+						unsigned int corner = result[triangle * 3 + k];
+						touched[corner] = true;
+						if ( corner == collapse.to )
+							removed++;
+					}
+				}
+
+				remap[collapse.from] = collapse.to;
+				quadrics[collapse.to].Add(quadrics[collapse.from]);
+				*resultError = std::max(*resultError, (float)sqrt(collapse.cost));
+				collapsed++;
+			}
+			if ( collapsed == 0 )
+				break;
+
+			unsigned int write = 0;
+			for (unsigned int i = 0; i < result.size(); i += 3)
+			{
+				unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+				if ( a == b || b == c || a == c )
+					continue;
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+			result.resize(write);
+		}
+		return result;
+	}
+
+ private:
+	static const unsigned int MIN_TRIANGLES = 32;
+
+	// Symmetric 4x4 matrix of the summed squared plane distances, weighted by triangle area
+	struct Quadric
+	{
+		double a2, b2, c2, d2, ab, ac, ad, bc, bd, cd, weight;
+
+		Quadric() : a2(0), b2(0), c2(0), d2(0), ab(0), ac(0), ad(0), bc(0), bd(0), cd(0), weight(0)
+		{
+		}
+
+		static Quadric FromTriangle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2)
+		{
+			Quadric q;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			double area = glm::length(normal);
+			if ( area == 0.0 )
+				return q;
+
+			double a = normal.x / area, b = normal.y / area, c = normal.z / area;
+			double d = -(a * p0.x + b * p0.y + c * p0.z);
+			q.a2 = a * a * area; q.b2 = b * b * area; q.c2 = c * c * area; q.d2 = d * d * area;
+			q.ab = a * b * area; q.ac = a * c * area; q.ad = a * d * area;
+			q.bc = b * c * area; q.bd = b * d * area; q.cd = c * d * area;
+			q.weight = area;
+			return q;
+		}
+
+		void Add(const Quadric &q)
+		{
+			a2 += q.a2; b2 += q.b2; c2 += q.c2; d2 += q.d2;
+			ab += q.ab; ac += q.ac; ad += q.ad;
+			bc += q.bc; bd += q.bd; cd += q.cd;
+			weight += q.weight;
+		}
+
+		// Mean squared distance of p to the planes
+		double Error(const glm::vec3 &p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double error = a2 * x * x + b2 * y * y + c2 * z * z + d2
+				+ 2.0 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z);
+			return weight > 0.0 ? fabs(error) / weight : 0.0;
+		}
+	};
+
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double cost;
+
+		bool operator<(const Collapse &other) const
+		{
+			return cost < other.cost;
+		}
+	};
+
+	static float meshRadius(const vector<Vertex> &vertices)
+	{
+		glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+		for (unsigned int i = 0; i < vertices.size(); i++)
+		{
+			boundsMin = i == 0 ? vertices[i].Position : glm::min(boundsMin, vertices[i].Position);
+			boundsMax = i == 0 ? vertices[i].Position : glm::max(boundsMax, vertices[i].Position);
+		}
+		return glm::length(boundsMax - boundsMin) * 0.5f;
+	}
+
+	// Triangles around every vertex, compressed
+	static void buildAdjacency(const vector<unsigned int> &indices, unsigned int vertexCount, vector<unsigned int> &offsets, vector<unsigned int> &adjacency)
+	{
+		offsets.assign(vertexCount + 1, 0);
+		for (unsigned int i = 0; i < indices.size(); i++)
+			offsets[indices[i] + 1]++;
+		for (unsigned int i = 0; i < vertexCount; i++)
+			offsets[i + 1] += offsets[i];
+
+		vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		adjacency.resize(indices.size());
+		for (unsigned int i = 0; i < indices.size(); i++)
+			adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	// a -> b is a border edge when no triangle uses it as b -> a
+	static bool isBorderEdge(const vector<unsigned int> &indices, const vector<unsigned int> &offsets, const vector<unsigned int> &adjacency, unsigned int a, unsigned int b)
+	{
+		for (unsigned int t = offsets[b]; t < offsets[b + 1]; t++)
+		{
+			const unsigned int *triangle = &indices[adjacency[t] * 3];
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				if ( triangle[k] == b && triangle[(k + 1) % 3] == a )
+					return false;
+			}
+		}
+		return true;
+	}
+
+	static vector<bool> findLockedVertices(const vector<Vertex> &vertices, const vector<unsigned int> &indices)
+	{
+		vector<bool> locked(vertices.size(), false);
+
+		// Seams: several vertices at one position
+		unordered_map<uint64_t, unsigned int> firstAtPosition;
+		for (unsigned int i = 0; i < vertices.size(); i++)
+		{
+			uint64_t key = HashBytes(&vertices[i].Position, sizeof(glm::vec3));
+			unordered_map<uint64_t, unsigned int>::iterator found = firstAtPosition.find(key);
+			if ( found == firstAtPosition.end() )
+				firstAtPosition[key] = i;
+			else
+				locked[i] = locked[found->second] = true;
+		}
+
+		// Borders: edges used by one triangle only
+		vector<unsigned int> offsets, adjacency;
+		buildAdjacency(indices, vertices.size(), offsets, adjacency);
+		for (unsigned int i = 0; i < indices.size(); i += 3)
+		{
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				unsigned int a = indices[i + k];
+				unsigned int b = indices[i + (k + 1) % 3];
+				if ( isBorderEdge(indices, offsets, adjacency, a, b) )
+					locked[a] = locked[b] = true;
+			}
+		}
+		return locked;
+	}
+
+	static void addCollapse(vector<Collapse> &collapses, const vector<Vertex> &vertices, const vector<Quadric> &quadrics, const vector<bool> &locked, unsigned int a, unsigned int b)
+	{
+		if ( locked[a] && locked[b] )
+			return;
+
+		Quadric combined = quadrics[a];
+		combined.Add(quadrics[b]);
+
+		Collapse collapse;
+		if ( locked[a] || (!locked[b] && combined.Error(vertices[a].Position) < combined.Error(vertices[b].Position)) )
+		{
+			collapse.from = b;
+			collapse.to = a;
+		}
+		else
+		{
+			collapse.from = a;
+			collapse.to = b;
+		}
+		collapse.cost = combined.Error(vertices[collapse.to].Position);
+		collapses.push_back(collapse);
+	}
+
+	// True if moving from onto to turns any surviving triangle of from upside down
+	static bool flipsTriangle(const vector<Vertex> &vertices, const vector<unsigned int> &indices, const vector<unsigned int> &offsets, const vector<unsigned int> &adjacency, unsigned int from, unsigned int to)
+	{
+		for (unsigned int t = offsets[from]; t < offsets[from + 1]; t++)
+		{
+			const unsigned int *triangle = &indices[adjacency[t] * 3];
+			if ( triangle[0] == to || triangle[1] == to || triangle[2] == to )
+				continue;
+
+			glm::vec3 p[3], moved[3];
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				p[k] = vertices[triangle[k]].Position;
+				moved[k] = triangle[k] == from ? vertices[to].Position : p[k];
+			}
+			glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+			if ( glm::dot(before, after) <= 0.0f )
+				return true;
+		}
+		return false;
+	}
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "vertex_format.h"
+
+using namespace std;
+
+// A range of at most MAX_VERTICES vertices / MAX_TRIANGLES triangles of a mesh's full index
+// list, with the bounds needed to skip it on the CPU. Plain data, stored in the mesh cache.
+struct Meshlet
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	glm::vec3 center;
+	float radius;
+	glm::vec3 coneAxis;
+	// Sine of the cone's half angle widened by 90 degrees, 1 when the triangles face every
+	// way and the meshlet can never be back facing
+	float coneCutoff;
+};
+
+// The six planes of a view frustum in the space of the matrix it was built from, normals
+// pointing inwards
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	// Gribb & Hartmann: with projection * view * model the planes come out in object space
+	static Frustum FromMatrix(const glm::mat4 &m)
+	{
+		Frustum frustum;
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			glm::vec4 row(m[0][i], m[1][i], m[2][i], m[3][i]);
+			glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+			frustum.planes[i * 2] = normalizePlane(w + row);
+			frustum.planes[i * 2 + 1] = normalizePlane(w - row);
+		}
+		return frustum;
+	}
+
+	bool IntersectsSphere(const glm::vec3 &center, float radius) const
+	{
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			if ( glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius )
+				return false;
+		}
+		return true;
+	}
+
+ private:
+	static glm::vec4 normalizePlane(const glm::vec4 &plane)
+	{
+		float length = glm::length(glm::vec3(plane));
+		return length > 0.0f ? plane / length : plane;
+	}
+};
+
+class MeshletBuilder
+{
+ public:
+	static const unsigned int MAX_VERTICES = 64;
+	static const unsigned int MAX_TRIANGLES = 124;
+
+	// Grows meshlets triangle by triangle from their neighbours, preferring triangles that
+	// add no new vertex and face the same way as the meshlet so far (tight normal cones).
+	// indices are reordered so every meshlet is a contiguous range.
+	static vector<Meshlet> Build(const vector<Vertex> &vertices, vector<unsigned int> &indices)
+	{
+		vector<Meshlet> meshlets;
+		if ( indices.size() % 3 != 0 )
+			return meshlets;
+
+		unsigned int vertexCount = vertices.size();
+		unsigned int triangleCount = indices.size() / 3;
+
+		// Triangles around every vertex, compressed
+		vector<unsigned int> offsets(vertexCount + 1, 0);
+		for (unsigned int i = 0; i < indices.size(); i++)
+			offsets[indices[i] + 1]++;
+		for (unsigned int i = 0; i < vertexCount; i++)
+			offsets[i + 1] += offsets[i];
+		vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		vector<unsigned int> adjacency(indices.size());
+		for (unsigned int i = 0; i < indices.size(); i++)
+			adjacency[fill[indices[i]]++] = i / 3;
+
+		vector<glm::vec3> faceNormals(triangleCount);
+		for (unsigned int i = 0; i < triangleCount; i++)
+			faceNormals[i] = faceNormal(vertices, &indices[i * 3]);
+
+		vector<unsigned int> result;
+		result.reserve(indices.size());
+		vector<bool> emitted(triangleCount, false);
+		// Meshlet each vertex was last added to
+		vector<unsigned int> seenIn(vertexCount, ~0u);
+		vector<unsigned int> meshletVertices;
+		glm::vec3 normalSum(0.0f);
+		unsigned int first = 0, cursor = 0;
+
+		for (unsigned int done = 0; done < triangleCount; )
+		{
+			unsigned int id = meshlets.size();
+			int best = -1;
+			unsigned int bestExtra = 4;
+			float bestDot = -2.0f;
+			float normalLength = glm::length(normalSum);
+			glm::vec3 direction = normalLength > 0.0f ? normalSum / normalLength : normalSum;
+			for (unsigned int v = 0; v < meshletVertices.size(); v++)
+			{
+				unsigned int vertex = meshletVertices[v];
+				for (unsigned int t = offsets[vertex]; t < offsets[vertex + 1]; t++)
+				{
+					unsigned int triangle = adjacency[t];
+					if ( emitted[triangle] )
+						continue;
+
+					unsigned int extra = newVertices(&indices[triangle * 3], seenIn, id);
+					if ( meshletVertices.size() + extra > MAX_VERTICES )
+						continue;
+					float alignment = glm::dot(faceNormals[triangle], direction);
+					if ( extra < bestExtra || (extra == bestExtra && alignment > bestDot) )
+					{
+						best = triangle;
+						bestExtra = extra;
+						bestDot = alignment;
+					}
+				}
+			}
+
+			if ( best < 0 )
+			{
+				// Nothing connected fits, close the meshlet and seed the next one
+				if ( !meshletVertices.empty() )
+				{
+					meshlets.push_back(bounds(vertices, result, first, result.size() - first));
+					first = result.size();
+					meshletVertices.clear();
+					normalSum = glm::vec3(0.0f);
+					continue;
+				}
+				while ( emitted[cursor] )
+					cursor++;
+				best = cursor;
+			}
+
+			emitted[best] = true;
+			done++;
+			normalSum += faceNormals[best];
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				unsigned int vertex = indices[best * 3 + k];
+				result.push_back(vertex);
+				if ( seenIn[vertex] != id )
+				{
+					seenIn[vertex] = id;
+					meshletVertices.push_back(vertex);
+				}
+			}
+
+			if ( (result.size() - first) / 3 >= MAX_TRIANGLES )
+			{
+				meshlets.push_back(bounds(vertices, result, first, result.size() - first));
+				first = result.size();
+				meshletVertices.clear();
+				normalSum = glm::vec3(0.0f);
+			}
+		}
+		if ( first < result.size() )
+			meshlets.push_back(bounds(vertices, result, first, result.size() - first));
+
+		indices.swap(result);
+		return meshlets;
+	}
+
+	// True if no triangle of the meshlet can be seen: all of them face away from
+	// cameraPosition or the bounds are outside the frustum. Both in object space.
+	static bool IsCulled(const Meshlet &meshlet, const Frustum &frustum, const glm::vec3 &cameraPosition)
+	{
+		if ( !frustum.IntersectsSphere(meshlet.center, meshlet.radius) )
+			return true;
+
+		glm::vec3 toCenter = meshlet.center - cameraPosition;
+		return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+	}
+
+ private:
+	static glm::vec3 faceNormal(const vector<Vertex> &vertices, const unsigned int *triangle)
+	{
+		glm::vec3 a = vertices[triangle[0]].Position;
+		glm::vec3 normal = glm::cross(vertices[triangle[1]].Position - a, vertices[triangle[2]].Position - a);
+		float length = glm::length(normal);
+		return length > 0.0f ? normal / length : glm::vec3(0.0f);
+	}
+
+	// Vertices of the triangle not in meshlet id yet
+	static unsigned int newVertices(const unsigned int *triangle, const vector<unsigned int> &seenIn, unsigned int id)
+	{
+		unsigned int count = 0;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			bool repeated = (k > 0 && triangle[k] == triangle[0]) || (k > 1 && triangle[k] == triangle[1]);
+			if ( seenIn[triangle[k]] != id && !repeated )
+				count++;
+		}
+		return count;
+	}
+
+	static Meshlet bounds(const vector<Vertex> &vertices, const vector<unsigned int> &indices, unsigned int first, unsigned int count)
+	{
+		Meshlet meshlet;
+		meshlet.firstIndex = first;
+		meshlet.indexCount = count;
+
+		glm::vec3 boundsMin = vertices[indices[first]].Position;
+		glm::vec3 boundsMax = boundsMin;
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			boundsMin = glm::min(boundsMin, vertices[indices[i]].Position);
+			boundsMax = glm::max(boundsMax, vertices[indices[i]].Position);
+		}
+		meshlet.center = (boundsMin + boundsMax) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (unsigned int i = first; i < first + count; i++)
+			meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+
+		// Normal cone from the face normals, the vertex normals may be smoothed or missing
+		vector<glm::vec3> normals;
+		glm::vec3 axis(0.0f);
+		for (unsigned int i = first; i < first + count; i += 3)
+		{
+			glm::vec3 normal = faceNormal(vertices, &indices[i]);
+			if ( glm::dot(normal, normal) == 0.0f )
+				continue;
+			normals.push_back(normal);
+			axis += normal;
+		}
+
+		meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCutoff = 1.0f;
+		float axisLength = glm::length(axis);
+		if ( axisLength == 0.0f )
+			return meshlet;
+
+		axis /= axisLength;
+		float minDot = 1.0f;
+		for (unsigned int i = 0; i < normals.size(); i++)
+			minDot = std::min(minDot, glm::dot(axis, normals[i]));
+		// A cone wider than a hemisphere is never entirely back facing
+		if ( minDot <= 0.0f )
+			return meshlet;
+
+		meshlet.coneAxis = axis;
+		meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+		return meshlet;
+	}
+};
@@ -1,42 +1,563 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "obj_loader.h"
+#include "render_queue.h"
+#include "vfs_io_system.h"
 
 using namespace std;
 
+enum ModelLoadFlags
+{
+	MODEL_LOAD_DEFAULT = 0,
+	// Import on a background thread, GL objects are then created by Update() in slices
+	MODEL_LOAD_ASYNC = 1 << 0,
+	// Write imported vertices straight into mapped GL buffers and keep no CPU copy. Lowest
+	// peak memory, but streamed meshes skip finishMesh: triangles keep the importer's order
+	// (no MeshOptimizer pass), there are no LODs and no meshlets, and no mesh cache is
+	// written. Vertices stay float32 and every mesh keeps its own buffers instead of the
+	// arena. Mapping needs the GL thread, so this cannot be combined with MODEL_LOAD_ASYNC:
+	// the pair is rejected with an error and the model loads asynchronously without it.
+	MODEL_LOAD_STREAM_TO_GPU = 1 << 1,
+	// Import .obj files through Assimp instead of ObjLoader. Other formats always use Assimp,
+	// and so does an .obj that ObjLoader cannot read.
+	MODEL_LOAD_ASSIMP = 1 << 2
+};
+
 class Model
 {
  public:
-	Model(char *path)
+	// format selects how vertices are encoded on the GPU, see vertex_format.h. All meshes are
+	// suballocated from one MeshArena, pass sharedArena to share it between models (its format
+	// is used instead of format then, and the caller releases it).
+	Model(const char *path, unsigned int flags = MODEL_LOAD_DEFAULT, VertexFormat format = VertexFormat(), MeshArena *sharedArena = NULL)
+		: boundsMin(0.0f), boundsMax(0.0f), hasBounds(false), arena(sharedArena ? sharedArena : new MeshArena(format)), ownsArena(sharedArena == NULL), streamToGpu(false), useAssimp((flags & MODEL_LOAD_ASSIMP) != 0), sourceImporter(MESH_CACHE_IMPORTER_NATIVE), placeholderMin(0.0f), placeholderMax(0.0f), hasPlaceholder(false), imported(false), decodingTextures(0), uploadedMeshes(0), uploadedTextures(0), ready(false), boxVAO(0), boxVBO(0)
 	{
-		loadModel(path);
+		directory = string(path).substr(0, string(path).find_last_of('/'));
+
+		if ( flags & MODEL_LOAD_ASYNC )
+		{
+			if ( flags & MODEL_LOAD_STREAM_TO_GPU )
+				cout << "ERROR::MODEL::STREAM_TO_GPU_WITH_ASYNC::" << path << endl;
+			loader = thread(&Model::importOnLoader, this, string(path));
+			return;
+		}
+
+		streamToGpu = (flags & MODEL_LOAD_STREAM_TO_GPU) != 0;
+		importModel(path);
+		imported = true;
+		reserveArena();
+		for(unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].Upload(*arena);
+		loadTextures();
+		ready = true;
+		reportMemory();
+	}
+	~Model()
+	{
+		if ( loader.joinable() )
+			loader.join();
+		waitForDecodes();
+		if ( ownsArena )
+			delete arena;
+	}
+	// Draws the bounding box of the model with the given shader until it is ready
+	void Draw(Shader &shader)
+	{
+		if ( !ready )
+		{
+			drawPlaceholder();
+			return;
+		}
+
+		// One VAO bind and one uniform lookup for every mesh in the arena
+		arena->Bind();
+		VertexEncodingUniforms uniforms(shader);
+		for(unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].Draw(uniforms, false);
+		glBindVertexArray(0);
 	}
-	void Draw(Shader shader)
+	// Queues every mesh like Draw, or the bounding box until the model is ready
+	void Submit(RenderQueue &queue, RenderPass pass, Shader *shader, const glm::mat4 &model)
 	{
+		if ( !ready )
+		{
+			if ( boxVAO != 0 )
+				queue.Submit(pass, shader, model, boxVAO, GL_LINES, 0, 24);
+			return;
+		}
+
 		for(unsigned int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shader);
+			queue.Submit(pass, shader, model, &meshes[i]);
+	}
+	// Continues an asynchronous load, creating GL objects until budgetMilliseconds is spent.
+	// Call once per frame on the GL thread, it returns straight away once the model is ready.
+	// The placeholder box is created as soon as the loader knows the bounds, from the mesh
+	// cache or a quick pass over an .obj, long before the meshes are imported.
+	void Update(float budgetMilliseconds = 2.0f)
+	{
+		if ( ready )
+			return;
+		if ( boxVAO == 0 && hasPlaceholder )
+			createPlaceholder();
+		if ( !imported )
+			return;
+
+		if ( loader.joinable() )
+		{
+			loader.join();
+			reserveArena();
+			decodeTextures();
+		}
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		while ( !ready )
+		{
+			if ( uploadedMeshes < meshes.size() )
+			{
+				meshes[uploadedMeshes++].Upload(*arena);
+			}
+			else if ( decodingTextures > 0 )
+			{
+				// Still decoding on the pool, nothing to do until the next frame
+				break;
+			}
+			else if ( uploadedTextures < pendingImages.size() )
+			{
+				TextureImage &image = pendingImages[uploadedTextures];
+				if ( pendingResident[uploadedTextures] )
+					textures_loaded[uploadedTextures].id = TextureRegistry::Get().Acquire(image.filename);
+				else
+					textures_loaded[uploadedTextures].id = TextureRegistry::Get().AcquireDecoded(image.filename, image);
+				uploadedTextures++;
+			}
+			else
+			{
+				applyTextureIds();
+				vector<TextureImage>().swap(pendingImages);
+				vector<bool>().swap(pendingResident);
+				ready = true;
+				reportMemory();
+			}
+
+			float elapsed = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+			if ( elapsed >= budgetMilliseconds )
+				break;
+		}
+	}
+	bool IsReady() const
+	{
+		return ready;
+	}
+	// Chooses the level of detail of every mesh for the next Draw from how large the model
+	// appears on screen: the coarsest level whose simplification error stays below
+	// maxPixelError pixels. fovY in radians, viewportHeight in pixels.
+	void SelectLod(const glm::mat4 &model, const glm::vec3 &cameraPosition, float fovY, float viewportHeight, float maxPixelError = 1.0f)
+	{
+		float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		glm::vec3 center = glm::vec3(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+		float radius = glm::length(boundsMax - boundsMin) * 0.5f * scale;
+
+		// Distance to the nearest point of the bounding sphere, full detail from inside it
+		float distance = glm::length(center - cameraPosition) - radius;
+		float pixelsPerUnit = distance > 0.0f ? scale * viewportHeight / (2.0f * tanf(fovY * 0.5f) * distance) : 1e30f;
+		for(unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].SelectLod(pixelsPerUnit, maxPixelError);
+	}
+	// Culls the meshlets of every mesh against the view for the next Draws, needs back face
+	// culling to be enabled as back facing meshlets are dropped too
+	void Cull(const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &cameraPosition)
+	{
+		Frustum frustum = Frustum::FromMatrix(projection * view * model);
+		glm::vec3 localCamera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+		for(unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].CullMeshlets(frustum, localCamera);
+	}
+	unsigned int VisibleTriangleCount() const
+	{
+		unsigned int count = 0;
+		for(unsigned int i = 0; i < meshes.size(); i++)
+			count += meshes[i].VisibleTriangleCount();
+		return count;
+	}
+	// Totals over all meshes, only meaningful once the model is ready
+	MeshMemoryStats MemoryStats() const
+	{
+		MeshMemoryStats total = { 0, 0, 0 };
+		for(unsigned int i = 0; i < meshes.size(); i++)
+		{
+			MeshMemoryStats stats = meshes[i].MemoryStats();
+			total.vertexBytes += stats.vertexBytes;
+			total.indexBytes += stats.indexBytes;
+			total.indexBytes32 += stats.indexBytes32;
+		}
+		return total;
+	}
+	// Imports path and writes its mesh cache without touching GL, for tools/asset_cooker. The
+	// texture files the meshes use are added to textures. Only MODEL_LOAD_ASSIMP applies.
+	static bool WriteMeshCache(const string &path, unsigned int flags, vector<string> *textures)
+	{
+		Model model(flags & MODEL_LOAD_ASSIMP);
+		if ( !model.importSource(path) || !MeshCache::Write(path, model.meshes, model.requestedImporter(), model.sourceImporter) )
+			return false;
+
+		for(unsigned int i = 0; i < model.meshes.size(); i++)
+		{
+			for(unsigned int j = 0; j < model.meshes[i].textures.size(); j++)
+				textures->push_back(path.substr(0, path.find_last_of('/')) + '/' + model.meshes[i].textures[j].path);
+		}
+		sort(textures->begin(), textures->end());
+		textures->erase(unique(textures->begin(), textures->end()), textures->end());
+		return true;
+	}
+	// Hands the textures back to the registry, call while the GL context is still alive
+	void Unload()
+	{
+		if ( loader.joinable() )
+			loader.join();
+		waitForDecodes();
+
+		for(unsigned int i = 0; i < textures_loaded.size(); i++)
+		{
+			if ( textures_loaded[i].id != 0 )
+				TextureRegistry::Get().Release(textures_loaded[i].id);
+		}
+		textures_loaded.clear();
+
+		// Streamed meshes have their own buffers
+		for(unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].Release();
+		if ( ownsArena )
+			arena->Release();
+
+		if ( boxVAO != 0 )
+		{
+			glDeleteVertexArrays(1, &boxVAO);
+			glDeleteBuffers(1, &boxVBO);
+			boxVAO = boxVBO = 0;
+		}
 	}
  private:
 	vector<Mesh> meshes;
 	vector<Texture> textures_loaded;
 	string directory;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	bool hasBounds;
+	MeshArena *arena;
+	bool ownsArena;
+	bool streamToGpu;
+	bool useAssimp;
+	// The importer that produced meshes, Assimp also when ObjLoader failed
+	MeshCacheImporter sourceImporter;
+
+	// Asynchronous loading state. The loader thread owns everything above until imported is set.
+	// It sets the placeholder bounds once, before hasPlaceholder.
+	glm::vec3 placeholderMin;
+	glm::vec3 placeholderMax;
+	atomic<bool> hasPlaceholder;
+	thread loader;
+	atomic<bool> imported;
+	// One per texture of textures_loaded, decoded on the shared pool unless the registry
+	// already had the file when the import finished
+	vector<TextureImage> pendingImages;
+	vector<bool> pendingResident;
+	atomic<unsigned int> decodingTextures;
+	unsigned int uploadedMeshes;
+	unsigned int uploadedTextures;
+	bool ready;
+	unsigned int boxVAO, boxVBO;
+
+	// Importer only, see WriteMeshCache
+	explicit Model(unsigned int flags)
+		: boundsMin(0.0f), boundsMax(0.0f), hasBounds(false), arena(NULL), ownsArena(false), streamToGpu(false), useAssimp((flags & MODEL_LOAD_ASSIMP) != 0), sourceImporter(MESH_CACHE_IMPORTER_NATIVE), placeholderMin(0.0f), placeholderMax(0.0f), hasPlaceholder(false), imported(false), decodingTextures(0), uploadedMeshes(0), uploadedTextures(0), ready(false), boxVAO(0), boxVBO(0)
+	{
+	}
+
+	// Fills meshes without touching GL (unless streaming to the GPU), safe to run on any thread.
+	// With placeholder the bounds are published for Update as early as they are known.
+	void importModel(const string &path, bool placeholder = false)
+	{
+		ProfileScope profile("model " + path);
+		if ( !loadFromCache(path, placeholder) )
+		{
+			glm::vec3 objMin, objMax;
+			if ( placeholder && isObj(path) && ObjLoader::Bounds(path, &objMin, &objMax) )
+				publishPlaceholder(objMin, objMax);
+			if ( !importSource(path) )
+				return;
+			if ( !streamToGpu )
+				MeshCache::Write(path, meshes, requestedImporter(), sourceImporter);
+		}
+		computeBounds();
+		if ( placeholder && !hasPlaceholder && hasBounds )
+			publishPlaceholder(boundsMin, boundsMax);
+	}
+
+	MeshCacheImporter requestedImporter() const
+	{
+		return useAssimp ? MESH_CACHE_IMPORTER_ASSIMP : MESH_CACHE_IMPORTER_NATIVE;
+	}
+
+	static bool isObj(const string &path)
+	{
+		return path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0;
+	}
+
+	bool importSource(const string &path)
+	{
+		return (isObj(path) && !useAssimp && importObj(path)) || importAssimp(path);
+	}
 
-	void loadModel(string path)
+	bool importObj(const string &path)
+	{
+		vector<ObjMesh> objMeshes;
+		bool loaded;
+		if ( streamToGpu )
+		{
+			// The loader writes the vertices straight into the mapped buffers of the meshes
+			loaded = ObjLoader::Load(path, objMeshes, [&](unsigned int i, unsigned int vertexCount) {
+				meshes.push_back(Mesh(NULL, vertexCount, NULL, objMeshes[i].indices.size(), vector<Texture>()));
+				return meshes.back().MapVertices();
+			});
+			for(unsigned int i = 0; i < meshes.size(); i++)
+			{
+				if ( loaded && !objMeshes[i].indices.empty() )
+					memcpy(meshes[i].MapIndices(), objMeshes[i].indices.data(), objMeshes[i].indices.size() * sizeof(unsigned int));
+				meshes[i].Unmap();
+			}
+			// The buffers of the meshes created before the failure go before Assimp starts over
+			if ( !loaded )
+			{
+				for(unsigned int i = 0; i < meshes.size(); i++)
+					meshes[i].Release();
+				meshes.clear();
+			}
+		}
+		else
+		{
+			loaded = ObjLoader::Load(path, objMeshes);
+		}
+		if ( !loaded )
+		{
+			cout << "MODEL::OBJ_LOADER_FAILED::USING_ASSIMP::" << path << endl;
+			return false;
+		}
+		sourceImporter = MESH_CACHE_IMPORTER_NATIVE;
+
+		meshes.reserve(objMeshes.size());
+		for(unsigned int i = 0; i < objMeshes.size(); i++)
+		{
+			ObjMesh &objMesh = objMeshes[i];
+			vector<Texture> textures;
+			for(unsigned int j = 0; j < objMesh.diffuseMaps.size(); j++)
+				textures.push_back(loadTexture(objMesh.diffuseMaps[j], "texture_diffuse"));
+			for(unsigned int j = 0; j < objMesh.specularMaps.size(); j++)
+				textures.push_back(loadTexture(objMesh.specularMaps[j], "texture_specular"));
+
+			if ( streamToGpu )
+			{
+				meshes[i].textures = std::move(textures);
+				if ( !objMesh.indices.empty() )
+					growBounds(objMesh.boundsMin, objMesh.boundsMax);
+				continue;
+			}
+			meshes.push_back(finishMesh(objMesh.name, std::move(objMesh.vertices), std::move(objMesh.indices), std::move(textures)));
+		}
+		return true;
+	}
+
+	bool importAssimp(const string &path)
 	{
 		Assimp::Importer import;
-		const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+		// The .obj and the files it references come from the mounted archives too
+		import.SetIOHandler(new VfsIOSystem());
+		const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs);
 
 		if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 		{
 			cout << "ERROR::ASSIMP::" << import.GetErrorString() << endl;
-			return;
+			return false;
 		}
-		directory = path.substr(0, path.find_last_of('/'));
 
+		meshes.reserve(scene->mNumMeshes);
 		processNode(scene->mRootNode, scene);
+		sourceImporter = MESH_CACHE_IMPORTER_ASSIMP;
+		return true;
+	}
+
+	void importOnLoader(const string &path)
+	{
+		importModel(path, true);
+		imported = true;
+	}
+
+	void publishPlaceholder(const glm::vec3 &min, const glm::vec3 &max)
+	{
+		placeholderMin = min;
+		placeholderMax = max;
+		hasPlaceholder = true;
+	}
+
+	// On the GL thread once imported, the registry is not shared with the loader. Textures
+	// other models loaded meanwhile are only acquired, the rest decode on the pool while the
+	// meshes upload.
+	void decodeTextures()
+	{
+		vector<string> filenames = collectTextures();
+		pendingImages.resize(filenames.size());
+		pendingResident.resize(filenames.size());
+		for (unsigned int i = 0; i < filenames.size(); i++)
+		{
+			pendingImages[i].filename = filenames[i];
+			pendingResident[i] = TextureRegistry::Get().IsResident(filenames[i]);
+			if ( pendingResident[i] )
+				continue;
+
+			decodingTextures++;
+			string filename = filenames[i];
+			ThreadPool::Shared().Enqueue([this, i, filename]() {
+				pendingImages[i] = TextureLoader::Decode(filename);
+				decodingTextures--;
+			});
+		}
+	}
+
+	// The decode jobs write into pendingImages, they must be done before it goes away
+	void waitForDecodes()
+	{
+		while ( decodingTextures > 0 )
+			this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	// Sizes the arena for every mesh of the model so it is not regrown mesh by mesh
+	void reserveArena()
+	{
+		unsigned int vertexCount = 0, indexCount = 0;
+		for(unsigned int i = 0; i < meshes.size(); i++)
+		{
+			vertexCount += meshes[i].vertices.size();
+			indexCount += meshes[i].indices.size();
+			for(unsigned int j = 0; j < meshes[i].lods.size(); j++)
+				indexCount += meshes[i].lods[j].indices.size();
+		}
+		if ( vertexCount > 0 )
+			arena->Reserve(vertexCount, indexCount);
+	}
+
+	void reportMemory()
+	{
+		unsigned int shortMeshes = 0;
+		for(unsigned int i = 0; i < meshes.size(); i++)
+		{
+			if ( meshes[i].IndexType() == GL_UNSIGNED_SHORT )
+				shortMeshes++;
+		}
+
+		MeshMemoryStats stats = MemoryStats();
+		cout << "MODEL::MEMORY::" << directory << " vertices " << stats.vertexBytes / 1024 << " KB, indices "
+				 << stats.indexBytes / 1024 << " KB (" << stats.indexBytes32 / 1024 << " KB as 32 bit, "
+				 << shortMeshes << "/" << meshes.size() << " meshes 16 bit)" << endl;
+	}
+
+	// Adds the vertices kept on the CPU to the bounds, GPU only meshes grew them while importing
+	void computeBounds()
+	{
+		for(unsigned int i = 0; i < meshes.size(); i++)
+		{
+			for(unsigned int j = 0; j < meshes[i].vertices.size(); j++)
+				growBounds(meshes[i].vertices[j].Position, meshes[i].vertices[j].Position);
+		}
+	}
+
+	void growBounds(const glm::vec3 &min, const glm::vec3 &max)
+	{
+		boundsMin = hasBounds ? glm::min(boundsMin, min) : min;
+		boundsMax = hasBounds ? glm::max(boundsMax, max) : max;
+		hasBounds = true;
+	}
+
+	void createPlaceholder()
+	{
+		glm::vec3 a = placeholderMin;
+		glm::vec3 b = placeholderMax;
+		float lines[] = {
+			a.x, a.y, a.z,  b.x, a.y, a.z,   b.x, a.y, a.z,  b.x, a.y, b.z,
+			b.x, a.y, b.z,  a.x, a.y, b.z,   a.x, a.y, b.z,  a.x, a.y, a.z,
+			a.x, b.y, a.z,  b.x, b.y, a.z,   b.x, b.y, a.z,  b.x, b.y, b.z,
+			b.x, b.y, b.z,  a.x, b.y, b.z,   a.x, b.y, b.z,  a.x, b.y, a.z,
+			a.x, a.y, a.z,  a.x, b.y, a.z,   b.x, a.y, a.z,  b.x, b.y, a.z,
+			b.x, a.y, b.z,  b.x, b.y, b.z,   a.x, a.y, b.z,  a.x, b.y, b.z
+		};
+
+		glGenVertexArrays(1, &boxVAO);
+		glGenBuffers(1, &boxVBO);
+		glBindVertexArray(boxVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(lines), lines, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glBindVertexArray(0);
+	}
+
+	void drawPlaceholder()
+	{
+		if ( boxVAO == 0 )
+			return;
+
+		glBindVertexArray(boxVAO);
+		glDrawArrays(GL_LINES, 0, 24);
+		glBindVertexArray(0);
+	}
+
+	bool loadFromCache(const string &path, bool placeholder)
+	{
+		MeshCache cache;
+		if ( !cache.Open(path, requestedImporter()) )
+			return false;
+		sourceImporter = cache.Importer();
+		if ( placeholder && cache.MeshCount() > 0 )
+			publishPlaceholder(cache.BoundsMin(), cache.BoundsMax());
+
+		meshes.reserve(cache.MeshCount());
+		for(unsigned int i = 0; i < cache.MeshCount(); i++)
+		{
+			vector<Texture> textures;
+			for(unsigned int j = 0; j < cache.TextureCount(i); j++)
+				textures.push_back(loadTexture(cache.TexturePath(i, j), cache.TextureType(i, j)));
+
+			// Streaming uploads straight from the mapped cache file
+			if ( streamToGpu )
+			{
+				meshes.push_back(Mesh(cache.Vertices(i), cache.VertexCount(i), cache.Indices(i), cache.IndexCount(i), std::move(textures)));
+				for(unsigned int j = 0; j < cache.VertexCount(i); j++)
+					growBounds(cache.Vertices(i)[j].Position, cache.Vertices(i)[j].Position);
+				continue;
+			}
+
+			vector<Vertex> vertices(cache.Vertices(i), cache.Vertices(i) + cache.VertexCount(i));
+			vector<unsigned int> indices(cache.Indices(i), cache.Indices(i) + cache.IndexCount(i));
+			meshes.push_back(Mesh(std::move(vertices), std::move(indices), std::move(textures), false));
+
+			Mesh &mesh = meshes.back();
+			mesh.meshlets.assign(cache.Meshlets(i), cache.Meshlets(i) + cache.MeshletCount(i));
+			mesh.lods.resize(cache.LodCount(i));
+			for(unsigned int j = 0; j < cache.LodCount(i); j++)
+			{
+				mesh.lods[j].indices.assign(cache.LodIndices(i, j), cache.LodIndices(i, j) + cache.LodIndexCount(i, j));
+				mesh.lods[j].error = cache.LodError(i, j);
+			}
+		}
+		return true;
 	}
 	
 	void processNode(aiNode *node, const aiScene *scene)
@@ -55,10 +576,63 @@ class Model
 	
 	Mesh processMesh(aiMesh *mesh, const aiScene *scene)
 	{
-		vector<Vertex> vertices;
-		vector<unsigned int> indices;
 		vector<Texture> textures;
+		if(mesh->mMaterialIndex >= 0)
+		{
+			aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+			
+			vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+			textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+
+			vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+			textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+		}
+
+		unsigned int indexCount = 0;
+		for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+			indexCount += mesh->mFaces[i].mNumIndices;
+
+		if ( streamToGpu )
+		{
+			Mesh result(NULL, mesh->mNumVertices, NULL, indexCount, std::move(textures));
+			for(unsigned int i = 0; i < mesh->mNumVertices; i++)
+			{
+				glm::vec3 position(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+				growBounds(position, position);
+			}
+			writeVertices(mesh, result.MapVertices());
+			writeIndices(mesh, result.MapIndices());
+			result.Unmap();
+			return result;
+		}
+
+		vector<Vertex> vertices(mesh->mNumVertices);
+		vector<unsigned int> indices(indexCount);
+		writeVertices(mesh, vertices.data());
+		writeIndices(mesh, indices.data());
+		return finishMesh(mesh->mName.C_Str(), std::move(vertices), std::move(indices), std::move(textures));
+	}
 
+	// Optimizes the triangle order and builds meshlets and LODs, the same for every importer
+	Mesh finishMesh(const string &name, vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	{
+		// The meshlets fix the triangle order, so they are built as part of the optimization
+		unsigned int vertexCount = vertices.size();
+		VertexCacheStats before, after;
+		vector<Meshlet> meshlets;
+		MeshOptimizer::Optimize(vertices, indices, &meshlets, &before, &after);
+		cout << "MESH::OPTIMIZE::" << name << " vertices " << vertexCount << " -> " << vertices.size()
+				 << ", ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << endl;
+
+		vector<MeshLod> lods = MeshSimplifier::BuildLodChain(vertices, indices);
+		Mesh result(std::move(vertices), std::move(indices), std::move(textures), false);
+		result.meshlets = std::move(meshlets);
+		result.lods = std::move(lods);
+		return result;
+	}
+
+	void writeVertices(aiMesh *mesh, Vertex *vertices)
+	{
 		for(unsigned int i = 0; i < mesh->mNumVertices; i++)
 		{
 			Vertex vertex;
@@ -70,7 +644,7 @@ class Model
 			vertex.Position = vector;
 
 			vector.x = mesh->mNormals[i].x;
-			vector.z = mesh->mNormals[i].y;
+			vector.y = mesh->mNormals[i].y;
 			vector.z = mesh->mNormals[i].z;
 			vertex.Normal = vector;
 
@@ -87,27 +661,18 @@ class Model
 				vertex.TexCoords = glm::vec2(0.0f, 0.0f);
 			}
 
-			vertices.push_back(vertex);
+			vertices[i] = vertex;
 		}
+	}
 
+	void writeIndices(aiMesh *mesh, unsigned int *indices)
+	{
 		for(unsigned int i = 0; i < mesh->mNumFaces; i++)
 		{
-			aiFace face = mesh->mFaces[i];
+			const aiFace &face = mesh->mFaces[i];
 			for(unsigned int j = 0; j < face.mNumIndices; j++)
-				indices.push_back(face.mIndices[j]);
-		}
-
-		if(mesh->mMaterialIndex >= 0)
-		{
-			aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-			
-			vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-			textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-
-			vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-			textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+				*indices++ = face.mIndices[j];
 		}
-		return Mesh(vertices, indices, textures);
 	}
 	
 	vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
@@ -117,29 +682,70 @@ class Model
 		{
 			aiString str;
 			mat->GetTexture(type, i, &str);
+			textures.push_back(loadTexture(str.C_Str(), typeName));
+		}
 
-			bool skip = false;
-			for (unsigned int j = 0; j < textures_loaded.size(); j++)
-			{
-				if ( std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-				{
-					textures.push_back(textures_loaded[j]);
-					skip = true;
-					break;
-				}
-			}
-			if ( !skip )
+		return textures;
+	}
+
+	// Only records the reference, the image is loaded once all meshes are known
+	Texture loadTexture(const string &path, const string &typeName)
+	{
+		Texture texture;
+		texture.id = 0;
+		texture.type = typeName;
+		texture.path = path;
+		return texture;
+	}
+
+	// Acquires every texture referenced by the meshes from the registry in one batch (misses
+	// are decoded in parallel) and patches the ids back into the meshes
+	void loadTextures()
+	{
+		vector<string> filenames = collectTextures();
+		vector<unsigned int> ids = TextureRegistry::Get().AcquireBatch(filenames);
+		for (unsigned int i = 0; i < ids.size(); i++)
+			textures_loaded[i].id = ids[i];
+
+		applyTextureIds();
+	}
+
+	// Lists every distinct texture of the model once in textures_loaded, returns their files
+	vector<string> collectTextures()
+	{
+		vector<string> filenames;
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			for (unsigned int j = 0; j < meshes[i].textures.size(); j++)
 			{
-				Texture texture;
+				if ( findLoadedTexture(meshes[i].textures[j].path) )
+					continue;
 
-				texture.id = Shader::LoadTextureFromFile(str.C_Str(), directory);
-				texture.type = typeName;
-				texture.path = str.C_Str();
-				textures.push_back(texture);
+				Texture texture = meshes[i].textures[j];
+				textures_loaded.push_back(texture);
+				filenames.push_back(directory + '/' + texture.path);
 			}
 		}
+		return filenames;
+	}
 
-		return textures;
+	void applyTextureIds()
+	{
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			for (unsigned int j = 0; j < meshes[i].textures.size(); j++)
+				meshes[i].textures[j].id = findLoadedTexture(meshes[i].textures[j].path)->id;
+		}
+	}
+
+	Texture *findLoadedTexture(const string &path)
+	{
+		for (unsigned int j = 0; j < textures_loaded.size(); j++)
+		{
+			if ( std::strcmp(textures_loaded[j].path.data(), path.c_str()) == 0)
+				return &textures_loaded[j];
+		}
+		return NULL;
 	}
 	
 };
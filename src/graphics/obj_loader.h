@@ -0,0 +1,683 @@
+#pragma once
+
+#include <map>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cfloat>
+#include <sstream>
+#include <iostream>
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include "../core/thread_pool.h"
+#include "../core/vfs.h"
+#include "vertex_format.h"
+
+using namespace std;
+
+// One mesh as Model::processMesh builds it from Assimp: triangles, vertices shared by
+// corners with the same position/texcoord/normal, texcoords flipped vertically. Texture
+// paths are relative to the .obj.
+struct ObjMesh
+{
+	string name;
+	// Empty when Load wrote them to a target instead
+	vector<Vertex> vertices;
+	vector<unsigned int> indices;
+	// Bounds of the vertex positions
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	vector<string> diffuseMaps;
+	vector<string> specularMaps;
+};
+
+// Reads .obj/.mtl files straight into ObjMesh, several times faster than Assimp for the
+// subset the game's assets use: v/vt/vn, polygon faces (fan triangulated), o/g, usemtl and
+// mtllib with map_Kd/map_Ks. Meshes split like Assimp's: one per object, and a new one
+// whenever the material changes inside it.
+//
+// The file is parsed in chunks of whole lines on the shared thread pool. A first pass counts
+// the v/vt/vn lines of every chunk so each chunk knows the global index of its first
+// vertex, then the chunks are parsed into shared arrays and finally every mesh remaps its
+// corners to vertices in parallel.
+class ObjLoader
+{
+ public:
+	// false if the file cannot be read or uses something the parser does not know, so the
+	// caller can fall back to Assimp
+	static bool Load(const string &path, vector<ObjMesh> &meshes)
+	{
+		return Load(path, meshes, [&meshes](unsigned int mesh, unsigned int vertexCount) {
+			meshes[mesh].vertices.resize(vertexCount);
+			return meshes[mesh].vertices.data();
+		});
+	}
+
+	// Like Load, but the vertices of mesh i go straight to the memory vertexTarget(i, count)
+	// returns, e.g. a mapped GPU buffer, and mesh.vertices stays empty. vertexTarget is called
+	// on the calling thread once every mesh has its indices, a NULL target fails the load.
+	static bool Load(const string &path, vector<ObjMesh> &meshes, const function<Vertex *(unsigned int, unsigned int)> &vertexTarget)
+	{
+		meshes.clear();
+		VfsFile file;
+		if ( !Vfs::Get().Open(path, file) || file.Size() == 0 )
+			return false;
+
+		string tail;
+		vector<Chunk> chunks = splitFile(file, tail);
+
+		ThreadPool &pool = ThreadPool::Shared();
+		pool.ParallelFor(chunks.size(), [&](unsigned int i) {
+			countLines(chunks[i]);
+		});
+
+		Geometry geometry;
+		geometry.positionCount = geometry.texCoordCount = geometry.normalCount = 0;
+		for (unsigned int i = 0; i < chunks.size(); i++)
+		{
+			chunks[i].firstPosition = geometry.positionCount;
+			chunks[i].firstTexCoord = geometry.texCoordCount;
+			chunks[i].firstNormal = geometry.normalCount;
+			geometry.positionCount += chunks[i].positionCount;
+			geometry.texCoordCount += chunks[i].texCoordCount;
+			geometry.normalCount += chunks[i].normalCount;
+		}
+		geometry.positions.resize(geometry.positionCount);
+		geometry.texCoords.resize(geometry.texCoordCount);
+		geometry.normals.resize(geometry.normalCount);
+
+		pool.ParallelFor(chunks.size(), [&](unsigned int i) {
+			parseChunk(chunks[i], geometry);
+		});
+		for (unsigned int i = 0; i < chunks.size(); i++)
+		{
+			if ( !chunks[i].valid )
+			{
+				cout << "ERROR::OBJ::UNSUPPORTED_FACE::" << path << endl;
+				return false;
+			}
+		}
+
+		vector<Part> parts = collectParts(chunks);
+		map<string, Material> materials = loadMaterials(path, chunks);
+
+		meshes.resize(parts.size());
+		vector<vector<Corner> > unique(parts.size());
+		vector<char> built(parts.size());
+		pool.ParallelFor(parts.size(), [&](unsigned int i) {
+			built[i] = buildMesh(parts[i], chunks, geometry, meshes[i], unique[i]);
+		});
+		for (unsigned int i = 0; i < parts.size(); i++)
+		{
+			if ( !built[i] )
+			{
+				cout << "ERROR::OBJ::INDEX_OUT_OF_RANGE::" << path << endl;
+				meshes.clear();
+				return false;
+			}
+		}
+
+		vector<Vertex *> targets(parts.size());
+		for (unsigned int i = 0; i < parts.size(); i++)
+		{
+			targets[i] = vertexTarget(i, unique[i].size());
+			if ( !targets[i] && !unique[i].empty() )
+			{
+				cout << "ERROR::OBJ::NO_VERTEX_TARGET::" << path << endl;
+				meshes.clear();
+				return false;
+			}
+		}
+		pool.ParallelFor(parts.size(), [&](unsigned int i) {
+			writeVertices(unique[i], geometry, targets[i], meshes[i]);
+		});
+
+		for (unsigned int i = 0; i < parts.size(); i++)
+		{
+			map<string, Material>::const_iterator material = materials.find(parts[i].material);
+			if ( material != materials.end() )
+			{
+				meshes[i].diffuseMaps = material->second.diffuseMaps;
+				meshes[i].specularMaps = material->second.specularMaps;
+			}
+		}
+		return !meshes.empty();
+	}
+
+	// The .mtl files path uses, relative to the working directory like path itself
+	static vector<string> MaterialLibraries(const string &path)
+	{
+		vector<string> libraries;
+		string text;
+		if ( !Vfs::Get().ReadText(path, text) )
+			return libraries;
+		text += '\n';
+
+		string directory = path.substr(0, path.find_last_of('/') + 1);
+		const char *end = text.c_str() + text.size();
+		for (const char *p = text.c_str(); p < end; p = nextLine(p, end))
+		{
+			p = skipBlanks(p);
+			if ( strncmp(p, "mtllib", 6) == 0 )
+				libraries.push_back(directory + restOfLine(p + 6));
+		}
+		return libraries;
+	}
+
+	// Bounds of the v lines alone, a fraction of the work of Load, e.g. for a placeholder
+	// while the model loads. False if the file cannot be read or has no vertex.
+	static bool Bounds(const string &path, glm::vec3 *boundsMin, glm::vec3 *boundsMax)
+	{
+		VfsFile file;
+		if ( !Vfs::Get().Open(path, file) || file.Size() == 0 )
+			return false;
+
+		string tail;
+		vector<Chunk> chunks = splitFile(file, tail);
+		vector<glm::vec3> mins(chunks.size(), glm::vec3(FLT_MAX)), maxs(chunks.size(), glm::vec3(-FLT_MAX));
+		ThreadPool::Shared().ParallelFor(chunks.size(), [&](unsigned int i) {
+			for (const char *p = chunks[i].begin; p < chunks[i].end; p = nextLine(p, chunks[i].end))
+			{
+				p = skipBlanks(p);
+				if ( p[0] != 'v' || (p[1] != ' ' && p[1] != '\t') )
+					continue;
+				glm::vec3 v;
+				p = parseFloat(parseFloat(parseFloat(p + 1, &v.x), &v.y), &v.z);
+				mins[i] = glm::min(mins[i], v);
+				maxs[i] = glm::max(maxs[i], v);
+			}
+		});
+
+		*boundsMin = glm::vec3(FLT_MAX);
+		*boundsMax = glm::vec3(-FLT_MAX);
+		for (unsigned int i = 0; i < chunks.size(); i++)
+		{
+			*boundsMin = glm::min(*boundsMin, mins[i]);
+			*boundsMax = glm::max(*boundsMax, maxs[i]);
+		}
+		return boundsMin->x <= boundsMax->x;
+	}
+
+ private:
+	static const unsigned int CHUNK_SIZE = 256 * 1024;
+	// Corner without texcoord or normal
+	static const int MISSING = -1;
+
+	struct Corner
+	{
+		int position;
+		int texCoord;
+		int normal;
+	};
+
+	enum EventType
+	{
+		EVENT_OBJECT,
+		EVENT_MATERIAL,
+		EVENT_MATERIAL_LIBRARY
+	};
+
+	// o/g, usemtl and mtllib lines, with the number of corners read before them
+	struct Event
+	{
+		EventType type;
+		unsigned int corner;
+		string name;
+	};
+
+	struct Chunk
+	{
+		const char *begin;
+		const char *end;
+		unsigned int positionCount, texCoordCount, normalCount;
+		unsigned int firstPosition, firstTexCoord, firstNormal;
+		// Three per triangle, indices already global and 0 based
+		vector<Corner> corners;
+		vector<Event> events;
+		bool valid;
+
+		Chunk(const char *begin, const char *end)
+			: begin(begin), end(end), positionCount(0), texCoordCount(0), normalCount(0), firstPosition(0), firstTexCoord(0), firstNormal(0), valid(true)
+		{
+		}
+	};
+
+	struct Geometry
+	{
+		vector<glm::vec3> positions;
+		vector<glm::vec2> texCoords;
+		vector<glm::vec3> normals;
+		unsigned int positionCount, texCoordCount, normalCount;
+	};
+
+	// Corners [begin, end) of one chunk
+	struct Range
+	{
+		unsigned int chunk;
+		unsigned int begin;
+		unsigned int end;
+	};
+
+	// The corners of one future mesh, spread over chunks
+	struct Part
+	{
+		string name;
+		string material;
+		vector<Range> ranges;
+		unsigned int cornerCount;
+	};
+
+	struct Material
+	{
+		vector<string> diffuseMaps;
+		vector<string> specularMaps;
+	};
+
+	// Chunks of about CHUNK_SIZE ending on a line end, end[-1] must be '\n'
+	static vector<Chunk> split(const char *data, const char *end)
+	{
+		vector<Chunk> chunks;
+		const char *begin = data;
+		while ( begin < end )
+		{
+			const char *chunkEnd = (size_t)(end - begin) > CHUNK_SIZE ? begin + CHUNK_SIZE : end;
+			chunkEnd = (const char *)memchr(chunkEnd - 1, '\n', end - chunkEnd + 1) + 1;
+			chunks.push_back(Chunk(begin, chunkEnd));
+			begin = chunkEnd;
+		}
+		return chunks;
+	}
+
+	// Chunks of the whole file. Lines are parsed up to their '\n', a last line without one is
+	// parsed from a copy kept in tail.
+	static vector<Chunk> splitFile(const VfsFile &file, string &tail)
+	{
+		const char *data = (const char *)file.Data();
+		const char *end = data + file.Size();
+		if ( end[-1] != '\n' )
+		{
+			const char *lastLine = end;
+			while ( lastLine > data && lastLine[-1] != '\n' )
+				lastLine--;
+			tail.assign(lastLine, end);
+			tail += '\n';
+			end = lastLine;
+		}
+
+		vector<Chunk> chunks = split(data, end);
+		if ( !tail.empty() )
+			chunks.push_back(Chunk(tail.data(), tail.data() + tail.size()));
+		return chunks;
+	}
+
+	static const char *nextLine(const char *p, const char *end)
+	{
+		return (const char *)memchr(p, '\n', end - p) + 1;
+	}
+
+	static void countLines(Chunk &chunk)
+	{
+		for (const char *p = chunk.begin; p < chunk.end; p = nextLine(p, chunk.end))
+		{
+			// Must agree with parseChunk on every line, the arrays are sized from this
+			p = skipBlanks(p);
+			if ( p[0] != 'v' )
+				continue;
+			chunk.positionCount += p[1] == ' ' || p[1] == '\t';
+			chunk.texCoordCount += p[1] == 't';
+			chunk.normalCount += p[1] == 'n';
+		}
+	}
+
+	static void parseChunk(Chunk &chunk, Geometry &geometry)
+	{
+		unsigned int position = chunk.firstPosition, texCoord = chunk.firstTexCoord, normal = chunk.firstNormal;
+		for (const char *p = chunk.begin; p < chunk.end && chunk.valid; p = nextLine(p, chunk.end))
+		{
+			p = skipBlanks(p);
+			if ( p[0] == 'v' && (p[1] == ' ' || p[1] == '\t') )
+			{
+				glm::vec3 &v = geometry.positions[position++];
+				p = parseFloat(parseFloat(parseFloat(p + 1, &v.x), &v.y), &v.z);
+			}
+			else if ( p[0] == 'v' && p[1] == 't' )
+			{
+				// A third texture coordinate, if any, is ignored like Assimp does for 2D maps
+				glm::vec2 &vt = geometry.texCoords[texCoord++];
+				p = parseFloat(parseFloat(p + 2, &vt.x), &vt.y);
+			}
+			else if ( p[0] == 'v' && p[1] == 'n' )
+			{
+				glm::vec3 &vn = geometry.normals[normal++];
+				p = parseFloat(parseFloat(parseFloat(p + 2, &vn.x), &vn.y), &vn.z);
+			}
+			else if ( p[0] == 'f' && (p[1] == ' ' || p[1] == '\t') )
+				chunk.valid = parseFace(p + 1, position, texCoord, normal, chunk.corners);
+			else if ( (p[0] == 'o' || p[0] == 'g') && (p[1] == ' ' || p[1] == '\t') )
+				addEvent(chunk, EVENT_OBJECT, p + 1);
+			else if ( strncmp(p, "usemtl", 6) == 0 )
+				addEvent(chunk, EVENT_MATERIAL, p + 6);
+			else if ( strncmp(p, "mtllib", 6) == 0 )
+				addEvent(chunk, EVENT_MATERIAL_LIBRARY, p + 6);
+		}
+	}
+
+	// f v v/vt v//vn v/vt/vn ..., resolved against the vertex counts read so far and fan
+	// triangulated into corners
+	static bool parseFace(const char *p, int positionCount, int texCoordCount, int normalCount, vector<Corner> &corners)
+	{
+		Corner first = Corner(), previous = Corner();
+		unsigned int count = 0;
+		for (;;)
+		{
+			p = skipBlanks(p);
+			if ( *p == '\n' || *p == '#' )
+				break;
+
+			Corner corner;
+			int value;
+			if ( !parseIndex(p, &value) || !resolve(value, positionCount, &corner.position) )
+				return false;
+			corner.texCoord = corner.normal = MISSING;
+			if ( *p == '/' )
+			{
+				p++;
+				if ( *p != '/' )
+				{
+					if ( !parseIndex(p, &value) || !resolve(value, texCoordCount, &corner.texCoord) )
+						return false;
+				}
+				if ( *p == '/' )
+				{
+					p++;
+					if ( !parseIndex(p, &value) || !resolve(value, normalCount, &corner.normal) )
+						return false;
+				}
+			}
+
+			if ( count >= 2 )
+			{
+				corners.push_back(first);
+				corners.push_back(previous);
+				corners.push_back(corner);
+			}
+			else if ( count == 0 )
+				first = corner;
+			previous = corner;
+			count++;
+		}
+		return count >= 3;
+	}
+
+	// OBJ indices start at 1, negative ones count back from the last vertex read. False for a
+	// negative index reaching before the first vertex, which would otherwise read as MISSING.
+	static bool resolve(int index, int count, int *resolved)
+	{
+		*resolved = index > 0 ? index - 1 : count + index;
+		return *resolved >= 0;
+	}
+
+	static bool parseIndex(const char *&p, int *value)
+	{
+		bool negative = *p == '-';
+		p += negative;
+		if ( (unsigned char)(*p - '0') > 9 )
+			return false;
+
+		int result = 0;
+		for (; (unsigned char)(*p - '0') <= 9; p++)
+			result = result * 10 + (*p - '0');
+		*value = negative ? -result : result;
+		return result != 0;
+	}
+
+	// Decimal float with optional sign, fraction and exponent. Up to 17 significant digits are
+	// kept and scaled by an exact power of ten, rounding the same as strtod for the numbers
+	// exporters write.
+	static const char *parseFloat(const char *p, float *value)
+	{
+		static const double powers[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		p = skipBlanks(p);
+		bool negative = *p == '-';
+		p += (*p == '-' || *p == '+');
+
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		for (; (unsigned char)(*p - '0') <= 9; p++)
+		{
+			if ( mantissa < 10000000000000000ULL )
+				mantissa = mantissa * 10 + (*p - '0');
+			else
+				exponent++;
+		}
+		if ( *p == '.' )
+		{
+			for (p++; (unsigned char)(*p - '0') <= 9; p++)
+			{
+				if ( mantissa < 10000000000000000ULL )
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					exponent--;
+				}
+			}
+		}
+		if ( *p == 'e' || *p == 'E' )
+		{
+			p++;
+			bool negativeExponent = *p == '-';
+			p += (*p == '-' || *p == '+');
+			int written = 0;
+			for (; (unsigned char)(*p - '0') <= 9; p++)
+				written = written < 10000 ? written * 10 + (*p - '0') : written;
+			exponent += negativeExponent ? -written : written;
+		}
+
+		double result = (double)mantissa;
+		for (; exponent > 22; exponent -= 22)
+			result *= powers[22];
+		for (; exponent < -22; exponent += 22)
+			result /= powers[22];
+		result = exponent >= 0 ? result * powers[exponent] : result / powers[-exponent];
+		*value = (float)(negative ? -result : result);
+		return p;
+	}
+
+	static const char *skipBlanks(const char *p)
+	{
+		while ( *p == ' ' || *p == '\t' || *p == '\r' )
+			p++;
+		return p;
+	}
+
+	static string restOfLine(const char *p)
+	{
+		p = skipBlanks(p);
+		const char *end = p;
+		while ( *end != '\n' && *end != '#' )
+			end++;
+		while ( end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r') )
+			end--;
+		return string(p, end);
+	}
+
+	static void addEvent(Chunk &chunk, EventType type, const char *p)
+	{
+		Event event;
+		event.type = type;
+		event.corner = chunk.corners.size();
+		event.name = restOfLine(p);
+		chunk.events.push_back(event);
+	}
+
+	// Walks the events of all chunks in file order: a new part starts at the first face after
+	// an o/g line, or after a usemtl that changes the material
+	static vector<Part> collectParts(const vector<Chunk> &chunks)
+	{
+		vector<Part> parts;
+		string object, material;
+		bool startPart = true;
+		for (unsigned int i = 0; i < chunks.size(); i++)
+		{
+			const Chunk &chunk = chunks[i];
+			unsigned int corner = 0;
+			for (unsigned int j = 0; j <= chunk.events.size(); j++)
+			{
+				unsigned int eventCorner = j < chunk.events.size() ? chunk.events[j].corner : chunk.corners.size();
+				if ( eventCorner > corner )
+				{
+					if ( startPart )
+					{
+						Part part;
+						part.name = object;
+						part.material = material;
+						part.cornerCount = 0;
+						parts.push_back(part);
+						startPart = false;
+					}
+					Range range = { i, corner, eventCorner };
+					parts.back().ranges.push_back(range);
+					parts.back().cornerCount += eventCorner - corner;
+					corner = eventCorner;
+				}
+				if ( j == chunk.events.size() )
+					break;
+
+				const Event &event = chunk.events[j];
+				if ( event.type == EVENT_OBJECT )
+				{
+					object = event.name;
+					startPart = true;
+				}
+				else if ( event.type == EVENT_MATERIAL && event.name != material )
+				{
+					material = event.name;
+					startPart = true;
+				}
+			}
+		}
+		return parts;
+	}
+
+	// Indices of the part into unique, which gets each distinct position/texcoord/normal triple
+	// once, through an open addressing table sized for the worst case of no sharing at all
+	static bool buildMesh(const Part &part, const vector<Chunk> &chunks, const Geometry &geometry, ObjMesh &mesh, vector<Corner> &unique)
+	{
+		mesh.name = part.name;
+		mesh.indices.resize(part.cornerCount);
+		unique.reserve(part.cornerCount / 4);
+
+		unsigned int capacity = 16;
+		while ( capacity < part.cornerCount * 2 )
+			capacity *= 2;
+		vector<Corner> keys(capacity);
+		vector<unsigned int> values(capacity);
+		for (unsigned int i = 0; i < capacity; i++)
+			keys[i].position = MISSING;
+
+		unsigned int index = 0;
+		for (unsigned int r = 0; r < part.ranges.size(); r++)
+		{
+			const Range &range = part.ranges[r];
+			const vector<Corner> &corners = chunks[range.chunk].corners;
+			for (unsigned int i = range.begin; i < range.end; i++)
+			{
+				const Corner &corner = corners[i];
+				if ( (unsigned int)corner.position >= geometry.positionCount
+						 || (corner.texCoord != MISSING && (unsigned int)corner.texCoord >= geometry.texCoordCount)
+						 || (corner.normal != MISSING && (unsigned int)corner.normal >= geometry.normalCount) )
+					return false;
+
+				uint32_t hash = (uint32_t)corner.position * 73856093u ^ (uint32_t)corner.texCoord * 19349663u ^ (uint32_t)corner.normal * 83492791u;
+				unsigned int slot = hash & (capacity - 1);
+				while ( keys[slot].position != MISSING
+								&& (keys[slot].position != corner.position || keys[slot].texCoord != corner.texCoord || keys[slot].normal != corner.normal) )
+					slot = (slot + 1) & (capacity - 1);
+
+				if ( keys[slot].position == MISSING )
+				{
+					keys[slot] = corner;
+					values[slot] = unique.size();
+					unique.push_back(corner);
+				}
+				mesh.indices[index++] = values[slot];
+			}
+		}
+		return true;
+	}
+
+	// The vertices of unique to target, the position bounds to mesh
+	static void writeVertices(const vector<Corner> &unique, const Geometry &geometry, Vertex *target, ObjMesh &mesh)
+	{
+		mesh.boundsMin = mesh.boundsMax = glm::vec3(0.0f);
+		for (unsigned int i = 0; i < unique.size(); i++)
+		{
+			const Corner &corner = unique[i];
+			Vertex vertex;
+			vertex.Position = geometry.positions[corner.position];
+			vertex.Normal = corner.normal != MISSING ? geometry.normals[corner.normal] : glm::vec3(0.0f);
+			// Same as aiProcess_FlipUVs
+			vertex.TexCoords = corner.texCoord != MISSING ? glm::vec2(geometry.texCoords[corner.texCoord].x, 1.0f - geometry.texCoords[corner.texCoord].y) : glm::vec2(0.0f);
+			target[i] = vertex;
+
+			mesh.boundsMin = i == 0 ? vertex.Position : glm::min(mesh.boundsMin, vertex.Position);
+			mesh.boundsMax = i == 0 ? vertex.Position : glm::max(mesh.boundsMax, vertex.Position);
+		}
+	}
+
+	// Every mtllib of the file, relative to it. A missing library only costs the textures.
+	static map<string, Material> loadMaterials(const string &path, const vector<Chunk> &chunks)
+	{
+		map<string, Material> materials;
+		string directory = path.substr(0, path.find_last_of('/') + 1);
+		for (unsigned int i = 0; i < chunks.size(); i++)
+		{
+			for (unsigned int j = 0; j < chunks[i].events.size(); j++)
+			{
+				if ( chunks[i].events[j].type != EVENT_MATERIAL_LIBRARY )
+					continue;
+
+				string text;
+				if ( !Vfs::Get().ReadText(directory + chunks[i].events[j].name, text) )
+				{
+					cout << "ERROR::OBJ::MATERIAL_LIBRARY_NOT_FOUND::" << directory + chunks[i].events[j].name << endl;
+					continue;
+				}
+				parseMaterials(text, materials);
+			}
+		}
+		return materials;
+	}
+
+	static void parseMaterials(const string &text, map<string, Material> &materials)
+	{
+		istringstream lines(text);
+		string line;
+		Material *material = NULL;
+		while ( getline(lines, line) )
+		{
+			line += '\n';
+			const char *p = skipBlanks(line.c_str());
+			if ( strncmp(p, "newmtl", 6) == 0 )
+				material = &materials[restOfLine(p + 6)];
+			else if ( material && strncmp(p, "map_Kd", 6) == 0 )
+				material->diffuseMaps.push_back(texturePath(p + 6));
+			else if ( material && strncmp(p, "map_Ks", 6) == 0 )
+				material->specularMaps.push_back(texturePath(p + 6));
+		}
+	}
+
+	// The file of a map_ line, options such as -bm 1.0 before it are skipped
+	static string texturePath(const char *p)
+	{
+		string value = restOfLine(p);
+		if ( value.empty() || value[0] != '-' )
+			return value;
+		size_t last = value.find_last_of(" \t");
+		return last == string::npos ? value : value.substr(last + 1);
+	}
+};
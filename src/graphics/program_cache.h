@@ -0,0 +1,193 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+#include <stdint.h>
+#include "../core/hash.h"
+#include "../core/mapped_file.h"
+#include "../core/startup_profiler.h"
+
+using namespace std;
+
+// GL 4.1 / ARB_get_program_binary, not part of the GL 3.3 the game is loaded for
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// One linked program as the driver returned it, written to shader_cache/<key>.bin
+const uint32_t PROGRAM_CACHE_MAGIC = 0x47525043; // "CPRG"
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t binaryFormat;
+	uint32_t binaryLength;
+};
+
+// Persistent cache of linked program binaries, so warm starts skip compiling and linking.
+// Keys hash the final source text together with the driver's vendor, renderer and version
+// strings; a binary the driver rejects anyway (e.g. after an update that kept the strings)
+// is deleted and the caller compiles from source. Disabled until Init finds driver support.
+class ProgramCache
+{
+ public:
+	static ProgramCache &Get()
+	{
+		static ProgramCache cache;
+		return cache;
+	}
+
+	// Call once on the GL thread after the context is current, with the loader given to glad
+	void Init(GLADloadproc load, const string &cacheDirectory = "shader_cache")
+	{
+		getProgramBinary = (GetProgramBinaryProc)load("glGetProgramBinary");
+		programBinary = (ProgramBinaryProc)load("glProgramBinary");
+		programParameteri = (ProgramParameteriProc)load("glProgramParameteri");
+
+		GLint formats = 0;
+		if ( getProgramBinary && programBinary && programParameteri )
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		enabled = formats > 0;
+		if ( !enabled )
+			return;
+
+		directory = cacheDirectory;
+		mkdir(directory.c_str(), 0755);
+
+		driverHash = HASH_SEED;
+		GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			const char *value = (const char *)glGetString(names[i]);
+			driverHash = HashString(value ? value : "", driverHash);
+		}
+	}
+
+	bool IsEnabled() const { return enabled; }
+
+	uint64_t Key(const string &vertexSource, const string &fragmentSource) const
+	{
+		uint64_t key = HashString(vertexSource, driverHash);
+		// The length keeps "ab" + "c" apart from "a" + "bc"
+		uint64_t length = vertexSource.size();
+		key = HashBytes(&length, sizeof(length), key);
+		return HashString(fragmentSource, key);
+	}
+
+	// Loads the cached binary for key into program, true if it linked
+	bool Load(uint64_t key, unsigned int program)
+	{
+		if ( !enabled )
+			return false;
+
+		MappedFile file;
+		if ( !file.Open(path(key)) )
+			return false;
+		StartupProfiler::AddBytesRead(file.Size());
+
+		const ProgramCacheHeader *header = (const ProgramCacheHeader *)file.Data();
+		bool valid = file.Size() >= sizeof(ProgramCacheHeader) && header->magic == PROGRAM_CACHE_MAGIC && header->version == PROGRAM_CACHE_VERSION
+			&& header->key == key && sizeof(ProgramCacheHeader) + (uint64_t)header->binaryLength <= file.Size();
+
+		GLint linked = GL_FALSE;
+		if ( valid )
+		{
+			programBinary(program, header->binaryFormat, file.Data() + sizeof(ProgramCacheHeader), header->binaryLength);
+			glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		}
+		if ( linked != GL_TRUE )
+		{
+			file.Close();
+			remove(path(key).c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// Must be called before glLinkProgram for Store to work
+	void PrepareLink(unsigned int program)
+	{
+		if ( enabled )
+			programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	// Writes the binary of a successfully linked program
+	void Store(uint64_t key, unsigned int program)
+	{
+		if ( !enabled )
+			return;
+
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if ( length <= 0 )
+			return;
+
+		vector<unsigned char> binary(length);
+		GLenum binaryFormat = 0;
+		GLsizei written = 0;
+		getProgramBinary(program, length, &written, &binaryFormat, binary.data());
+		if ( written <= 0 )
+			return;
+
+		ProgramCacheHeader header = ProgramCacheHeader();
+		header.magic = PROGRAM_CACHE_MAGIC;
+		header.version = PROGRAM_CACHE_VERSION;
+		header.key = key;
+		header.binaryFormat = binaryFormat;
+		header.binaryLength = written;
+
+		// Through a temporary file so a crash never leaves a truncated binary behind
+		string cachePath = path(key);
+		string tempPath = cachePath + ".tmp";
+		FILE *out = fopen(tempPath.c_str(), "wb");
+		if ( !out )
+		{
+			cout << "ERROR::PROGRAM_CACHE::CANNOT_WRITE::" << tempPath << endl;
+			return;
+		}
+		bool ok = fwrite(&header, sizeof(header), 1, out) == 1 && fwrite(binary.data(), written, 1, out) == 1;
+		ok = (fclose(out) == 0) && ok;
+		if ( !ok || rename(tempPath.c_str(), cachePath.c_str()) != 0 )
+		{
+			cout << "ERROR::PROGRAM_CACHE::CANNOT_WRITE::" << cachePath << endl;
+			remove(tempPath.c_str());
+		}
+	}
+
+ private:
+	typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+	typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+	typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+	GetProgramBinaryProc getProgramBinary;
+	ProgramBinaryProc programBinary;
+	ProgramParameteriProc programParameteri;
+	bool enabled;
+	string directory;
+	uint64_t driverHash;
+
+	ProgramCache() : getProgramBinary(NULL), programBinary(NULL), programParameteri(NULL), enabled(false), driverHash(HASH_SEED) {}
+	ProgramCache(const ProgramCache &);
+	ProgramCache &operator=(const ProgramCache &);
+
+	string path(uint64_t key) const
+	{
+		char name[17];
+		snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+		return directory + "/" + name + ".bin";
+	}
+};
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <cstring>
+#include <vector>
+#include "shader.h"
+#include "mesh.h"
+#include "texture_residency.h"
+
+using namespace std;
+
+// Passes run in this order, each with its own depth and stencil state
+enum RenderPass
+{
+	// Depth tested, the stencil is left alone
+	RENDER_PASS_OPAQUE,
+	// Opaque, writing 1 to the stencil where drawn, for RENDER_PASS_OUTLINE
+	RENDER_PASS_STENCIL_MARK,
+	// Depth test with GL_LEQUAL so a skybox drawn at the far plane passes where nothing was drawn
+	RENDER_PASS_SKYBOX,
+	// No depth test, only where the stencil was not marked
+	RENDER_PASS_OUTLINE,
+	// Blended, back to front
+	RENDER_PASS_TRANSPARENT,
+	RENDER_PASS_COUNT
+};
+
+const unsigned int RENDER_QUEUE_TEXTURE_UNITS = 4;
+
+// One draw, filled through RenderQueue::Submit. Texture i is bound to unit i.
+struct RenderItem
+{
+	RenderPass pass;
+	Shader *shader;
+	glm::mat4 model;
+	unsigned int vertexArray;
+	// GL_TEXTURE_2D, or GL_TEXTURE_CUBE_MAP for a skybox
+	GLenum textureTarget;
+	unsigned int textures[RENDER_QUEUE_TEXTURE_UNITS];
+	unsigned int textureCount;
+	// Draws the mesh when set, glDrawArrays(mode, first, count) otherwise
+	Mesh *mesh;
+	GLenum mode;
+	GLint first;
+	GLsizei count;
+	// Above 1 the arrays are drawn with glDrawArraysInstanced, the program is expected to take
+	// its model matrices from vertexArray (see InstanceBuffer)
+	GLsizei instanceCount;
+	// Set to color before the draw unless it is a default handle, e.g. the color of a lamp
+	Uniform<glm::vec3> colorUniform;
+	glm::vec3 color;
+	// Distance to the camera, see RenderQueue::Begin
+	float depth;
+};
+
+// Number of state changes and draws of the last Execute
+struct RenderQueueStats
+{
+	unsigned int draws;
+	unsigned int passChanges;
+	unsigned int programChanges;
+	unsigned int textureChanges;
+	unsigned int vertexArrayChanges;
+};
+
+// Collects the draws of a frame and runs them sorted by a 64-bit key, so draws sharing a program,
+// textures or VAO end up next to each other and binding what is already bound is skipped. From
+// the top bit down the key holds
+//   pass (4) | program (12) | textures (16) | VAO (12) | depth (20), front to back
+// for every pass but RENDER_PASS_TRANSPARENT, where depth (back to front) follows the pass:
+//   pass (4) | depth (20) | program (12) | textures (16) | VAO (12)
+// Each frame: Begin, Submit every draw, Execute. Items only point to shaders and meshes, they must
+// stay alive until Execute.
+class RenderQueue
+{
+ public:
+	// Depth beyond this is sorted as if it were at this distance
+	static constexpr float MAX_DEPTH = 100.0f;
+
+	RenderQueue() : viewPos(0.0f), stats() {}
+
+	// Starts a frame, depth is measured from viewPos
+	void Begin(const glm::vec3 &viewPos)
+	{
+		this->viewPos = viewPos;
+		items.clear();
+	}
+
+	// Queues glDrawArrays(mode, first, count) on vertexArray, textures are added to the returned
+	// item. The reference is only valid until the next Submit.
+	RenderItem &Submit(RenderPass pass, Shader *shader, const glm::mat4 &model, unsigned int vertexArray, GLenum mode, GLint first, GLsizei count)
+	{
+		items.push_back(RenderItem());
+		RenderItem &item = items.back();
+		item.pass = pass;
+		item.shader = shader;
+		item.model = model;
+		item.vertexArray = vertexArray;
+		item.textureTarget = GL_TEXTURE_2D;
+		item.textureCount = 0;
+		item.mesh = NULL;
+		item.mode = mode;
+		item.first = first;
+		item.count = count;
+		item.instanceCount = 1;
+		item.color = glm::vec3(0.0f);
+		item.depth = glm::length(glm::vec3(model[3]) - viewPos);
+		return item;
+	}
+
+	// Queues the mesh with the level of detail and culling selected last, and its textures
+	RenderItem &Submit(RenderPass pass, Shader *shader, const glm::mat4 &model, Mesh *mesh)
+	{
+		RenderItem &item = Submit(pass, shader, model, mesh->VertexArray(), GL_TRIANGLES, 0, 0);
+		item.mesh = mesh;
+		for (unsigned int i = 0; i < mesh->textures.size() && i < RENDER_QUEUE_TEXTURE_UNITS; i++)
+			AddTexture(item, mesh->textures[i].id);
+		return item;
+	}
+
+	static void AddTexture(RenderItem &item, unsigned int texture)
+	{
+		if ( item.textureCount < RENDER_QUEUE_TEXTURE_UNITS )
+			item.textures[item.textureCount++] = texture;
+	}
+
+	// Sorts and draws everything submitted since Begin. Leaves depth testing on with GL_LESS,
+	// stencil writes on and GL_TEXTURE0 active, like the frame starts with.
+	void Execute()
+	{
+		sort();
+
+		stats = RenderQueueStats();
+		int currentPass = -1;
+		unsigned int currentProgram = 0, currentVertexArray = 0;
+		const glm::mat4 *currentModel = NULL;
+		// Resolved once per program switch, not per mesh
+		VertexEncodingUniforms encodingUniforms;
+		Uniform<glm::mat4> modelUniform;
+		GLenum boundTargets[RENDER_QUEUE_TEXTURE_UNITS] = {};
+		unsigned int boundTextures[RENDER_QUEUE_TEXTURE_UNITS] = {};
+		// Nothing is known to be bound when the frame starts
+		bool first = true;
+		for (unsigned int i = 0; i < order.size(); i++)
+		{
+			RenderItem &item = items[order[i]];
+			if ( (int)item.pass != currentPass )
+			{
+				currentPass = item.pass;
+				applyPass(item.pass);
+				stats.passChanges++;
+			}
+
+			if ( first || item.shader->ID != currentProgram )
+			{
+				item.shader->use();
+				currentProgram = item.shader->ID;
+				currentModel = NULL;
+				encodingUniforms = VertexEncodingUniforms(*item.shader);
+				modelUniform = item.shader->GetUniform<glm::mat4>("model");
+				stats.programChanges++;
+			}
+
+			for (unsigned int unit = 0; unit < item.textureCount; unit++)
+			{
+				if ( boundTargets[unit] == item.textureTarget && boundTextures[unit] == item.textures[unit] )
+					continue;
+				glActiveTexture(GL_TEXTURE0 + unit);
+				glBindTexture(item.textureTarget, item.textures[unit]);
+				TextureResidency::Get().Touch(item.textures[unit]);
+				boundTargets[unit] = item.textureTarget;
+				boundTextures[unit] = item.textures[unit];
+				stats.textureChanges++;
+			}
+
+			if ( first || item.vertexArray != currentVertexArray )
+			{
+				glBindVertexArray(item.vertexArray);
+				currentVertexArray = item.vertexArray;
+				stats.vertexArrayChanges++;
+			}
+			first = false;
+
+			// The meshes of one model share their matrix
+			if ( !currentModel || memcmp(currentModel, &item.model, sizeof(glm::mat4)) != 0 )
+			{
+				if ( modelUniform.Location() >= 0 )
+					modelUniform.Set(item.model);
+				currentModel = &item.model;
+			}
+			if ( item.colorUniform.Location() >= 0 )
+				item.colorUniform.Set(item.color);
+
+			if ( item.mesh )
+				item.mesh->DrawGeometry(encodingUniforms);
+			else if ( item.instanceCount > 1 )
+				glDrawArraysInstanced(item.mode, item.first, item.count, item.instanceCount);
+			else
+				glDrawArrays(item.mode, item.first, item.count);
+			stats.draws++;
+		}
+
+		glBindVertexArray(0);
+		glActiveTexture(GL_TEXTURE0);
+		applyPass(RENDER_PASS_OPAQUE);
+		glStencilMask(0xFF);
+	}
+
+	const RenderQueueStats &Stats() const { return stats; }
+
+ private:
+	glm::vec3 viewPos;
+	vector<RenderItem> items;
+	// Reused every frame, order holds the item indices once sorted
+	vector<uint64_t> keys, scratchKeys;
+	vector<unsigned int> order, scratchOrder;
+	RenderQueueStats stats;
+
+	RenderQueue(const RenderQueue &);
+	RenderQueue &operator=(const RenderQueue &);
+
+	static void applyPass(RenderPass pass)
+	{
+		switch ( pass )
+		{
+		case RENDER_PASS_STENCIL_MARK:
+			glEnable(GL_DEPTH_TEST);
+			glDepthFunc(GL_LESS);
+			glStencilFunc(GL_ALWAYS, 1, 0xFF);
+			glStencilMask(0xFF);
+			break;
+		case RENDER_PASS_SKYBOX:
+			glEnable(GL_DEPTH_TEST);
+			glDepthFunc(GL_LEQUAL);
+			glStencilFunc(GL_ALWAYS, 1, 0xFF);
+			glStencilMask(0x00);
+			break;
+		case RENDER_PASS_OUTLINE:
+			glDisable(GL_DEPTH_TEST);
+			glDepthFunc(GL_LESS);
+			glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
+			glStencilMask(0x00);
+			break;
+		default:
+			glEnable(GL_DEPTH_TEST);
+			glDepthFunc(GL_LESS);
+			glStencilFunc(GL_ALWAYS, 1, 0xFF);
+			glStencilMask(0x00);
+			break;
+		}
+	}
+
+	static uint64_t makeKey(const RenderItem &item)
+	{
+		// Every bind of the material in one value, ids are small so xor keeps them apart
+		uint32_t textures = item.textureTarget == GL_TEXTURE_CUBE_MAP ? 0x8000 : 0;
+		for (unsigned int i = 0; i < item.textureCount; i++)
+			textures ^= item.textures[i] << (4 * i);
+
+		float clamped = item.depth < MAX_DEPTH ? item.depth : MAX_DEPTH;
+		uint64_t depth = (uint64_t)(clamped / MAX_DEPTH * 0xFFFFF) & 0xFFFFF;
+		uint64_t pass = item.pass;
+		uint64_t program = item.shader->ID & 0xFFF;
+		uint64_t material = textures & 0xFFFF;
+		uint64_t vertexArray = item.vertexArray & 0xFFF;
+		if ( item.pass == RENDER_PASS_TRANSPARENT )
+			return pass << 60 | (0xFFFFF - depth) << 40 | program << 28 | material << 12 | vertexArray;
+		return pass << 60 | program << 48 | material << 32 | vertexArray << 20 | depth;
+	}
+
+	// Least significant byte first radix sort of the keys with their item indices, a byte that
+	// is the same in every key is skipped
+	void sort()
+	{
+		unsigned int count = items.size();
+		keys.resize(count);
+		order.resize(count);
+		scratchKeys.resize(count);
+		scratchOrder.resize(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			keys[i] = makeKey(items[i]);
+			order[i] = i;
+		}
+		if ( count < 2 )
+			return;
+
+		for (unsigned int shift = 0; shift < 64; shift += 8)
+		{
+			unsigned int offsets[256] = {};
+			for (unsigned int i = 0; i < count; i++)
+				offsets[(keys[i] >> shift) & 0xFF]++;
+			if ( offsets[(keys[0] >> shift) & 0xFF] == count )
+				continue;
+
+			unsigned int total = 0;
+			for (unsigned int b = 0; b < 256; b++)
+			{
+				unsigned int bucket = offsets[b];
+				offsets[b] = total;
+				total += bucket;
+			}
+			for (unsigned int i = 0; i < count; i++)
+			{
+				unsigned int slot = offsets[(keys[i] >> shift) & 0xFF]++;
+				scratchKeys[slot] = keys[i];
+				scratchOrder[slot] = order[i];
+			}
+			keys.swap(scratchKeys);
+			order.swap(scratchOrder);
+		}
+	}
+};
@@ -6,48 +6,187 @@
 // #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "../contrib/stb_image.h"
+#include "texture_registry.h"
+#include "frame_uniforms.h"
+#include "light_uniforms.h"
+#include "program_cache.h"
+#include "shader_preprocessor.h"
+#include "uniform.h"
 
+#include <map>
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <vector>
 #include <iostream>
 
 using namespace std;
 
+// What a program was built from, kept so it can be rebuilt in place (see Shader::Reload)
+struct ShaderSource
+{
+	string vertexPath;
+	string fragmentPath;
+	ShaderDefines defines;
+	// Every file read for either stage, includes too
+	vector<string> files;
+	// Reflected when the program is built or reloaded
+	UniformTable uniforms;
+};
+
 class Shader
 {
  public:
   unsigned int ID;
 
-  Shader(const char* vertexPath, const char* fragmentPath)
+  // Both stages go through ShaderPreprocessor with the same defines
+  Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines &defines = ShaderDefines())
 	{
-		string vertexCode;
-		string fragmentCode;
-		ifstream vShaderFile;
-		ifstream fShaderFile;
+		string label = defines.Label();
+		ProfileScope profile(string("shader ") + vertexPath + " " + fragmentPath + (label.empty() ? "" : " " + label));
+		ID = glCreateProgram();
+		ShaderSource &source = Sources()[ID];
+		uniforms = &source.uniforms;
+		source.vertexPath = vertexPath;
+		source.fragmentPath = fragmentPath;
+		source.defines = defines;
 
-		vShaderFile.exceptions(ifstream::failbit | ifstream::badbit);
-		fShaderFile.exceptions(ifstream::failbit | ifstream::badbit);
-		try
-		{
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			stringstream vShaderStream, fShaderStream;
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
+		string vertexCode, fragmentCode;
+		vector<string> vertexFiles, fragmentFiles;
+		preprocess(source, &vertexCode, &fragmentCode, &vertexFiles, &fragmentFiles);
 
-			vShaderFile.close();
-			fShaderFile.close();
+		// Warm starts load the linked binary and skip compiling
+		uint64_t cacheKey = ProgramCache::Get().Key(vertexCode, fragmentCode);
+		if ( !ProgramCache::Get().Load(cacheKey, ID) && build(ID, vertexCode, fragmentCode, vertexFiles, fragmentFiles) )
+			ProgramCache::Get().Store(cacheKey, ID);
+		bindUniformBlocks(ID);
+		uniforms->Reflect(ID);
+	}
 
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-		}
-		catch(ifstream::failure e)
-		{
-			cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ::" << vertexPath << "," << fragmentPath << endl;
-		}
+	// Every program built by a Shader, by ID
+	static map<unsigned int, ShaderSource> &Sources()
+	{
+		static map<unsigned int, ShaderSource> sources;
+		return sources;
+	}
+
+	// Bumped whenever the files of a program are read, when it is built or reloaded
+	static unsigned int &SourcesGeneration()
+	{
+		static unsigned int generation = 0;
+		return generation;
+	}
+
+	// Rebuilds program from its files again, keeping its ID and the values of its uniforms.
+	// If the new source does not compile or link the errors are printed and the program
+	// keeps working as before. Must run on the GL thread.
+	static bool Reload(unsigned int program)
+	{
+		map<unsigned int, ShaderSource>::iterator found = Sources().find(program);
+		if ( found == Sources().end() )
+			return false;
+
+		string vertexCode, fragmentCode;
+		vector<string> vertexFiles, fragmentFiles;
+		if ( !preprocess(found->second, &vertexCode, &fragmentCode, &vertexFiles, &fragmentFiles) )
+			return false;
+
+		// Linking a program that is in use replaces it even when the link fails, so the new
+		// source is tried on a scratch program first
+		unsigned int scratch = glCreateProgram();
+		bool linked = build(scratch, vertexCode, fragmentCode, vertexFiles, fragmentFiles);
+		glDeleteProgram(scratch);
+		if ( !linked )
+			return false;
+
+		vector<UniformValue> uniforms = saveUniforms(program);
+		if ( !build(program, vertexCode, fragmentCode, vertexFiles, fragmentFiles) )
+			return false;
+		restoreUniforms(program, uniforms);
+		bindUniformBlocks(program);
+		found->second.uniforms.Reflect(program);
+		ProgramCache::Get().Store(ProgramCache::Get().Key(vertexCode, fragmentCode), program);
+		return true;
+	}
+  
+  void use()
+	{
+		glUseProgram(ID);
+	}
+  
+	// Looked up in the table reflected at link time, no driver call
+	GLint Location(const string &name) const
+	{
+		return uniforms->Location(name);
+	}
+
+	// For uniforms set every frame, see Uniform
+	template <typename T>
+	Uniform<T> GetUniform(const string &name)
+	{
+		return Uniform<T>(uniforms, uniforms->Slot(name));
+	}
+
+  void setBool(const string &name, bool value) const
+	{
+		glUniform1i(Location(name), (int)value);
+	}
+  void setInt(const string &name, int value) const
+	{
+		glUniform1i(Location(name), value);
+	}
+  void setFloat(const string &name, float value) const
+	{
+		glUniform1f(Location(name), value);
+	}
+	void setVec4(const string &name, float v1, float v2, float v3, float v4) const
+	{
+		glUniform4f(Location(name), v1, v2, v3, v4);
+	}
+	void setVec3(const string &name, float v1, float v2, float v3) const
+	{
+		glUniform3f(Location(name), v1, v2, v3);
+	}
+	void setVec3(const string &name, glm::vec3 v) const
+	{
+		glUniform3f(Location(name), v.x, v.y, v.z);
+	}
+	void setMat4(const string &name, glm::mat4 mat) const
+	{
+		glUniformMatrix4fv(Location(name), 1, GL_FALSE, glm::value_ptr(mat));
+	}
+	static unsigned int LoadTextureFromFile(char const * path, const string &directory)
+	{
+		return TextureRegistry::Get().Acquire(directory + '/' + string(path));
+	}
+
+ private:
+	UniformTable *uniforms;
+
+	struct UniformValue
+	{
+		string name;
+		GLenum type;
+		GLint size;
+		// Big enough for a mat4, larger types are not used by the game
+		GLfloat floats[16];
+		GLint ints[4];
+	};
+
+	static bool preprocess(ShaderSource &source, string *vertexCode, string *fragmentCode, vector<string> *vertexFiles, vector<string> *fragmentFiles)
+	{
+		bool read = ShaderPreprocessor::Process(source.vertexPath, source.defines, vertexCode, vertexFiles)
+			&& ShaderPreprocessor::Process(source.fragmentPath, source.defines, fragmentCode, fragmentFiles);
+		if ( !read )
+			cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ::" << source.vertexPath << "," << source.fragmentPath << endl;
+
+		source.files = *vertexFiles;
+		source.files.insert(source.files.end(), fragmentFiles->begin(), fragmentFiles->end());
+		SourcesGeneration()++;
+		return read;
+	}
+
+	// Compiles both stages and links them into program, printing any errors
+	static bool build(unsigned int program, const string &vertexCode, const string &fragmentCode, const vector<string> &vertexFiles, const vector<string> &fragmentFiles)
+	{
 		const char* vShaderCode = vertexCode.c_str();
 		const char* fShaderCode = fragmentCode.c_str();
 
@@ -64,7 +203,7 @@ class Shader
 		if (!success)
 		{
 			glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-			cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << endl;
+			cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED::" << ShaderPreprocessor::FileLegend(vertexFiles) << "\n" << infoLog << endl;
 		}
 
 		// FRAGMENT
@@ -76,98 +215,161 @@ class Shader
 		if (!success)
 		{
 			glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-			cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << endl;
+			cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED::" << ShaderPreprocessor::FileLegend(fragmentFiles) << "\n" << infoLog << endl;
 		}
 
 		// Shader program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		glLinkProgram(ID);
+		glAttachShader(program, vertex);
+		glAttachShader(program, fragment);
+		ProgramCache::Get().PrepareLink(program);
+		glLinkProgram(program);
 
-		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
 		if (!success)
 		{
-			glGetProgramInfoLog(ID, 512, NULL, infoLog);
+			glGetProgramInfoLog(program, 512, NULL, infoLog);
 			cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
 		}
 
+		// Detached so a later Reload links only the new stages
+		glDetachShader(program, vertex);
+		glDetachShader(program, fragment);
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
+		return success != 0;
 	}
-  
-  void use()
+
+	// Blocks shared by every program get fixed binding points, linking resets them to 0
+	static void bindUniformBlocks(unsigned int program)
 	{
-		glUseProgram(ID);
+		GLuint index = glGetUniformBlockIndex(program, "FrameData");
+		if ( index != GL_INVALID_INDEX )
+			glUniformBlockBinding(program, index, FrameUniforms::BINDING);
+		index = glGetUniformBlockIndex(program, "LightData");
+		if ( index != GL_INVALID_INDEX )
+			glUniformBlockBinding(program, index, LightUniforms::BINDING);
 	}
-  
-  void setBool(const string &name, bool value) const
+
+	// Linking resets every uniform, values set once at startup (samplers, materials) are
+	// carried over by name
+	static vector<UniformValue> saveUniforms(unsigned int program)
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		vector<UniformValue> uniforms;
+		GLint count = 0;
+		glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			char name[256];
+			UniformValue value = UniformValue();
+			glGetActiveUniform(program, i, sizeof(name), NULL, &value.size, &value.type, name);
+			value.name = name;
+			// Arrays are saved element by element
+			string base = value.name.substr(0, value.name.find('['));
+			for (GLint element = 0; element < value.size; element++)
+			{
+				UniformValue item = value;
+				item.name = value.size > 1 ? base + "[" + to_string(element) + "]" : value.name;
+				GLint location = glGetUniformLocation(program, item.name.c_str());
+				if ( location < 0 || !(isFloatType(item.type) || isIntType(item.type)) )
+					continue;
+				if ( isFloatType(item.type) )
+					glGetUniformfv(program, location, item.floats);
+				else
+					glGetUniformiv(program, location, item.ints);
+				uniforms.push_back(item);
+			}
+		}
+		return uniforms;
 	}
-  void setInt(const string &name, int value) const
+
+	static void restoreUniforms(unsigned int program, const vector<UniformValue> &uniforms)
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		GLint current = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+		glUseProgram(program);
+		for (unsigned int i = 0; i < uniforms.size(); i++)
+		{
+			const UniformValue &value = uniforms[i];
+			GLint location = glGetUniformLocation(program, value.name.c_str());
+			if ( location < 0 )
+				continue;
+			switch ( value.type )
+			{
+			case GL_FLOAT: glUniform1fv(location, 1, value.floats); break;
+			case GL_FLOAT_VEC2: glUniform2fv(location, 1, value.floats); break;
+			case GL_FLOAT_VEC3: glUniform3fv(location, 1, value.floats); break;
+			case GL_FLOAT_VEC4: glUniform4fv(location, 1, value.floats); break;
+			case GL_FLOAT_MAT3: glUniformMatrix3fv(location, 1, GL_FALSE, value.floats); break;
+			case GL_FLOAT_MAT4: glUniformMatrix4fv(location, 1, GL_FALSE, value.floats); break;
+			case GL_INT_VEC2: case GL_BOOL_VEC2: glUniform2iv(location, 1, value.ints); break;
+			case GL_INT_VEC3: case GL_BOOL_VEC3: glUniform3iv(location, 1, value.ints); break;
+			case GL_INT_VEC4: case GL_BOOL_VEC4: glUniform4iv(location, 1, value.ints); break;
+			default: glUniform1iv(location, 1, value.ints); break;
+			}
+		}
+		glUseProgram(current);
 	}
-  void setFloat(const string &name, float value) const
+
+	static bool isFloatType(GLenum type)
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		return type == GL_FLOAT || type == GL_FLOAT_VEC2 || type == GL_FLOAT_VEC3 || type == GL_FLOAT_VEC4 || type == GL_FLOAT_MAT3 || type == GL_FLOAT_MAT4;
 	}
-	void setVec4(const string &name, float v1, float v2, float v3, float v4) const
+
+	// Samplers are ints too
+	static bool isIntType(GLenum type)
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), v1, v2, v3, v4);
+		switch ( type )
+		{
+		case GL_INT: case GL_INT_VEC2: case GL_INT_VEC3: case GL_INT_VEC4:
+		case GL_BOOL: case GL_BOOL_VEC2: case GL_BOOL_VEC3: case GL_BOOL_VEC4:
+		case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+			return true;
+		default:
+			return false;
+		}
 	}
-	void setVec3(const string &name, float v1, float v2, float v3) const
+};
+
+// Every compiled variant of one vertex/fragment pair, picked by defines at draw time so the
+// fragment shaders branch at compile time instead of on uniforms. Variants are built the
+// first time they are asked for, Prepare builds them up front to keep that out of a frame.
+class ShaderPermutations
+{
+ public:
+	ShaderPermutations(const char* vertexPath, const char* fragmentPath) : vertexPath(vertexPath), fragmentPath(fragmentPath)
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), v1, v2, v3);
 	}
-	void setVec3(const string &name, glm::vec3 v) const
+	~ShaderPermutations()
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), v.x, v.y, v.z);
+		for (map<ShaderDefines, Shader *>::iterator it = variants.begin(); it != variants.end(); ++it)
+			delete it->second;
 	}
-	void setMat4(const string &name, glm::mat4 mat) const
+
+	void Prepare(const ShaderDefines &defines)
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+		Get(defines);
 	}
-	static unsigned int LoadTextureFromFile(char const * path, const string &directory)
+
+	Shader &Get(const ShaderDefines &defines)
 	{
-		string filename = string(path);
-		filename = directory + '/' + filename;
-		
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-			GLenum format;
-			if (nrComponents == 1)
-				format = GL_RED;
-			else if (nrComponents == 3)
-				format = GL_RGB;
-			else if (nrComponents == 4)
-				format = GL_RGBA;
-
-			glBindTexture(GL_TEXTURE_2D, textureID);
-			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_2D);
-
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-			stbi_image_free(data);
-    }
-    else
-    {
-			cout << "Texture failed to load at path: " << filename.c_str() << endl;
-			stbi_image_free(data);
-    }
-
-    return textureID;
+		map<ShaderDefines, Shader *>::iterator found = variants.find(defines);
+		if ( found != variants.end() )
+			return *found->second;
+
+		Shader *shader = new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines);
+		variants[defines] = shader;
+		return *shader;
 	}
+
+	unsigned int VariantCount() const { return variants.size(); }
+
+ private:
+	string vertexPath;
+	string fragmentPath;
+	map<ShaderDefines, Shader *> variants;
+
+	ShaderPermutations(const ShaderPermutations &);
+	ShaderPermutations &operator=(const ShaderPermutations &);
 };
 
 #endif
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include "../core/archive.h"
+#include "../core/vfs.h"
+
+using namespace std;
+
+// Compile time switches of a shader, e.g. HAS_SPECULAR 0 or POST_EFFECT 2. Every
+// distinct set of values is its own program.
+class ShaderDefines
+{
+ public:
+	ShaderDefines &Set(const string &name, int value)
+	{
+		values[name] = value;
+		return *this;
+	}
+
+	// #define lines in name order, the same values always give the same text
+	string Source() const
+	{
+		string source;
+		for (map<string, int>::const_iterator it = values.begin(); it != values.end(); ++it)
+			source += "#define " + it->first + " " + to_string(it->second) + "\n";
+		return source;
+	}
+
+	// "HAS_SPECULAR=0 POST_EFFECT=2", for logs
+	string Label() const
+	{
+		string label;
+		for (map<string, int>::const_iterator it = values.begin(); it != values.end(); ++it)
+			label += (label.empty() ? "" : " ") + it->first + "=" + to_string(it->second);
+		return label;
+	}
+
+	bool operator<(const ShaderDefines &other) const
+	{
+		return values < other.values;
+	}
+
+ private:
+	map<string, int> values;
+};
+
+// Turns a GLSL file into the source handed to glShaderSource:
+//  - #include "file" is replaced by that file, relative to the including one. Every file is
+//    included once, so shared headers need no guards.
+//  - defines go right after #version (only blank lines and comments may come before it),
+//    shaders pick defaults with #ifndef.
+//  - #line directives keep compiler errors pointing at the right line. GLSL 3.30 only takes a
+//    number as the source, it is the index into files.
+class ShaderPreprocessor
+{
+ public:
+	static bool Process(const string &path, const ShaderDefines &defines, string *source, vector<string> *files)
+	{
+		source->clear();
+		files->clear();
+		return append(Archive::NormalizePath(path), defines.Source(), source, files);
+	}
+
+	// "0: shaders/color.fs, 1: shaders/include/lights.glsl", to read the compiler's log with
+	static string FileLegend(const vector<string> &files)
+	{
+		string legend;
+		for (unsigned int i = 0; i < files.size(); i++)
+			legend += (i > 0 ? ", " : "") + to_string(i) + ": " + files[i];
+		return legend;
+	}
+
+ private:
+	static bool append(const string &path, const string &defines, string *source, vector<string> *files)
+	{
+		string text;
+		if ( !Vfs::Get().ReadText(path, text) )
+		{
+			cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ::" << path << endl;
+			return false;
+		}
+
+		unsigned int index = files->size();
+		files->push_back(path);
+		string directory = path.substr(0, path.find_last_of('/') + 1);
+
+		if ( index > 0 )
+			*source += "#line 1 " + to_string(index) + "\n";
+
+		// Defines follow the #version line, blank lines and comments may come before it. Without
+		// one they go first.
+		unsigned int versionLine = index == 0 ? findVersion(text) : 0;
+		if ( index == 0 && versionLine == 0 )
+			*source += defines + "#line 1 0\n";
+
+		istringstream lines(text);
+		string line;
+		for (unsigned int number = 1; getline(lines, line); number++)
+		{
+			string include;
+			if ( parseInclude(line, &include) )
+			{
+				string includePath = Archive::NormalizePath(directory + include);
+				bool included = false;
+				for (unsigned int i = 0; i < files->size(); i++)
+					included = included || (*files)[i] == includePath;
+				if ( !included && !append(includePath, "", source, files) )
+					return false;
+				*source += "#line " + to_string(number + 1) + " " + to_string(index) + "\n";
+				continue;
+			}
+
+			*source += line + "\n";
+			if ( number == versionLine )
+				*source += defines + "#line " + to_string(number + 1) + " 0\n";
+		}
+		return true;
+	}
+
+	// Number of the first line starting with #version, 0 if there is none
+	static unsigned int findVersion(const string &text)
+	{
+		istringstream lines(text);
+		string line;
+		for (unsigned int number = 1; getline(lines, line); number++)
+		{
+			size_t start = line.find_first_not_of(" \t");
+			if ( start != string::npos && line.compare(start, 8, "#version") == 0 )
+				return number;
+		}
+		return 0;
+	}
+
+	// #include "file" with optional blanks, anything else is left to the GLSL compiler
+	static bool parseInclude(const string &line, string *include)
+	{
+		size_t start = line.find_first_not_of(" \t");
+		if ( start == string::npos || line.compare(start, 8, "#include") != 0 )
+			return false;
+
+		size_t open = line.find('"', start + 8);
+		size_t close = open == string::npos ? string::npos : line.find('"', open + 1);
+		if ( close == string::npos )
+			return false;
+		*include = line.substr(open + 1, close - open - 1);
+		return true;
+	}
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+using namespace std;
+
+// Cooked texture written by tools/texture_cooker next to its source (tile.png ->
+// tile.png.ctex). Every mip level is stored ready for glCompressedTexImage2D (or
+// glTexImage2D for the uncompressed formats), rows bottom to top like GL expects.
+//
+//   TextureContainerHeader
+//   TextureContainerLevel[mipCount]
+//   level data, each level 8 byte aligned
+const uint32_t TEXTURE_CONTAINER_MAGIC = 0x58455443; // "CTEX"
+const uint32_t TEXTURE_CONTAINER_VERSION = 1;
+
+enum TextureContainerFormat
+{
+	TEXTURE_FORMAT_R8,
+	TEXTURE_FORMAT_RGB8,
+	TEXTURE_FORMAT_RGBA8,
+	// Opaque color, 8 bytes per 4x4 block
+	TEXTURE_FORMAT_BC1,
+	// Color with alpha, 16 bytes per 4x4 block
+	TEXTURE_FORMAT_BC3,
+	// Two channels (normal map X and Y), 16 bytes per 4x4 block
+	TEXTURE_FORMAT_BC5
+};
+
+// Header flags
+// Rows were flipped like stbi_set_flip_vertically_on_load(true) does
+const uint32_t TEXTURE_CONTAINER_FLIPPED = 1 << 0;
+// The source had an alpha channel, sampled with GL_CLAMP_TO_EDGE like uncooked RGBA images
+const uint32_t TEXTURE_CONTAINER_CLAMP = 1 << 1;
+
+struct TextureContainerHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t flags;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipCount;
+	uint32_t padding;
+};
+
+struct TextureContainerLevel
+{
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;
+	uint64_t size;
+};
+
+class TextureContainer
+{
+ public:
+	static string CookedPath(const string &sourcePath)
+	{
+		return sourcePath + ".ctex";
+	}
+
+	static bool IsCompressed(uint32_t format)
+	{
+		return format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_BC3 || format == TEXTURE_FORMAT_BC5;
+	}
+
+	static unsigned int Components(uint32_t format)
+	{
+		switch ( format )
+		{
+		case TEXTURE_FORMAT_R8: return 1;
+		case TEXTURE_FORMAT_BC5: return 2;
+		case TEXTURE_FORMAT_RGB8:
+		case TEXTURE_FORMAT_BC1: return 3;
+		default: return 4;
+		}
+	}
+
+	// Bytes of one mip level
+	static uint64_t LevelSize(uint32_t format, uint32_t width, uint32_t height)
+	{
+		uint64_t blocks = (uint64_t)((width + 3) / 4) * ((height + 3) / 4);
+		if ( format == TEXTURE_FORMAT_BC1 )
+			return blocks * 8;
+		if ( IsCompressed(format) )
+			return blocks * 16;
+		return (uint64_t)width * height * Components(format);
+	}
+
+	// Checks that data holds a complete container, returns its header or NULL
+	static const TextureContainerHeader *Parse(const unsigned char *data, size_t size)
+	{
+		if ( size < sizeof(TextureContainerHeader) )
+			return NULL;
+
+		const TextureContainerHeader *header = (const TextureContainerHeader *)data;
+		if ( header->magic != TEXTURE_CONTAINER_MAGIC || header->version != TEXTURE_CONTAINER_VERSION
+				 || header->format > TEXTURE_FORMAT_BC5 || header->mipCount == 0 || header->mipCount > 32 )
+			return NULL;
+		if ( sizeof(TextureContainerHeader) + (uint64_t)header->mipCount * sizeof(TextureContainerLevel) > size )
+			return NULL;
+
+		for (unsigned int i = 0; i < header->mipCount; i++)
+		{
+			const TextureContainerLevel *level = Level(header, i);
+			if ( level->size != LevelSize(header->format, level->width, level->height) || level->offset + level->size > size )
+				return NULL;
+		}
+		return header;
+	}
+
+	static const TextureContainerLevel *Level(const TextureContainerHeader *header, unsigned int level)
+	{
+		return (const TextureContainerLevel *)(header + 1) + level;
+	}
+};
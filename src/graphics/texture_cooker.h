@@ -0,0 +1,230 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+#include "../contrib/stb_image.h"
+#include "../core/mapped_file.h"
+#include "bc_encoder.h"
+#include "texture_container.h"
+
+using namespace std;
+
+struct TextureCookOptions
+{
+	// Store R8/RGB8/RGBA8 instead of block compressing
+	bool uncompressed;
+	// Flip rows like the game does with stbi_set_flip_vertically_on_load(true)
+	bool flip;
+
+	TextureCookOptions() : uncompressed(false), flip(true)
+	{
+	}
+};
+
+// Converts an image into a TextureContainer with a full mip chain. Offline only, the
+// including translation unit provides the stb_image implementation.
+class TextureCooker
+{
+ public:
+	static bool IsImage(const string &path)
+	{
+		static const char *extensions[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+		for (unsigned int i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+		{
+			string extension = extensions[i];
+			if ( path.size() > extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0 )
+				return true;
+		}
+		return false;
+	}
+
+	// True if the cooked file is missing or older than its source
+	static bool IsStale(const string &sourcePath)
+	{
+		int64_t sourceTime, cookedTime;
+		uint64_t size;
+		if ( !MappedFile::Stat(TextureContainer::CookedPath(sourcePath), &cookedTime, &size) )
+			return true;
+		return !MappedFile::Stat(sourcePath, &sourceTime, &size) || cookedTime < sourceTime;
+	}
+
+	static bool Cook(const string &sourcePath, const TextureCookOptions &options, uint64_t *cookedBytes)
+	{
+		stbi_set_flip_vertically_on_load(options.flip);
+		int width, height, components;
+		unsigned char *pixels = stbi_load(sourcePath.c_str(), &width, &height, &components, 4);
+		if ( !pixels )
+		{
+			cout << "ERROR::TEXTURE_COOKER::CANNOT_LOAD::" << sourcePath << endl;
+			return false;
+		}
+
+		vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4);
+		stbi_image_free(pixels);
+
+		TextureContainerHeader header = TextureContainerHeader();
+		header.magic = TEXTURE_CONTAINER_MAGIC;
+		header.version = TEXTURE_CONTAINER_VERSION;
+		header.format = chooseFormat(sourcePath, components, level, options);
+		header.flags = (options.flip ? TEXTURE_CONTAINER_FLIPPED : 0) | (components == 4 ? TEXTURE_CONTAINER_CLAMP : 0);
+		header.width = width;
+		header.height = height;
+
+		vector<TextureContainerLevel> levels;
+		vector<vector<unsigned char> > data;
+		uint64_t offset = 0;
+		for (unsigned int w = width, h = height; ; w = w > 1 ? w / 2 : 1, h = h > 1 ? h / 2 : 1)
+		{
+			TextureContainerLevel entry;
+			entry.width = w;
+			entry.height = h;
+			entry.offset = offset;
+			data.push_back(encode(header.format, level, w, h));
+			entry.size = data.back().size();
+			levels.push_back(entry);
+			offset = align(offset + entry.size);
+
+			if ( w == 1 && h == 1 )
+				break;
+			level = downsample(level, w, h);
+		}
+		header.mipCount = levels.size();
+
+		uint64_t dataStart = align(sizeof(TextureContainerHeader) + levels.size() * sizeof(TextureContainerLevel));
+		for (unsigned int i = 0; i < levels.size(); i++)
+			levels[i].offset += dataStart;
+
+		// Written to a temporary file first so a crash never leaves a truncated container behind
+		string cookedPath = TextureContainer::CookedPath(sourcePath);
+		string tempPath = cookedPath + ".tmp";
+		FILE *out = fopen(tempPath.c_str(), "wb");
+		if ( !out )
+		{
+			cout << "ERROR::TEXTURE_COOKER::CANNOT_WRITE::" << tempPath << endl;
+			return false;
+		}
+
+		bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+		ok = ok && fwrite(levels.data(), sizeof(TextureContainerLevel), levels.size(), out) == levels.size();
+		for (unsigned int i = 0; ok && i < levels.size(); i++)
+		{
+			ok = fseek(out, levels[i].offset, SEEK_SET) == 0;
+			ok = ok && fwrite(data[i].data(), 1, data[i].size(), out) == data[i].size();
+		}
+		ok = (fclose(out) == 0) && ok;
+
+		if ( !ok || rename(tempPath.c_str(), cookedPath.c_str()) != 0 )
+		{
+			cout << "ERROR::TEXTURE_COOKER::CANNOT_WRITE::" << cookedPath << endl;
+			remove(tempPath.c_str());
+			return false;
+		}
+
+		*cookedBytes = levels.back().offset + levels.back().size;
+		return true;
+	}
+
+	static const char *FormatName(uint32_t format)
+	{
+		static const char *names[] = { "R8", "RGB8", "RGBA8", "BC1", "BC3", "BC5" };
+		return format <= TEXTURE_FORMAT_BC5 ? names[format] : "unknown";
+	}
+
+ private:
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + 7) & ~(uint64_t)7;
+	}
+
+	static bool isNormalMap(const string &path)
+	{
+		return path.find("_ddn.") != string::npos || path.find("_normal.") != string::npos;
+	}
+
+	static uint32_t chooseFormat(const string &path, int components, const vector<unsigned char> &rgba, const TextureCookOptions &options)
+	{
+		if ( options.uncompressed )
+			return components == 1 ? TEXTURE_FORMAT_R8 : (components == 3 ? TEXTURE_FORMAT_RGB8 : TEXTURE_FORMAT_RGBA8);
+		if ( isNormalMap(path) )
+			return TEXTURE_FORMAT_BC5;
+		if ( components == 1 )
+			return TEXTURE_FORMAT_R8;
+		if ( components == 3 )
+			return TEXTURE_FORMAT_BC1;
+
+		// Opaque images with an alpha channel still fit BC1
+		for (size_t i = 3; i < rgba.size(); i += 4)
+		{
+			if ( rgba[i] != 255 )
+				return TEXTURE_FORMAT_BC3;
+		}
+		return TEXTURE_FORMAT_BC1;
+	}
+
+	// 2x2 box filter, like glGenerateMipmap
+	static vector<unsigned char> downsample(const vector<unsigned char> &rgba, unsigned int width, unsigned int height)
+	{
+		unsigned int w = width > 1 ? width / 2 : 1, h = height > 1 ? height / 2 : 1;
+		vector<unsigned char> result((size_t)w * h * 4);
+		for (unsigned int y = 0; y < h; y++)
+		{
+			for (unsigned int x = 0; x < w; x++)
+			{
+				unsigned int x0 = x * 2, y0 = y * 2;
+				unsigned int x1 = x0 + 1 < width ? x0 + 1 : x0, y1 = y0 + 1 < height ? y0 + 1 : y0;
+				for (unsigned int c = 0; c < 4; c++)
+				{
+					unsigned int sum = rgba[((size_t)y0 * width + x0) * 4 + c] + rgba[((size_t)y0 * width + x1) * 4 + c]
+						+ rgba[((size_t)y1 * width + x0) * 4 + c] + rgba[((size_t)y1 * width + x1) * 4 + c];
+					result[((size_t)y * w + x) * 4 + c] = (sum + 2) / 4;
+				}
+			}
+		}
+		return result;
+	}
+
+	static vector<unsigned char> encode(uint32_t format, const vector<unsigned char> &rgba, unsigned int width, unsigned int height)
+	{
+		vector<unsigned char> out(TextureContainer::LevelSize(format, width, height));
+		if ( !TextureContainer::IsCompressed(format) )
+		{
+			unsigned int components = TextureContainer::Components(format);
+			for (size_t i = 0; i < (size_t)width * height; i++)
+				memcpy(&out[i * components], &rgba[i * 4], components);
+			return out;
+		}
+
+		unsigned int blockSize = format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+		unsigned char *block = out.data();
+		for (unsigned int by = 0; by < height; by += 4)
+		{
+			for (unsigned int bx = 0; bx < width; bx += 4)
+			{
+				// Blocks past the edge repeat the last row and column
+				unsigned char pixels[16 * 4];
+				for (unsigned int y = 0; y < 4; y++)
+				{
+					for (unsigned int x = 0; x < 4; x++)
+					{
+						unsigned int sx = bx + x < width ? bx + x : width - 1;
+						unsigned int sy = by + y < height ? by + y : height - 1;
+						memcpy(&pixels[(y * 4 + x) * 4], &rgba[((size_t)sy * width + sx) * 4], 4);
+					}
+				}
+
+				if ( format == TEXTURE_FORMAT_BC1 )
+					BcEncoder::EncodeBC1(pixels, block);
+				else if ( format == TEXTURE_FORMAT_BC3 )
+					BcEncoder::EncodeBC3(pixels, block);
+				else
+					BcEncoder::EncodeBC5(pixels, block);
+				block += blockSize;
+			}
+		}
+		return out;
+	}
+};
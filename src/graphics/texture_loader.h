@@ -0,0 +1,302 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../contrib/stb_image.h"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include "../core/hash.h"
+#include "../core/thread_pool.h"
+#include "../core/vfs.h"
+#include "texture_container.h"
+
+// From GL_EXT_texture_compression_s3tc, not part of core GL
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+using namespace std;
+
+// Pixels decoded on a worker thread, waiting to be uploaded on the GL thread
+struct TextureImage
+{
+	string filename;
+	vector<unsigned char> fileData;
+	uint64_t contentHash;
+	int width;
+	int height;
+	int components;
+	// Size of level 0 once decoded, mipmaps not included
+	size_t bytes;
+	unsigned char *data;
+	// fileData is a TextureContainer (tile.png.ctex) and is uploaded as is instead of data
+	bool cooked;
+};
+
+class TextureLoader
+{
+ public:
+	// Must match the flag the game used to call stbi_set_flip_vertically_on_load with, cooked
+	// textures flipped the other way are ignored
+	static void SetFlipVertically(bool flip)
+	{
+		stbi_set_flip_vertically_on_load(flip);
+		flipVertically() = flip;
+	}
+
+	// Reads the encoded file and hashes it, the pixels are decoded separately so files with
+	// an already known hash never get decoded. An up to date cooked container is read in
+	// place of the source unless allowCooked is false. CPU only, safe to call from any thread.
+	static TextureImage Read(const string &filename, bool allowCooked = true)
+	{
+		TextureImage image;
+		image.filename = filename;
+		image.contentHash = 0;
+		image.width = image.height = image.components = 0;
+		image.bytes = 0;
+		image.data = NULL;
+		image.cooked = allowCooked && hasCooked(filename) && Vfs::Get().Read(TextureContainer::CookedPath(filename), image.fileData)
+			&& flippedAsLoaded(image.fileData);
+
+		if ( !image.cooked && !Vfs::Get().Read(filename, image.fileData) )
+		{
+			image.fileData.clear();
+			return image;
+		}
+		image.contentHash = HashBytes(image.fileData.data(), image.fileData.size());
+		return image;
+	}
+
+	static void Decode(TextureImage &image)
+	{
+		if ( image.cooked )
+		{
+			const TextureContainerHeader *header = TextureContainer::Parse(image.fileData.data(), image.fileData.size());
+			if ( header )
+			{
+				image.width = header->width;
+				image.height = header->height;
+				image.components = TextureContainer::Components(header->format);
+				image.bytes = TextureContainer::Level(header, 0)->size;
+				return;
+			}
+			cout << "ERROR::TEXTURE::INVALID_CONTAINER::" << TextureContainer::CookedPath(image.filename) << endl;
+			image = Read(image.filename, false);
+		}
+
+		if ( !image.fileData.empty() )
+			image.data = stbi_load_from_memory(image.fileData.data(), image.fileData.size(), &image.width, &image.height, &image.components, 0);
+		image.bytes = image.data ? (size_t)image.width * image.height * image.components : 0;
+		vector<unsigned char>().swap(image.fileData);
+	}
+
+	static TextureImage Decode(const string &filename)
+	{
+		TextureImage image = Read(filename);
+		Decode(image);
+		return image;
+	}
+
+	// Frees the pixels of a decoded image, cooked or not
+	static void Free(TextureImage &image)
+	{
+		if ( image.data )
+			stbi_image_free(image.data);
+		image.data = NULL;
+		vector<unsigned char>().swap(image.fileData);
+		image.cooked = false;
+	}
+
+	// Uploads into textureID and frees the pixels. Must run on the GL thread.
+	static void Upload(TextureImage &image, unsigned int textureID)
+	{
+		if ( image.cooked )
+		{
+			if ( uploadCooked(image, textureID) )
+			{
+				Free(image);
+				return;
+			}
+			// No driver support for the block format, decode the source instead
+			image = Read(image.filename, false);
+			Decode(image);
+		}
+
+		if ( !image.data )
+		{
+			cout << "Texture failed to load at path: " << image.filename << endl;
+			return;
+		}
+
+		GLenum format = GL_RGB;
+		if (image.components == 1)
+			format = GL_RED;
+		else if (image.components == 3)
+			format = GL_RGB;
+		else if (image.components == 4)
+			format = GL_RGBA;
+
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+		// Back to the GL default, TextureResidency lowers it on reduced textures and a reload
+		// or restore into the same id must get the full chain
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		Free(image);
+	}
+
+	// Uploads six decoded faces in +X, -X, +Y, -Y, +Z, -Z order. Cooked faces only provide
+	// level 0, the cubemap is not mipmapped.
+	static void UploadCubemap(vector<TextureImage> &faces, unsigned int textureID)
+	{
+		// Every face needs the same internal format, mixed faces all use their sources
+		bool cooked = true;
+		for (unsigned int i = 0; i < faces.size(); i++)
+			cooked = cooked && faces[i].cooked && cookedFormat(faces[i]) == cookedFormat(faces[0]) && supportsFormat(cookedFormat(faces[i]));
+		for (unsigned int i = 0; i < faces.size() && !cooked; i++)
+		{
+			if ( faces[i].cooked )
+			{
+				faces[i] = Read(faces[i].filename, false);
+				Decode(faces[i]);
+			}
+		}
+
+		glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+		for (unsigned int i = 0; i < faces.size(); i++)
+		{
+			if ( faces[i].cooked )
+			{
+				uploadCookedLevel(faces[i], GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0);
+				Free(faces[i]);
+			}
+			else if (faces[i].data)
+			{
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+										 0, GL_RGB, faces[i].width, faces[i].height, 0, GL_RGB, GL_UNSIGNED_BYTE, faces[i].data
+					);
+				Free(faces[i]);
+			}
+			else
+			{
+				std::cout << "Cubemap tex failed to load at path: " << faces[i].filename << std::endl;
+			}
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+
+ private:
+	static bool &flipVertically()
+	{
+		static bool flip = false;
+		return flip;
+	}
+
+	// The cooked container exists and is not older than its source
+	static bool hasCooked(const string &filename)
+	{
+		int64_t sourceTime, cookedTime;
+		uint64_t size;
+		if ( !Vfs::Get().Stat(TextureContainer::CookedPath(filename), &cookedTime, &size) )
+			return false;
+		return !Vfs::Get().Stat(filename, &sourceTime, &size) || cookedTime >= sourceTime;
+	}
+
+	// Containers flipped the other way than uncooked images are loaded are not used
+	static bool flippedAsLoaded(const vector<unsigned char> &container)
+	{
+		if ( container.size() < sizeof(TextureContainerHeader) )
+			return false;
+		const TextureContainerHeader *header = (const TextureContainerHeader *)container.data();
+		return ((header->flags & TEXTURE_CONTAINER_FLIPPED) != 0) == flipVertically();
+	}
+
+	// Format of a decoded cooked image
+	static uint32_t cookedFormat(const TextureImage &image)
+	{
+		return ((const TextureContainerHeader *)image.fileData.data())->format;
+	}
+
+	// S3TC is an extension, RGTC and the uncompressed formats are core GL 3.0
+	static bool supportsFormat(uint32_t format)
+	{
+		if ( format != TEXTURE_FORMAT_BC1 && format != TEXTURE_FORMAT_BC3 )
+			return true;
+
+		static int s3tc = -1;
+		if ( s3tc < 0 )
+		{
+			s3tc = 0;
+			GLint count = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+			for (GLint i = 0; i < count; i++)
+			{
+				const char *name = (const char *)glGetStringi(GL_EXTENSIONS, i);
+				if ( name && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0 )
+					s3tc = 1;
+			}
+		}
+		return s3tc == 1;
+	}
+
+	// Uploads one mip level of a decoded cooked image to target (already bound), the format
+	// must be supported
+	static void uploadCookedLevel(const TextureImage &image, GLenum target, unsigned int level)
+	{
+		const TextureContainerHeader *header = (const TextureContainerHeader *)image.fileData.data();
+		const TextureContainerLevel *entry = TextureContainer::Level(header, level);
+		const unsigned char *pixels = image.fileData.data() + entry->offset;
+		if ( TextureContainer::IsCompressed(header->format) )
+		{
+			static const GLenum compressedFormats[] = { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RG_RGTC2 };
+			GLenum format = compressedFormats[header->format - TEXTURE_FORMAT_BC1];
+			glCompressedTexImage2D(target, level, format, entry->width, entry->height, 0, entry->size, pixels);
+			return;
+		}
+
+		static const GLenum formats[] = { GL_RED, GL_RGB, GL_RGBA };
+		GLenum format = formats[header->format];
+		// Rows are tightly packed
+		GLint alignment;
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(target, level, format, entry->width, entry->height, 0, format, GL_UNSIGNED_BYTE, pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+	}
+
+	static bool uploadCooked(const TextureImage &image, unsigned int textureID)
+	{
+		const TextureContainerHeader *header = TextureContainer::Parse(image.fileData.data(), image.fileData.size());
+		if ( !header || !supportsFormat(header->format) )
+			return false;
+
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		for (unsigned int level = 0; level < header->mipCount; level++)
+			uploadCookedLevel(image, GL_TEXTURE_2D, level);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header->mipCount - 1);
+
+		GLint wrap = (header->flags & TEXTURE_CONTAINER_CLAMP) ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		return true;
+	}
+};
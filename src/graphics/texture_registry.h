@@ -0,0 +1,409 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <iostream>
+#include "../core/hash.h"
+#include "../core/startup_profiler.h"
+#include "../core/thread_pool.h"
+#include "texture_loader.h"
+#include "texture_residency.h"
+
+using namespace std;
+
+// Process wide owner of every file backed texture. A file is looked up by its canonical
+// path first and by the hash of its content second, so the same image reached through two
+// paths (or copied next to two models) is decoded and uploaded only once.
+// Every Acquire must be paired with a Release, the GL texture is deleted with the last one.
+class TextureRegistry
+{
+ public:
+	static TextureRegistry &Get()
+	{
+		static TextureRegistry registry;
+		return registry;
+	}
+
+	unsigned int Acquire(const string &filename)
+	{
+		return AcquireBatch(vector<string>(1, filename))[0];
+	}
+
+	// Files that are not resident yet are read, hashed and decoded on the shared pool and
+	// uploaded together on the calling (GL) thread. Ids are in the order of filenames.
+	vector<unsigned int> AcquireBatch(const vector<string> &filenames)
+	{
+		ProfileScope profile(filenames.size() == 1 ? "texture " + filenames[0] : "textures " + to_string(filenames.size()) + " files");
+		vector<unsigned int> ids(filenames.size(), 0);
+		vector<string> keys(filenames.size());
+		vector<unsigned int> missing;
+		for (unsigned int i = 0; i < filenames.size(); i++)
+		{
+			keys[i] = CanonicalPath(filenames[i]);
+			unordered_map<string, unsigned int>::iterator found = byPath.find(keys[i]);
+			if ( found != byPath.end() )
+				ids[i] = addRef(found->second);
+			else
+				missing.push_back(i);
+		}
+		if ( missing.empty() )
+			return ids;
+
+		vector<TextureImage> images(missing.size());
+		ThreadPool::Shared().ParallelFor(missing.size(), [&](unsigned int i) {
+			images[i] = TextureLoader::Read(filenames[missing[i]]);
+		});
+
+		// Only decode content we have not seen under another path (or earlier in this batch).
+		// Like findContent, files that could not be read (hash 0) are never shared.
+		vector<unsigned int> toDecode;
+		unordered_map<uint64_t, unsigned int> batchContent;
+		for (unsigned int i = 0; i < images.size(); i++)
+		{
+			unsigned int index = missing[i];
+			uint64_t contentHash = images[i].contentHash;
+			unsigned int id = findContent(contentHash, GL_TEXTURE_2D);
+			if ( id == 0 && (contentHash == 0 || batchContent.count(contentHash) == 0) )
+			{
+				if ( contentHash != 0 )
+					batchContent[contentHash] = i;
+				toDecode.push_back(i);
+				continue;
+			}
+			if ( id != 0 )
+			{
+				ids[index] = addRef(id);
+				addPath(keys[index], id);
+			}
+		}
+
+		ThreadPool::Shared().ParallelFor(toDecode.size(), [&](unsigned int i) {
+			TextureLoader::Decode(images[toDecode[i]]);
+		});
+
+		for (unsigned int i = 0; i < toDecode.size(); i++)
+		{
+			TextureImage &image = images[toDecode[i]];
+			unsigned int index = missing[toDecode[i]];
+
+			unsigned int id;
+			glGenTextures(1, &id);
+			TextureLoader::Upload(image, id);
+			insert(id, GL_TEXTURE_2D, keys[index], image.contentHash, image.bytes);
+			track(id, filenames[index], image.bytes);
+			ids[index] = id;
+		}
+
+		// Duplicates inside this batch share the texture uploaded above
+		for (unsigned int i = 0; i < images.size(); i++)
+		{
+			unsigned int index = missing[i];
+			if ( ids[index] != 0 )
+				continue;
+
+			unsigned int id = ids[missing[batchContent[images[i].contentHash]]];
+			ids[index] = addRef(id);
+			if ( byPath.count(keys[index]) == 0 )
+				addPath(keys[index], id);
+		}
+		return ids;
+	}
+
+	// For images read and decoded by the caller, e.g. on a loader thread. If the file turned
+	// out to be resident already the pixels are dropped and the existing texture is shared.
+	unsigned int AcquireDecoded(const string &filename, TextureImage &image)
+	{
+		string key = CanonicalPath(filename);
+		unsigned int id = 0;
+		unordered_map<string, unsigned int>::iterator found = byPath.find(key);
+		if ( found != byPath.end() )
+			id = found->second;
+		else
+			id = findContent(image.contentHash, GL_TEXTURE_2D);
+
+		if ( id != 0 )
+		{
+			if ( byPath.count(key) == 0 )
+				addPath(key, id);
+			TextureLoader::Free(image);
+			return addRef(id);
+		}
+
+		if ( !image.data )
+			TextureLoader::Decode(image);
+
+		glGenTextures(1, &id);
+		TextureLoader::Upload(image, id);
+		insert(id, GL_TEXTURE_2D, key, image.contentHash, image.bytes);
+		track(id, filename, image.bytes);
+		return id;
+	}
+
+	// faces in +X, -X, +Y, -Y, +Z, -Z order
+	unsigned int AcquireCubemap(const vector<string> &faces)
+	{
+		ProfileScope profile("cubemap " + (faces.empty() ? string() : faces[0]));
+		string key = "cubemap:";
+		for (unsigned int i = 0; i < faces.size(); i++)
+			key += CanonicalPath(faces[i]) + "|";
+
+		unordered_map<string, unsigned int>::iterator found = byPath.find(key);
+		if ( found != byPath.end() )
+			return addRef(found->second);
+
+		vector<TextureImage> images(faces.size());
+		ThreadPool::Shared().ParallelFor(faces.size(), [&](unsigned int i) {
+			images[i] = TextureLoader::Read(faces[i]);
+		});
+
+		uint64_t contentHash = cubemapHash(images);
+		unsigned int id = findContent(contentHash, GL_TEXTURE_CUBE_MAP);
+		if ( id != 0 )
+		{
+			addPath(key, id);
+			return addRef(id);
+		}
+
+		ThreadPool::Shared().ParallelFor(images.size(), [&](unsigned int i) {
+			TextureLoader::Decode(images[i]);
+		});
+
+		glGenTextures(1, &id);
+		TextureLoader::UploadCubemap(images, id);
+
+		size_t bytes = 0;
+		for (unsigned int i = 0; i < images.size(); i++)
+			bytes += images[i].bytes;
+		insert(id, GL_TEXTURE_CUBE_MAP, key, contentHash, bytes);
+		return id;
+	}
+
+	// Reads path (canonical) again and uploads it into every texture made from it, cubemaps
+	// using it as a face included, keeping their ids. Textures shared by content with another
+	// file change for that file too. If the file does not decode the old pixels are kept.
+	// Returns how many textures were updated.
+	unsigned int Reload(const string &path)
+	{
+		unsigned int reloaded = 0;
+		unordered_map<string, unsigned int>::iterator found = byPath.find(path);
+		if ( found != byPath.end() )
+		{
+			TextureImage image = TextureLoader::Read(path);
+			TextureLoader::Decode(image);
+			if ( image.bytes == 0 )
+				cout << "ERROR::TEXTURE::RELOAD_FAILED::" << path << endl;
+			else
+			{
+				TextureLoader::Upload(image, found->second);
+				updateContent(found->second, image.contentHash, image.bytes);
+				track(found->second, path, image.bytes);
+				reloaded++;
+			}
+		}
+
+		vector<pair<unsigned int, vector<string> > > cubemaps;
+		for (unordered_map<string, unsigned int>::iterator it = byPath.begin(); it != byPath.end(); ++it)
+		{
+			vector<string> faces = cubemapFaces(it->first);
+			if ( find(faces.begin(), faces.end(), path) != faces.end() )
+				cubemaps.push_back(make_pair(it->second, faces));
+		}
+		for (unsigned int i = 0; i < cubemaps.size(); i++)
+		{
+			const vector<string> &faces = cubemaps[i].second;
+			vector<TextureImage> images(faces.size());
+			size_t bytes = 0;
+			for (unsigned int j = 0; j < faces.size(); j++)
+			{
+				images[j] = TextureLoader::Read(faces[j]);
+				TextureLoader::Decode(images[j]);
+				bytes = images[j].bytes == 0 || (j > 0 && bytes == 0) ? 0 : bytes + images[j].bytes;
+			}
+			if ( bytes == 0 )
+			{
+				cout << "ERROR::TEXTURE::RELOAD_FAILED::" << path << endl;
+				for (unsigned int j = 0; j < images.size(); j++)
+					TextureLoader::Free(images[j]);
+				continue;
+			}
+			TextureLoader::UploadCubemap(images, cubemaps[i].first);
+			updateContent(cubemaps[i].first, cubemapHash(images), bytes);
+			reloaded++;
+		}
+		return reloaded;
+	}
+
+	// Canonical path of every file a resident texture was made from, cubemap faces included
+	vector<string> Paths() const
+	{
+		vector<string> paths;
+		for (unordered_map<string, unsigned int>::const_iterator it = byPath.begin(); it != byPath.end(); ++it)
+		{
+			vector<string> faces = cubemapFaces(it->first);
+			if ( faces.empty() )
+				paths.push_back(it->first);
+			paths.insert(paths.end(), faces.begin(), faces.end());
+		}
+		return paths;
+	}
+
+	void Release(unsigned int id)
+	{
+		unordered_map<unsigned int, Entry>::iterator found = entries.find(id);
+		if ( found == entries.end() )
+			return;
+
+		Entry &entry = found->second;
+		if ( --entry.refCount > 0 )
+			return;
+
+		for (unsigned int i = 0; i < entry.paths.size(); i++)
+			byPath.erase(entry.paths[i]);
+		byContent.erase(contentKey(entry.contentHash, entry.target));
+		TextureResidency::Get().Untrack(id);
+		glDeleteTextures(1, &id);
+		entries.erase(found);
+	}
+
+	void Release(const vector<unsigned int> &ids)
+	{
+		for (unsigned int i = 0; i < ids.size(); i++)
+			Release(ids[i]);
+	}
+
+	unsigned int TextureCount() const { return entries.size(); }
+
+	// Changes whenever a path is added to Paths, e.g. for watching them
+	unsigned int PathsGeneration() const { return pathsGeneration; }
+
+	// Whether filename is loaded already, Acquire then only adds a reference
+	bool IsResident(const string &filename) const
+	{
+		return byPath.count(CanonicalPath(filename)) != 0;
+	}
+
+	// Size of the level 0 images as uploaded (block compressed for cooked textures), mipmaps
+	// not included
+	size_t ResidentBytes() const
+	{
+		size_t total = 0;
+		for (unordered_map<unsigned int, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+			total += it->second.bytes;
+		return total;
+	}
+
+	static string CanonicalPath(const string &filename)
+	{
+		char resolved[PATH_MAX];
+		if ( realpath(filename.c_str(), resolved) )
+			return string(resolved);
+		return filename;
+	}
+
+ private:
+	struct Entry
+	{
+		GLenum target;
+		unsigned int refCount;
+		uint64_t contentHash;
+		size_t bytes;
+		vector<string> paths;
+	};
+
+	unordered_map<string, unsigned int> byPath;
+	unordered_map<uint64_t, unsigned int> byContent;
+	unordered_map<unsigned int, Entry> entries;
+	unsigned int pathsGeneration;
+
+	TextureRegistry() : pathsGeneration(0) {}
+	TextureRegistry(const TextureRegistry &);
+	TextureRegistry &operator=(const TextureRegistry &);
+
+	static uint64_t contentKey(uint64_t contentHash, GLenum target)
+	{
+		return HashBytes(&target, sizeof(target), contentHash);
+	}
+
+	unsigned int findContent(uint64_t contentHash, GLenum target)
+	{
+		// A hash of 0 means the file could not be read, never share those
+		if ( contentHash == 0 )
+			return 0;
+
+		unordered_map<uint64_t, unsigned int>::iterator found = byContent.find(contentKey(contentHash, target));
+		return found == byContent.end() ? 0 : found->second;
+	}
+
+	static uint64_t cubemapHash(const vector<TextureImage> &faces)
+	{
+		uint64_t contentHash = HASH_SEED;
+		for (unsigned int i = 0; i < faces.size(); i++)
+			contentHash = HashBytes(&faces[i].contentHash, sizeof(uint64_t), contentHash);
+		return contentHash;
+	}
+
+	// The face paths of a "cubemap:" key, nothing for other keys
+	static vector<string> cubemapFaces(const string &key)
+	{
+		vector<string> faces;
+		static const string prefix = "cubemap:";
+		if ( key.compare(0, prefix.size(), prefix) != 0 )
+			return faces;
+		for (size_t start = prefix.size(), end; (end = key.find('|', start)) != string::npos; start = end + 1)
+			faces.push_back(key.substr(start, end - start));
+		return faces;
+	}
+
+	// After a reload the texture is found by its new content
+	void updateContent(unsigned int id, uint64_t contentHash, size_t bytes)
+	{
+		Entry &entry = entries[id];
+		unordered_map<uint64_t, unsigned int>::iterator old = byContent.find(contentKey(entry.contentHash, entry.target));
+		if ( old != byContent.end() && old->second == id )
+			byContent.erase(old);
+
+		entry.contentHash = contentHash;
+		entry.bytes = bytes;
+		if ( contentHash != 0 && byContent.count(contentKey(contentHash, entry.target)) == 0 )
+			byContent[contentKey(contentHash, entry.target)] = id;
+	}
+
+	// Only textures that uploaded, a failed file is left as the empty texture it is
+	static void track(unsigned int id, const string &filename, size_t bytes)
+	{
+		if ( bytes > 0 )
+			TextureResidency::Get().Track(id, filename, bytes);
+	}
+
+	void addPath(const string &key, unsigned int id)
+	{
+		byPath[key] = id;
+		entries[id].paths.push_back(key);
+		pathsGeneration++;
+	}
+
+	unsigned int addRef(unsigned int id)
+	{
+		entries[id].refCount++;
+		return id;
+	}
+
+	void insert(unsigned int id, GLenum target, const string &key, uint64_t contentHash, size_t bytes)
+	{
+		Entry entry;
+		entry.target = target;
+		entry.refCount = 1;
+		entry.contentHash = contentHash;
+		entry.bytes = bytes;
+		entries[id] = entry;
+
+		addPath(key, id);
+		if ( contentHash != 0 )
+			byContent[contentKey(contentHash, target)] = id;
+	}
+};
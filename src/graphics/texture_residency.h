@@ -0,0 +1,314 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include "../core/thread_pool.h"
+#include "texture_loader.h"
+
+using namespace std;
+
+// Keeps the file backed 2D textures inside a video memory budget. Memory is estimated from
+// the level 0 size and the mip levels still present. While over budget the least recently
+// used texture gives up its top mip level each frame, in place so its id stays valid, and one
+// unused for EVICT_AFTER_FRAMES frames is cut down to its smallest level at once. A reduction
+// reads the kept levels back from the GPU, so only one is done per frame and a budget that
+// drops a lot is reached over several frames. A reduced texture
+// that is drawn again is read and decoded on the shared pool and uploaded at full size as
+// soon as it fits. Textures drawn in the current frame are only reduced when nothing else is.
+//
+// TextureRegistry tracks the textures it uploads, draws mark theirs with Touch and Update
+// runs once per frame on the GL thread. A budget of 0 (the default) never reduces anything.
+class TextureResidency
+{
+ public:
+	static const unsigned int EVICT_AFTER_FRAMES = 300;
+
+	static TextureResidency &Get()
+	{
+		static TextureResidency residency;
+		return residency;
+	}
+
+	void SetBudget(size_t bytes) { budget = bytes; }
+	size_t Budget() const { return budget; }
+
+	// Estimated size of the tracked textures as they are now, mipmaps included
+	size_t ResidentBytes() const { return residentBytes; }
+	// Estimated size of the tracked textures at full resolution
+	size_t FullBytes() const { return fullBytes; }
+
+	// Number of tracked textures missing their top levels
+	unsigned int ReducedCount() const
+	{
+		unsigned int count = 0;
+		for (unordered_map<unsigned int, Resident>::const_iterator it = residents.begin(); it != residents.end(); ++it)
+			count += it->second.dropped > 0;
+		return count;
+	}
+
+	// Called for a texture just uploaded at full resolution from filename, with bytes the size
+	// of its level 0. Tracking it again, e.g. after a reload, starts over.
+	void Track(unsigned int id, const string &filename, size_t bytes)
+	{
+		Untrack(id);
+
+		GLint width = 0, height = 0, maxLevel = 0;
+		glBindTexture(GL_TEXTURE_2D, id);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+
+		Resident resident;
+		resident.filename = filename;
+		resident.levelBytes = bytes;
+		resident.levels = 1;
+		for (GLint size = width > height ? width : height; size > 1 && (GLint)resident.levels <= maxLevel; size /= 2)
+			resident.levels++;
+		resident.dropped = 0;
+		resident.lastUsed = frame;
+		resident.generation = ++generations;
+		resident.streaming = false;
+		residents[id] = resident;
+
+		residentBytes += currentBytes(resident);
+		fullBytes += chainBytes(bytes, resident.levels);
+	}
+
+	// Called before the texture is deleted
+	void Untrack(unsigned int id)
+	{
+		unordered_map<unsigned int, Resident>::iterator found = residents.find(id);
+		if ( found == residents.end() )
+			return;
+
+		Resident &resident = found->second;
+		residentBytes -= currentBytes(resident);
+		fullBytes -= chainBytes(resident.levelBytes, resident.levels + resident.dropped);
+		if ( resident.streaming )
+			pendingBytes -= chainBytes(resident.levelBytes, resident.levels + resident.dropped) - currentBytes(resident);
+		residents.erase(found);
+	}
+
+	// Marks the texture as drawn this frame, call where it is bound for drawing
+	void Touch(unsigned int id)
+	{
+		unordered_map<unsigned int, Resident>::iterator found = residents.find(id);
+		if ( found != residents.end() )
+			found->second.lastUsed = frame;
+	}
+
+	// Uploads what finished streaming, requests what was drawn reduced and fits now, then
+	// reduces the least recently used texture if over budget. Once per frame on the GL thread,
+	// before drawing.
+	void Update()
+	{
+		finishStreaming();
+		requestStreaming();
+		if ( budget > 0 )
+			enforceBudget();
+		frame++;
+	}
+
+ private:
+	struct Resident
+	{
+		// As given to TextureRegistry, so it is read again the same way (archive included)
+		string filename;
+		size_t levelBytes;
+		// Levels present now and how many were dropped from the top
+		unsigned int levels;
+		unsigned int dropped;
+		unsigned int lastUsed;
+		// Streamed pixels for an older upload of the same id are discarded
+		unsigned int generation;
+		bool streaming;
+	};
+
+	struct Streamed
+	{
+		unsigned int id;
+		unsigned int generation;
+		TextureImage image;
+	};
+
+	unordered_map<unsigned int, Resident> residents;
+	size_t budget;
+	size_t residentBytes;
+	size_t fullBytes;
+	// Bytes the requested restores will add once uploaded
+	size_t pendingBytes;
+	unsigned int frame;
+	unsigned int generations;
+
+	mutex streamedMutex;
+	vector<Streamed> streamed;
+
+	TextureResidency() : budget(0), residentBytes(0), fullBytes(0), pendingBytes(0), frame(0), generations(0) {}
+	TextureResidency(const TextureResidency &);
+	TextureResidency &operator=(const TextureResidency &);
+
+	// Each level is a quarter of the one above
+	static size_t chainBytes(size_t levelBytes, unsigned int levels)
+	{
+		size_t total = 0;
+		for (unsigned int i = 0; i < levels && levelBytes > 0; i++, levelBytes /= 4)
+			total += levelBytes;
+		return total;
+	}
+
+	static size_t currentBytes(const Resident &resident)
+	{
+		return chainBytes(resident.levelBytes >> (2 * resident.dropped), resident.levels);
+	}
+
+	void finishStreaming()
+	{
+		vector<Streamed> done;
+		{
+			lock_guard<mutex> lock(streamedMutex);
+			done.swap(streamed);
+		}
+
+		for (unsigned int i = 0; i < done.size(); i++)
+		{
+			unordered_map<unsigned int, Resident>::iterator found = residents.find(done[i].id);
+			if ( found == residents.end() || found->second.generation != done[i].generation )
+			{
+				TextureLoader::Free(done[i].image);
+				continue;
+			}
+
+			Resident &resident = found->second;
+			size_t full = chainBytes(resident.levelBytes, resident.levels + resident.dropped);
+			pendingBytes -= full - currentBytes(resident);
+			resident.streaming = false;
+			if ( done[i].image.bytes == 0 )
+			{
+				cout << "ERROR::TEXTURE::RESIDENCY::STREAM_FAILED::" << resident.filename << endl;
+				TextureLoader::Free(done[i].image);
+				continue;
+			}
+
+			// Upload generates or sets every level again, the reduced chain is replaced
+			TextureLoader::Upload(done[i].image, done[i].id);
+			residentBytes += full - currentBytes(resident);
+			resident.levels += resident.dropped;
+			resident.dropped = 0;
+		}
+	}
+
+	void requestStreaming()
+	{
+		for (unordered_map<unsigned int, Resident>::iterator it = residents.begin(); it != residents.end(); ++it)
+		{
+			Resident &resident = it->second;
+			if ( resident.dropped == 0 || resident.streaming || resident.lastUsed != frame )
+				continue;
+
+			size_t extra = chainBytes(resident.levelBytes, resident.levels + resident.dropped) - currentBytes(resident);
+			if ( budget > 0 && residentBytes + pendingBytes + extra > budget )
+				continue;
+
+			resident.streaming = true;
+			pendingBytes += extra;
+			unsigned int id = it->first;
+			unsigned int generation = resident.generation;
+			string filename = resident.filename;
+			ThreadPool::Shared().Enqueue([this, id, generation, filename]() {
+				Streamed result;
+				result.id = id;
+				result.generation = generation;
+				result.image = TextureLoader::Decode(filename);
+				lock_guard<mutex> lock(streamedMutex);
+				streamed.push_back(result);
+			});
+		}
+	}
+
+	// One reduction at most, dropLevels stalls on the readback of the levels it keeps
+	void enforceBudget()
+	{
+		if ( residentBytes <= budget )
+			return;
+
+		// Least recently used first, the largest of those
+		unordered_map<unsigned int, Resident>::iterator victim = residents.end();
+		for (unordered_map<unsigned int, Resident>::iterator it = residents.begin(); it != residents.end(); ++it)
+		{
+			const Resident &resident = it->second;
+			if ( resident.levels <= 1 || resident.streaming )
+				continue;
+			if ( victim == residents.end() || resident.lastUsed < victim->second.lastUsed
+					 || (resident.lastUsed == victim->second.lastUsed && currentBytes(resident) > currentBytes(victim->second)) )
+				victim = it;
+		}
+		if ( victim == residents.end() )
+			return;
+
+		Resident &resident = victim->second;
+		unsigned int count = frame - resident.lastUsed >= EVICT_AFTER_FRAMES ? resident.levels - 1 : 1;
+		size_t before = currentBytes(resident);
+		if ( !dropLevels(victim->first, resident, count) )
+		{
+			cout << "ERROR::TEXTURE::RESIDENCY::CANNOT_REDUCE::" << resident.filename << endl;
+			return;
+		}
+		residentBytes -= before - currentBytes(resident);
+	}
+
+	// Moves levels count.. down to 0.. and releases the rest, GL has no way to drop a level
+	// from the top of an existing texture
+	bool dropLevels(unsigned int id, Resident &resident, unsigned int count)
+	{
+		glBindTexture(GL_TEXTURE_2D, id);
+		GLint compressed = GL_FALSE, internalFormat = GL_RGBA8;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+
+		unsigned int kept = resident.levels - count;
+		vector<vector<unsigned char> > pixels(kept);
+		vector<GLint> widths(kept), heights(kept);
+		for (unsigned int i = 0; i < kept; i++)
+		{
+			GLint level = count + i;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &widths[i]);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &heights[i]);
+			if ( widths[i] == 0 || heights[i] == 0 )
+				return false;
+
+			if ( compressed )
+			{
+				GLint size = 0;
+				glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+				pixels[i].resize(size);
+				glGetCompressedTexImage(GL_TEXTURE_2D, level, pixels[i].data());
+			}
+			else
+			{
+				pixels[i].resize((size_t)widths[i] * heights[i] * 4);
+				glPixelStorei(GL_PACK_ALIGNMENT, 4);
+				glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels[i].data());
+			}
+		}
+
+		for (unsigned int i = 0; i < kept; i++)
+		{
+			if ( compressed )
+				glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, widths[i], heights[i], 0, pixels[i].size(), pixels[i].data());
+			else
+				glTexImage2D(GL_TEXTURE_2D, i, internalFormat, widths[i], heights[i], 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels[i].data());
+		}
+		// Empty levels free what is left of the old chain
+		for (unsigned int i = kept; i < resident.levels; i++)
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, kept - 1);
+
+		resident.levels = kept;
+		resident.dropped += count;
+		return true;
+	}
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <unordered_map>
+#include "../core/hash.h"
+
+using namespace std;
+
+// Locations of the uniforms of one program by name, filled by reflection when the program is
+// built so a lookup never calls the driver. Names get a slot that survives Shader::Reload,
+// only the location in it changes, which keeps Uniform handles valid across an edit. Names are
+// found by hash and then compared, a name whose hash is taken goes to a map by name.
+class UniformTable
+{
+ public:
+	// Every active uniform, struct members and array elements included (e.g. "lights[1].color",
+	// and "weights" as well as "weights[0]" for a plain array). Names that are gone keep their
+	// slot with location -1.
+	void Reflect(unsigned int program)
+	{
+		for (unsigned int i = 0; i < locations.size(); i++)
+			locations[i] = -1;
+
+		GLint count = 0;
+		glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			char name[256];
+			GLint size = 0;
+			GLenum type;
+			glGetActiveUniform(program, i, sizeof(name), NULL, &size, &type, name);
+			// Members of uniform blocks have no location
+			GLint location = glGetUniformLocation(program, name);
+			if ( location < 0 )
+				continue;
+
+			string full = name;
+			if ( size == 1 || full.size() < 3 || full.compare(full.size() - 3, 3, "[0]") != 0 )
+			{
+				locations[Slot(full)] = location;
+				continue;
+			}
+
+			string base = full.substr(0, full.size() - 3);
+			locations[Slot(base)] = location;
+			for (GLint element = 0; element < size; element++)
+			{
+				string elementName = base + "[" + to_string(element) + "]";
+				locations[Slot(elementName)] = glGetUniformLocation(program, elementName.c_str());
+			}
+		}
+	}
+
+	// Slot of name, added with location -1 if the program does not use it (yet)
+	unsigned int Slot(const string &name)
+	{
+		uint64_t key = HashString(name);
+		unordered_map<uint64_t, unsigned int>::iterator found = slots.find(key);
+		if ( found == slots.end() )
+		{
+			unsigned int slot = add(name);
+			slots[key] = slot;
+			return slot;
+		}
+		if ( names[found->second] == name )
+			return found->second;
+
+		map<string, unsigned int>::iterator collided = collisions.find(name);
+		if ( collided != collisions.end() )
+			return collided->second;
+
+		cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION::" << name << " and " << names[found->second] << endl;
+		unsigned int slot = add(name);
+		collisions[name] = slot;
+		return slot;
+	}
+
+	// -1 if the program has no such uniform, like glGetUniformLocation
+	GLint Location(const string &name) const
+	{
+		unordered_map<uint64_t, unsigned int>::const_iterator found = slots.find(HashString(name));
+		if ( found == slots.end() )
+			return -1;
+		if ( names[found->second] == name )
+			return locations[found->second];
+
+		map<string, unsigned int>::const_iterator collided = collisions.find(name);
+		return collided == collisions.end() ? -1 : locations[collided->second];
+	}
+
+	GLint LocationAt(unsigned int slot) const { return locations[slot]; }
+
+ private:
+	unordered_map<uint64_t, unsigned int> slots;
+	// Names whose hash belongs to another name, almost always empty
+	map<string, unsigned int> collisions;
+	// By slot
+	vector<string> names;
+	vector<GLint> locations;
+
+	unsigned int add(const string &name)
+	{
+		names.push_back(name);
+		locations.push_back(-1);
+		return locations.size() - 1;
+	}
+};
+
+inline void SetUniform(GLint location, bool value) { glUniform1i(location, (int)value); }
+inline void SetUniform(GLint location, int value) { glUniform1i(location, value); }
+inline void SetUniform(GLint location, float value) { glUniform1f(location, value); }
+inline void SetUniform(GLint location, const glm::vec2 &value) { glUniform2fv(location, 1, glm::value_ptr(value)); }
+inline void SetUniform(GLint location, const glm::vec3 &value) { glUniform3fv(location, 1, glm::value_ptr(value)); }
+inline void SetUniform(GLint location, const glm::vec4 &value) { glUniform4fv(location, 1, glm::value_ptr(value)); }
+inline void SetUniform(GLint location, const glm::mat3 &value) { glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+inline void SetUniform(GLint location, const glm::mat4 &value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+
+// One uniform of a Shader, resolved once and kept to be set every frame, e.g.
+//   Uniform<glm::mat4> model = shader.GetUniform<glm::mat4>("model");
+//   model.Set(transform);
+// Like the Shader setters it sets the program in use. A default constructed handle, or one
+// for a name the program does not use, sets nothing.
+template <typename T>
+class Uniform
+{
+ public:
+	Uniform() : table(NULL), slot(0) {}
+	Uniform(const UniformTable *table, unsigned int slot) : table(table), slot(slot) {}
+
+	GLint Location() const
+	{
+		return table ? table->LocationAt(slot) : -1;
+	}
+
+	void Set(const T &value) const
+	{
+		SetUniform(Location(), value);
+	}
+
+ private:
+	const UniformTable *table;
+	unsigned int slot;
+};
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+struct Vertex {
+  glm::vec3 Position;
+  glm::vec3 Normal;
+  glm::vec2 TexCoords;
+};
+
+// How each Vertex attribute is stored in the GPU buffer. The packed encodings need the
+// matching decode in the vertex shader, see DecodePosition/DecodeNormal in the shaders and
+// VertexFormat::ShaderFlags.
+enum PositionEncoding
+{
+	POSITION_FLOAT32,
+	POSITION_HALF,
+	// Normalized int16 relative to the mesh bounds
+	POSITION_SNORM16
+};
+
+enum NormalEncoding
+{
+	NORMAL_FLOAT32,
+	// Octahedral mapping stored as two normalized int16
+	NORMAL_OCT16,
+	NORMAL_INT_2_10_10_10
+};
+
+enum TexCoordEncoding
+{
+	TEXCOORD_FLOAT32,
+	TEXCOORD_HALF
+};
+
+// Bits of the vertexEncoding uniform
+const int VERTEX_ENCODING_QUANTIZED_POSITION = 1 << 0;
+const int VERTEX_ENCODING_OCTAHEDRAL_NORMAL = 1 << 1;
+
+struct VertexFormat
+{
+	PositionEncoding position;
+	NormalEncoding normal;
+	TexCoordEncoding texCoords;
+
+	VertexFormat(PositionEncoding position = POSITION_FLOAT32, NormalEncoding normal = NORMAL_FLOAT32, TexCoordEncoding texCoords = TEXCOORD_FLOAT32)
+		: position(position), normal(normal), texCoords(texCoords)
+	{
+	}
+
+	// 16 bytes per vertex instead of 32
+	static VertexFormat Packed()
+	{
+		return VertexFormat(POSITION_SNORM16, NORMAL_OCT16, TEXCOORD_HALF);
+	}
+
+	bool IsFloat() const
+	{
+		return position == POSITION_FLOAT32 && normal == NORMAL_FLOAT32 && texCoords == TEXCOORD_FLOAT32;
+	}
+
+	unsigned int PositionSize() const { return position == POSITION_FLOAT32 ? 12 : 8; }
+	unsigned int NormalSize() const { return normal == NORMAL_FLOAT32 ? 12 : 4; }
+	unsigned int TexCoordSize() const { return texCoords == TEXCOORD_FLOAT32 ? 8 : 4; }
+	unsigned int Stride() const { return PositionSize() + NormalSize() + TexCoordSize(); }
+
+	int ShaderFlags() const
+	{
+		int flags = 0;
+		if ( position == POSITION_SNORM16 )
+			flags |= VERTEX_ENCODING_QUANTIZED_POSITION;
+		if ( normal == NORMAL_OCT16 )
+			flags |= VERTEX_ENCODING_OCTAHEDRAL_NORMAL;
+		return flags;
+	}
+
+	// Points attributes 0 (position), 1 (normal) and 2 (texture coords) at the bound VBO
+	void SetupAttributes() const
+	{
+		GLsizei stride = Stride();
+		uintptr_t offset = 0;
+
+		glEnableVertexAttribArray(0);
+		if ( position == POSITION_FLOAT32 )
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+		else if ( position == POSITION_HALF )
+			glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offset);
+		else
+			glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, stride, (void*)offset);
+		offset += PositionSize();
+
+		glEnableVertexAttribArray(1);
+		if ( normal == NORMAL_FLOAT32 )
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+		else if ( normal == NORMAL_OCT16 )
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)offset);
+		else
+			glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offset);
+		offset += NormalSize();
+
+		glEnableVertexAttribArray(2);
+		if ( texCoords == TEXCOORD_FLOAT32 )
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+		else
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offset);
+	}
+};
+
+class VertexPacker
+{
+ public:
+	// Encodes vertices into format. For POSITION_SNORM16 the shader gets the position back
+	// with position * positionScale + positionBias.
+	static vector<unsigned char> Pack(const VertexFormat &format, const Vertex *vertices, unsigned int count, glm::vec3 *positionScale, glm::vec3 *positionBias)
+	{
+		glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			boundsMin = i == 0 ? vertices[i].Position : glm::min(boundsMin, vertices[i].Position);
+			boundsMax = i == 0 ? vertices[i].Position : glm::max(boundsMax, vertices[i].Position);
+		}
+		*positionBias = (boundsMin + boundsMax) * 0.5f;
+		*positionScale = glm::max((boundsMax - boundsMin) * 0.5f, glm::vec3(1e-6f));
+
+		unsigned int stride = format.Stride();
+		vector<unsigned char> packed((size_t)count * stride);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			unsigned char *out = &packed[(size_t)i * stride];
+			const Vertex &vertex = vertices[i];
+
+			if ( format.position == POSITION_FLOAT32 )
+				memcpy(out, &vertex.Position, 12);
+			else if ( format.position == POSITION_HALF )
+				writeHalf4(out, vertex.Position.x, vertex.Position.y, vertex.Position.z, 1.0f);
+			else
+			{
+				glm::vec3 local = (vertex.Position - *positionBias) / *positionScale;
+				writeSnorm16(out, local.x, local.y, local.z, 0.0f);
+			}
+			out += format.PositionSize();
+
+			if ( format.normal == NORMAL_FLOAT32 )
+				memcpy(out, &vertex.Normal, 12);
+			else if ( format.normal == NORMAL_OCT16 )
+			{
+				glm::vec2 oct = octahedralEncode(vertex.Normal);
+				int16_t encoded[2] = { snorm16(oct.x), snorm16(oct.y) };
+				memcpy(out, encoded, 4);
+			}
+			else
+			{
+				glm::vec3 n = safeNormalize(vertex.Normal);
+				uint32_t encoded = (snorm10(n.x)) | (snorm10(n.y) << 10) | (snorm10(n.z) << 20);
+				memcpy(out, &encoded, 4);
+			}
+			out += format.NormalSize();
+
+			if ( format.texCoords == TEXCOORD_FLOAT32 )
+				memcpy(out, &vertex.TexCoords, 8);
+			else
+			{
+				uint16_t encoded[2] = { FloatToHalf(vertex.TexCoords.x), FloatToHalf(vertex.TexCoords.y) };
+				memcpy(out, encoded, 4);
+			}
+		}
+		return packed;
+	}
+
+	static uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, 4);
+
+		uint32_t sign = (bits >> 16) & 0x8000;
+		int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+		uint32_t mantissa = bits & 0x7fffff;
+
+		if ( ((bits >> 23) & 0xff) == 0xff )
+			return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+		if ( exponent >= 31 )
+			return sign | 0x7c00;
+		if ( exponent <= 0 )
+		{
+			if ( exponent < -10 )
+				return sign;
+			mantissa |= 0x800000;
+			uint32_t shift = 14 - exponent;
+			uint32_t rounded = mantissa + (1 << (shift - 1));
+			return sign | (rounded >> shift);
+		}
+
+		uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+		// Round to nearest, a carry correctly bumps the exponent
+		if ( mantissa & 0x1000 )
+			half++;
+		return half;
+	}
+
+ private:
+	static glm::vec3 safeNormalize(glm::vec3 v)
+	{
+		float length = glm::length(v);
+		return length > 0.0f ? v / length : glm::vec3(0.0f, 0.0f, 1.0f);
+	}
+
+	static glm::vec2 octahedralEncode(glm::vec3 n)
+	{
+		n = safeNormalize(n);
+		n /= (fabsf(n.x) + fabsf(n.y) + fabsf(n.z));
+		glm::vec2 result(n.x, n.y);
+		if ( n.z < 0.0f )
+		{
+			result.x = (1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+			result.y = (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return result;
+	}
+
+	static int16_t snorm16(float value)
+	{
+		value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+		return (int16_t)lroundf(value * 32767.0f);
+	}
+
+	static uint32_t snorm10(float value)
+	{
+		value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+		return (uint32_t)lroundf(value * 511.0f) & 0x3ff;
+	}
+
+	static void writeSnorm16(unsigned char *out, float x, float y, float z, float w)
+	{
+		int16_t encoded[4] = { snorm16(x), snorm16(y), snorm16(z), snorm16(w) };
+		memcpy(out, encoded, 8);
+	}
+
+	static void writeHalf4(unsigned char *out, float x, float y, float z, float w)
+	{
+		uint16_t encoded[4] = { FloatToHalf(x), FloatToHalf(y), FloatToHalf(z), FloatToHalf(w) };
+		memcpy(out, encoded, 8);
+	}
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstring>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include "../core/vfs.h"
+
+// Read only Assimp stream over a VfsFile
+class VfsIOStream : public Assimp::IOStream
+{
+ public:
+	VfsIOStream() : position(0)
+	{
+	}
+
+	VfsFile file;
+
+	size_t Read(void *buffer, size_t size, size_t count)
+	{
+		if ( size == 0 )
+			return 0;
+		size_t available = (file.Size() - position) / size;
+		count = count < available ? count : available;
+		if ( count > 0 )
+			memcpy(buffer, file.Data() + position, size * count);
+		position += size * count;
+		return count;
+	}
+
+	size_t Write(const void *, size_t, size_t)
+	{
+		return 0;
+	}
+
+	aiReturn Seek(size_t offset, aiOrigin origin)
+	{
+		size_t base = origin == aiOrigin_SET ? 0 : (origin == aiOrigin_CUR ? position : file.Size());
+		if ( base + offset > file.Size() )
+			return aiReturn_FAILURE;
+		position = base + offset;
+		return aiReturn_SUCCESS;
+	}
+
+	size_t Tell() const { return position; }
+	size_t FileSize() const { return file.Size(); }
+	void Flush() {}
+
+ private:
+	size_t position;
+};
+
+// Lets Assimp open models and the files they reference (.mtl) through Vfs. Give the
+// importer a new one with SetIOHandler, it takes ownership.
+class VfsIOSystem : public Assimp::IOSystem
+{
+ public:
+	bool Exists(const char *path) const
+	{
+		return Vfs::Get().Exists(path);
+	}
+
+	char getOsSeparator() const
+	{
+		return '/';
+	}
+
+	Assimp::IOStream *Open(const char *path, const char *mode = "rb")
+	{
+		// Nothing in the game writes through Assimp
+		if ( strchr(mode, 'w') || strchr(mode, 'a') )
+			return NULL;
+
+		VfsIOStream *stream = new VfsIOStream();
+		if ( !Vfs::Get().Open(path, stream->file) )
+		{
+			delete stream;
+			return NULL;
+		}
+		return stream;
+	}
+
+	void Close(Assimp::IOStream *stream)
+	{
+		delete stream;
+	}
+};
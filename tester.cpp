@@ -214,69 +214,50 @@ int main()
 
 		// be sure to activate shader when setting uniforms/drawing objects
 		boxShader.use();
-		boxShader.setVec3("viewPos", camera.Position);
 		boxShader.setFloat("material.shininess", 32.0f);
 
-		/*
-			Here we set all the uniforms for the 5/6 types of lights we have. We have to set them manually and index 
-			the proper PointLight struct in the array to set each uniform variable. This can be done more code-friendly
-			by defining light types as classes and set their values in there, or by using a more efficient uniform approach
-			by using 'Uniform buffer objects', but that is something we'll discuss in the 'Advanced GLSL' tutorial.
-		*/
+		// Lights for both lit shaders, written to the light buffer once
+		LightUniforms &lights = LightUniforms::Get();
+		lights.Begin();
 		// directional light
-		boxShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-		boxShader.setVec3("dirLight.ambient", glm::vec3(0.01f));
-		boxShader.setVec3("dirLight.diffuse", glm::vec3(0.05f));
-		boxShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-		// point light 1
-		boxShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-		boxShader.setVec3("pointLights[0].ambient", 1.05f, 0.05f, 0.05f);
-		boxShader.setVec3("pointLights[0].diffuse", 1.8f, 0.8f, 0.8f);
-		boxShader.setVec3("pointLights[0].specular", 0.0f, 1.0f, 0.0f);
-		boxShader.setFloat("pointLights[0].constant", 1.0f);
-		boxShader.setFloat("pointLights[0].linear", 0.09);
-		boxShader.setFloat("pointLights[0].quadratic", 0.032);
-		// point light 2
-		boxShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-		boxShader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-		boxShader.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-		boxShader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-		boxShader.setFloat("pointLights[1].constant", 1.0f);
-		boxShader.setFloat("pointLights[1].linear", 0.09);
-		boxShader.setFloat("pointLights[1].quadratic", 0.032);
-		// point light 3
-		boxShader.setVec3("pointLights[2].position", pointLightPositions[2]);
-		boxShader.setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-		boxShader.setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-		boxShader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-		boxShader.setFloat("pointLights[2].constant", 1.0f);
-		boxShader.setFloat("pointLights[2].linear", 0.09);
-		boxShader.setFloat("pointLights[2].quadratic", 0.032);
-		// point light 4
-		boxShader.setVec3("pointLights[3].position", pointLightPositions[3]);
-		boxShader.setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-		boxShader.setVec3("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-		boxShader.setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-		boxShader.setFloat("pointLights[3].constant", 1.0f);
-		boxShader.setFloat("pointLights[3].linear", 0.09);
-		boxShader.setFloat("pointLights[3].quadratic", 0.032);
+		DirLightData dirLight = DirLightData();
+		dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+		dirLight.ambient = glm::vec3(0.01f);
+		dirLight.diffuse = glm::vec3(0.05f);
+		dirLight.specular = glm::vec3(0.5f);
+		lights.SetDirectionLight(dirLight);
+		// point lights, the first one red
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			PointLightData pointLight = PointLightData();
+			pointLight.position = pointLightPositions[i];
+			pointLight.ambient = i == 0 ? glm::vec3(1.05f, 0.05f, 0.05f) : glm::vec3(0.05f);
+			pointLight.diffuse = i == 0 ? glm::vec3(1.8f, 0.8f, 0.8f) : glm::vec3(0.8f);
+			pointLight.specular = i == 0 ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f);
+			pointLight.constant = 1.0f;
+			pointLight.linear = 0.09f;
+			pointLight.quadratic = 0.032f;
+			lights.AddPointLight(pointLight);
+		}
 		// spotLight
-		boxShader.setVec3("spotLight.position", camera.Position);
-		boxShader.setVec3("spotLight.direction", camera.Front);
-		boxShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-		boxShader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-		boxShader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-		boxShader.setFloat("spotLight.constant", 1.0f);
-		boxShader.setFloat("spotLight.linear", 0.09);
-		boxShader.setFloat("spotLight.quadratic", 0.032);
-		boxShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-		boxShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));     
+		SpotLightData spotLight = SpotLightData();
+		spotLight.position = camera.Position;
+		spotLight.direction = camera.Front;
+		spotLight.ambient = glm::vec3(0.0f);
+		spotLight.diffuse = glm::vec3(1.0f);
+		spotLight.specular = glm::vec3(1.0f);
+		spotLight.constant = 1.0f;
+		spotLight.linear = 0.09f;
+		spotLight.quadratic = 0.032f;
+		spotLight.cutOff = glm::cos(glm::radians(12.5f));
+		spotLight.outerCutOff = glm::cos(glm::radians(15.0f));
+		lights.SetSpotLight(spotLight);
+		lights.Upload();
 
 		// view/projection transformations
 		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 		glm::mat4 view = camera.GetViewMatrix();
-		boxShader.setMat4("projection", projection);
-		boxShader.setMat4("view", view);
+		FrameUniforms::Get().Update(view, projection, camera.Position, currentFrame);
 
 		// world transformation
 		glm::mat4 model = glm::mat4(1.0f);
@@ -306,61 +287,8 @@ int main()
 		// Draw the cyborg
 		nanoShader.use();
 
-		nanoShader.setVec3("viewPos", camera.Position);
 		nanoShader.setFloat("material.shininess", 32.0f);
 
-		nanoShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-		nanoShader.setVec3("dirLight.ambient", glm::vec3(0.01f));
-		nanoShader.setVec3("dirLight.diffuse", glm::vec3(0.05f));
-		nanoShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-
-		// point light 1
-		nanoShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-		nanoShader.setVec3("pointLights[0].ambient", 1.05f, 0.05f, 0.05f);
-		nanoShader.setVec3("pointLights[0].diffuse", 1.8f, 0.8f, 0.8f);
-		nanoShader.setVec3("pointLights[0].specular", 0.0f, 1.0f, 0.0f);
-		nanoShader.setFloat("pointLights[0].constant", 1.0f);
-		nanoShader.setFloat("pointLights[0].linear", 0.09);
-		nanoShader.setFloat("pointLights[0].quadratic", 0.032);
-		// point light 2
-		nanoShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-		nanoShader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-		nanoShader.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-		nanoShader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-		nanoShader.setFloat("pointLights[1].constant", 1.0f);
-		nanoShader.setFloat("pointLights[1].linear", 0.09);
-		nanoShader.setFloat("pointLights[1].quadratic", 0.032);
-		// point light 3
-		nanoShader.setVec3("pointLights[2].position", pointLightPositions[2]);
-		nanoShader.setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-		nanoShader.setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-		nanoShader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-		nanoShader.setFloat("pointLights[2].constant", 1.0f);
-		nanoShader.setFloat("pointLights[2].linear", 0.09);
-		nanoShader.setFloat("pointLights[2].quadratic", 0.032);
-		// point light 4
-		nanoShader.setVec3("pointLights[3].position", pointLightPositions[3]);
-		nanoShader.setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-		nanoShader.setVec3("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-		nanoShader.setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-		nanoShader.setFloat("pointLights[3].constant", 1.0f);
-		nanoShader.setFloat("pointLights[3].linear", 0.09);
-		nanoShader.setFloat("pointLights[3].quadratic", 0.032);
-		// spotLight
-		nanoShader.setVec3("spotLight.position", camera.Position);
-		nanoShader.setVec3("spotLight.direction", camera.Front);
-		nanoShader.setVec3("spotLight.ambient", glm::vec3(0.5f));
-		nanoShader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-		nanoShader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-		nanoShader.setFloat("spotLight.constant", 1.0f);
-		nanoShader.setFloat("spotLight.linear", 0.09);
-		nanoShader.setFloat("spotLight.quadratic", 0.032);
-		nanoShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-		nanoShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));     
-
-		nanoShader.setMat4("projection", projection);
-		nanoShader.setMat4("view", view);
-
 		model = glm::mat4(1.0f);
 		model = glm::translate(model, glm::vec3(2.0f, -2.0f, 0.0f));
 		model = glm::scale(model, glm::vec3(1.0f));
@@ -373,10 +301,6 @@ int main()
 		nanoShader.setMat4("model", model);
 		nanosuit.Draw(nanoShader);
 
-		// simpleShader.use();
-		// simpleShader.setMat4("projection", projection);
-		// simpleShader.setMat4("view", view);
-
 		// Draw the robot
 		model = glm::mat4(1.0f);
 		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 1.0f));
@@ -386,8 +310,6 @@ int main()
 		
 		// also draw the lamp object(s)
 		lampShader.use();
-		lampShader.setMat4("projection", projection);
-		lampShader.setMat4("view", view);
 		lampShader.setVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
     
 		// we now draw as many light bulbs as we have point lights.
@@ -0,0 +1,248 @@
+// Builds everything the game can load pre-processed, redoing only what changed since the
+// last run (see src/core/asset_manifest.h):
+//  - images -> .ctex containers, see texture_cooker.h
+//  - models -> .meshcache files, after their textures. A model depends on its .obj and .mtl
+//    files, a texture it uses that does not exist fails it.
+//  - shaders are preprocessed to check that their includes resolve. A shader depends on the
+//    files it includes.
+// Jobs of one kind run in parallel on every core. Run from the directory the game runs in.
+//
+//   asset_cooker [--force] [--uncompressed] [--manifest asset_manifest.txt] [directory...]
+
+#include <dirent.h>
+#include <sys/time.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+// model.h expects Shader to be declared, like in main.cpp. The stb_image implementation
+// comes with texture_loader.h through them, and must not be expanded a second time.
+#include "../src/graphics/shader.h"
+#include "../src/graphics/model.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include "../src/graphics/texture_cooker.h"
+#include "../src/core/asset_manifest.h"
+#include "../src/core/thread_pool.h"
+
+using namespace std;
+
+// Bump to rebuild every shader check, the other kinds use their file format versions
+const uint32_t SHADER_CHECK_VERSION = 1;
+
+enum JobKind
+{
+	JOB_TEXTURE,
+	JOB_MODEL,
+	JOB_SHADER
+};
+
+struct Job
+{
+	JobKind kind;
+	string path;
+};
+
+struct Options
+{
+	TextureCookOptions texture;
+	bool force;
+};
+
+bool hasExtension(const string &path, const char *extension)
+{
+	size_t length = strlen(extension);
+	return path.size() > length && path.compare(path.size() - length, length, extension) == 0;
+}
+
+void findJobs(const string &directory, vector<Job> *jobs)
+{
+	DIR *dir = opendir(directory.c_str());
+	if ( !dir )
+	{
+		cout << "ERROR::ASSET_COOKER::CANNOT_OPEN_DIRECTORY::" << directory << endl;
+		return;
+	}
+
+	struct dirent *entry;
+	while ( (entry = readdir(dir)) != NULL )
+	{
+		string name = entry->d_name;
+		if ( name == "." || name == ".." )
+			continue;
+
+		Job job;
+		job.path = directory + "/" + name;
+		if ( entry->d_type == DT_DIR )
+		{
+			findJobs(job.path, jobs);
+			continue;
+		}
+
+		if ( TextureCooker::IsImage(job.path) )
+			job.kind = JOB_TEXTURE;
+		else if ( hasExtension(job.path, ".obj") )
+			job.kind = JOB_MODEL;
+		else if ( hasExtension(job.path, ".vs") || hasExtension(job.path, ".fs") )
+			job.kind = JOB_SHADER;
+		else
+			continue;
+		jobs->push_back(job);
+	}
+	closedir(dir);
+}
+
+string jobKey(const Job &job)
+{
+	static const char *kinds[] = { "texture:", "model:", "shader:" };
+	return kinds[job.kind] + job.path;
+}
+
+uint32_t jobVersion(const Job &job)
+{
+	static const uint32_t versions[] = { TEXTURE_CONTAINER_VERSION, MESH_CACHE_VERSION, SHADER_CHECK_VERSION };
+	return versions[job.kind];
+}
+
+// Output files must still exist for a job to be up to date
+bool hasOutput(const Job &job)
+{
+	int64_t mtime;
+	uint64_t size;
+	if ( job.kind == JOB_TEXTURE )
+		return MappedFile::Stat(TextureContainer::CookedPath(job.path), &mtime, &size);
+	if ( job.kind == JOB_MODEL )
+		return MappedFile::Stat(MeshCache::CachePath(job.path), &mtime, &size);
+	return true;
+}
+
+// The game only uses a .ctex that is not older than its source. A source that was touched
+// without changing is up to date here, so its container is touched too.
+void refreshOutput(const Job &job)
+{
+	if ( job.kind == JOB_TEXTURE && TextureCooker::IsStale(job.path) )
+		utimes(TextureContainer::CookedPath(job.path).c_str(), NULL);
+}
+
+// Builds job, filling the files it read
+bool runJob(const Job &job, const Options &options, vector<string> *dependencies)
+{
+	dependencies->push_back(job.path);
+	if ( job.kind == JOB_TEXTURE )
+	{
+		uint64_t bytes;
+		return TextureCooker::Cook(job.path, options.texture, &bytes);
+	}
+
+	if ( job.kind == JOB_MODEL )
+	{
+		vector<string> libraries = ObjLoader::MaterialLibraries(job.path);
+		for (unsigned int i = 0; i < libraries.size(); i++)
+		{
+			if ( !Vfs::Get().Exists(libraries[i]) )
+			{
+				cout << "ERROR::ASSET_COOKER::MISSING_MATERIAL_LIBRARY::" << libraries[i] << endl;
+				return false;
+			}
+			dependencies->push_back(libraries[i]);
+		}
+
+		vector<string> textures;
+		if ( !Model::WriteMeshCache(job.path, MODEL_LOAD_DEFAULT, &textures) )
+			return false;
+		bool complete = true;
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			if ( !Vfs::Get().Exists(textures[i]) )
+			{
+				cout << "ERROR::ASSET_COOKER::MISSING_TEXTURE::" << textures[i] << " (" << job.path << ")" << endl;
+				complete = false;
+			}
+		}
+		return complete;
+	}
+
+	string source;
+	return ShaderPreprocessor::Process(job.path, ShaderDefines(), &source, dependencies);
+}
+
+int main(int argc, char **argv)
+{
+	Options options;
+	options.force = false;
+	string manifestPath = "asset_manifest.txt";
+	vector<string> directories;
+	for (int i = 1; i < argc; i++)
+	{
+		if ( strcmp(argv[i], "--force") == 0 )
+			options.force = true;
+		else if ( strcmp(argv[i], "--uncompressed") == 0 )
+			options.texture.uncompressed = true;
+		else if ( strcmp(argv[i], "--manifest") == 0 && i + 1 < argc )
+			manifestPath = argv[++i];
+		else
+			directories.push_back(argv[i]);
+	}
+	if ( directories.empty() )
+	{
+		directories.push_back("assets");
+		directories.push_back("shaders");
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<Job> jobs;
+	for (unsigned int i = 0; i < directories.size(); i++)
+		findJobs(directories[i], &jobs);
+
+	AssetManifest manifest;
+	if ( !options.force )
+		manifest.Load(manifestPath);
+
+	// Textures before the models that use them
+	unsigned int cooked = 0, upToDate = 0, failed = 0;
+	JobKind order[] = { JOB_TEXTURE, JOB_MODEL, JOB_SHADER };
+	for (unsigned int k = 0; k < 3; k++)
+	{
+		vector<Job> batch;
+		for (unsigned int i = 0; i < jobs.size(); i++)
+		{
+			if ( jobs[i].kind == order[k] )
+				batch.push_back(jobs[i]);
+		}
+
+		vector<char> results(batch.size());
+		ThreadPool::Shared().ParallelFor(batch.size(), [&](unsigned int i) {
+			string key = jobKey(batch[i]);
+			if ( hasOutput(batch[i]) && manifest.IsUpToDate(key, jobVersion(batch[i])) )
+			{
+				refreshOutput(batch[i]);
+				results[i] = 'u';
+				return;
+			}
+
+			vector<string> dependencies;
+			bool built = runJob(batch[i], options, &dependencies) && manifest.Record(key, jobVersion(batch[i]), dependencies);
+			if ( !built )
+				manifest.Forget(key);
+			results[i] = built ? 'c' : 'f';
+		});
+
+		for (unsigned int i = 0; i < batch.size(); i++)
+		{
+			if ( results[i] == 'c' )
+				cout << "ASSET_COOKER::BUILT::" << jobKey(batch[i]) << endl;
+			else if ( results[i] == 'f' )
+				cout << "ERROR::ASSET_COOKER::FAILED::" << jobKey(batch[i]) << endl;
+			cooked += results[i] == 'c';
+			upToDate += results[i] == 'u';
+			failed += results[i] == 'f';
+		}
+	}
+
+	manifest.Save(manifestPath);
+	float seconds = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+	cout << cooked << " built, " << upToDate << " up to date, " << failed << " failed in " << seconds << " s on "
+			 << ThreadPool::Shared().ThreadCount() << " threads" << endl;
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+// Packs every file below the given directories (assets and shaders by default) into one
+// archive the game mounts at startup, see src/core/archive.h. Run from the directory the
+// game runs in, entries are named by their path relative to it.
+//
+//   asset_packer [--store] [-o assets.pak] [directory...]
+
+#include <dirent.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "../src/core/archive.h"
+
+using namespace std;
+
+bool isTemporary(const string &path)
+{
+	return path.size() > 4 && path.compare(path.size() - 4, 4, ".tmp") == 0;
+}
+
+void findFiles(const string &directory, vector<string> *files)
+{
+	DIR *dir = opendir(directory.c_str());
+	if ( !dir )
+	{
+		cout << "ERROR::ASSET_PACKER::CANNOT_OPEN_DIRECTORY::" << directory << endl;
+		return;
+	}
+
+	struct dirent *entry;
+	while ( (entry = readdir(dir)) != NULL )
+	{
+		string name = entry->d_name;
+		if ( name == "." || name == ".." )
+			continue;
+
+		string path = directory + "/" + name;
+		if ( entry->d_type == DT_DIR )
+			findFiles(path, files);
+		else if ( !isTemporary(path) )
+			files->push_back(path);
+	}
+	closedir(dir);
+}
+
+int main(int argc, char **argv)
+{
+	string output = "assets.pak";
+	bool compress = true;
+	vector<string> directories;
+	for (int i = 1; i < argc; i++)
+	{
+		if ( strcmp(argv[i], "--store") == 0 )
+			compress = false;
+		else if ( strcmp(argv[i], "-o") == 0 && i + 1 < argc )
+			output = argv[++i];
+		else
+			directories.push_back(argv[i]);
+	}
+	if ( directories.empty() )
+	{
+		directories.push_back("assets");
+		directories.push_back("shaders");
+	}
+
+	vector<string> files;
+	for (unsigned int i = 0; i < directories.size(); i++)
+		findFiles(directories[i], &files);
+
+	ArchiveWriter writer;
+	uint64_t totalBytes = 0;
+	unsigned int failed = 0;
+	for (unsigned int i = 0; i < files.size(); i++)
+	{
+		int64_t mtime;
+		uint64_t size;
+		ifstream file(files[i].c_str(), ios::binary);
+		if ( !MappedFile::Stat(files[i], &mtime, &size) || !file )
+		{
+			cout << "ERROR::ASSET_PACKER::CANNOT_READ::" << files[i] << endl;
+			failed++;
+			continue;
+		}
+
+		vector<unsigned char> data(size);
+		if ( size > 0 && !file.read((char *)data.data(), size) )
+		{
+			cout << "ERROR::ASSET_PACKER::CANNOT_READ::" << files[i] << endl;
+			failed++;
+			continue;
+		}
+		writer.Add(files[i], data, mtime, compress);
+		totalBytes += size;
+	}
+
+	uint64_t archiveBytes;
+	if ( !writer.Write(output, &archiveBytes) )
+		return 1;
+
+	cout << writer.FileCount() << " files, " << totalBytes / 1024 << " KB -> " << output << " " << archiveBytes / 1024 << " KB, "
+			 << failed << " failed" << endl;
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+// Times ObjLoader against Assimp (with the flags Model uses) on the given .obj files, the
+// game's models by default. Both only parse, no mesh optimization or GL.
+//
+//   obj_benchmark [--runs 10] [file.obj...]
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include "../src/graphics/obj_loader.h"
+
+using namespace std;
+
+double milliseconds(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Best of runs, the first one also warms the page cache
+double timeObjLoader(const string &path, unsigned int runs, unsigned int *vertexCount)
+{
+	double best = 1e30;
+	for (unsigned int i = 0; i < runs; i++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		vector<ObjMesh> meshes;
+		if ( !ObjLoader::Load(path, meshes) )
+			return -1.0;
+		double elapsed = milliseconds(start);
+		best = elapsed < best ? elapsed : best;
+
+		*vertexCount = 0;
+		for (unsigned int j = 0; j < meshes.size(); j++)
+			*vertexCount += meshes[j].vertices.size();
+	}
+	return best;
+}
+
+double timeAssimp(const string &path, unsigned int runs, unsigned int *vertexCount)
+{
+	double best = 1e30;
+	for (unsigned int i = 0; i < runs; i++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		Assimp::Importer import;
+		const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs);
+		if ( !scene )
+			return -1.0;
+		double elapsed = milliseconds(start);
+		best = elapsed < best ? elapsed : best;
+
+		*vertexCount = 0;
+		for (unsigned int j = 0; j < scene->mNumMeshes; j++)
+			*vertexCount += scene->mMeshes[j]->mNumVertices;
+	}
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int runs = 10;
+	vector<string> files;
+	for (int i = 1; i < argc; i++)
+	{
+		if ( strcmp(argv[i], "--runs") == 0 && i + 1 < argc )
+			runs = atoi(argv[++i]);
+		else
+			files.push_back(argv[i]);
+	}
+	if ( files.empty() )
+	{
+		files.push_back("assets/nanosuit/nanosuit.obj");
+		files.push_back("assets/planet/planet.obj");
+	}
+	runs = runs > 0 ? runs : 1;
+
+	for (unsigned int i = 0; i < files.size(); i++)
+	{
+		unsigned int objVertices = 0, assimpVertices = 0;
+		double objTime = timeObjLoader(files[i], runs, &objVertices);
+		double assimpTime = timeAssimp(files[i], runs, &assimpVertices);
+		if ( objTime < 0.0 || assimpTime < 0.0 )
+		{
+			cout << "ERROR::OBJ_BENCHMARK::CANNOT_LOAD::" << files[i] << endl;
+			continue;
+		}
+
+		cout << files[i] << ": ObjLoader " << objTime << " ms (" << objVertices << " vertices), Assimp " << assimpTime << " ms ("
+				 << assimpVertices << " vertices), " << assimpTime / objTime << "x" << endl;
+	}
+	return 0;
+}
@@ -0,0 +1,82 @@
+// Cooks every image below the given directories (assets by default) into .ctex containers
+// next to the sources, skipping the ones that are up to date.
+//
+//   texture_cooker [--force] [--uncompressed] [directory...]
+
+#include <dirent.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+// texture_cooker.h includes stb_image
+#define STB_IMAGE_IMPLEMENTATION
+#include "../src/graphics/texture_cooker.h"
+
+using namespace std;
+
+void findImages(const string &directory, vector<string> *images)
+{
+	DIR *dir = opendir(directory.c_str());
+	if ( !dir )
+	{
+		cout << "ERROR::TEXTURE_COOKER::CANNOT_OPEN_DIRECTORY::" << directory << endl;
+		return;
+	}
+
+	struct dirent *entry;
+	while ( (entry = readdir(dir)) != NULL )
+	{
+		string name = entry->d_name;
+		if ( name == "." || name == ".." )
+			continue;
+
+		string path = directory + "/" + name;
+		if ( entry->d_type == DT_DIR )
+			findImages(path, images);
+		else if ( TextureCooker::IsImage(path) )
+			images->push_back(path);
+	}
+	closedir(dir);
+}
+
+int main(int argc, char **argv)
+{
+	TextureCookOptions options;
+	bool force = false;
+	vector<string> directories;
+	for (int i = 1; i < argc; i++)
+	{
+		if ( strcmp(argv[i], "--force") == 0 )
+			force = true;
+		else if ( strcmp(argv[i], "--uncompressed") == 0 )
+			options.uncompressed = true;
+		else
+			directories.push_back(argv[i]);
+	}
+	if ( directories.empty() )
+		directories.push_back("assets");
+
+	vector<string> images;
+	for (unsigned int i = 0; i < directories.size(); i++)
+		findImages(directories[i], &images);
+
+	unsigned int cooked = 0, failed = 0;
+	for (unsigned int i = 0; i < images.size(); i++)
+	{
+		if ( !force && !TextureCooker::IsStale(images[i]) )
+			continue;
+
+		uint64_t bytes;
+		if ( !TextureCooker::Cook(images[i], options, &bytes) )
+		{
+			failed++;
+			continue;
+		}
+		cooked++;
+		cout << images[i] << " -> " << bytes / 1024 << " KB" << endl;
+	}
+
+	cout << cooked << " cooked, " << images.size() - cooked - failed << " up to date, " << failed << " failed" << endl;
+	return failed == 0 ? 0 : 1;
+}